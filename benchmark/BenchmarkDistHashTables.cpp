@@ -104,6 +104,7 @@ static int measure_mode = MEASURE_DISABLED;
 #define MURMUR64avx 28
 #define CRC32C 29
 #define CLHASH 30
+#define CRC32C64 36
 
 #define COUNT 33
 #define FIRST 34
@@ -149,6 +150,9 @@ using DistHash = ::fsc::hash::murmur32<KM>;
 #elif (pDistHash == CRC32C)
 template <typename KM>
 using DistHash = ::fsc::hash::crc32c<KM>;
+#elif (pDistHash == CRC32C64)
+template <typename KM>
+using DistHash = ::fsc::hash::crc32c64<KM>;
 #elif (pDistHash == CLHASH)
 template <typename KM>
 using DistHash = ::fsc::hash::clhash<KM>;
@@ -190,6 +194,9 @@ using StoreHash = ::fsc::hash::murmur32<KM>;
 #elif (pStoreHash == CRC32C)
 template <typename KM>
 using StoreHash = ::fsc::hash::crc32c<KM>;
+#elif (pStoreHash == CRC32C64)
+template <typename KM>
+using StoreHash = ::fsc::hash::crc32c64<KM>;
 #elif (pStoreHash == CLHASH)
 template <typename KM>
 using StoreHash = ::fsc::hash::clhash<KM>;
@@ -728,6 +735,44 @@ void benchmark(std::vector<TT> const & input,
     BL_BENCH_REPORT_MPI_NAMED(test, name, comm);
 }
 
+// one-sided asynchronous insert of the same input, in uneven batches:  rank r makes batches + r async_insert calls.
+template <typename MapType, typename TT>
+void benchmark_async_insert(std::vector<TT> const & input,
+               std::string const &name,
+               size_t const &batches,
+               mxx::comm const &comm)
+{
+    BL_BENCH_INIT(test);
+
+    BL_BENCH_COLLECTIVE_START(test, "init", comm);
+    MapType map(comm);
+    map.async_insert_begin();
+    BL_BENCH_END(test, "init", map.local_size());
+
+    size_t nbatches = batches + comm.rank();
+    size_t step = (input.size() + nbatches - 1) / nbatches;
+
+    BL_BENCH_COLLECTIVE_START(test, "async_insert", comm);
+    std::vector<TT> in;
+    for (size_t i = 0; i < input.size(); i += step)
+    {
+        in.assign(input.begin() + i, input.begin() + std::min(input.size(), i + step));
+        map.async_insert(in);
+    }
+    BL_BENCH_END(test, "async_insert", map.local_size());
+
+    BL_BENCH_COLLECTIVE_START(test, "async_insert_end", comm);
+    map.async_insert_end();
+    BL_BENCH_END(test, "async_insert_end", map.local_size());
+
+    // debug print total map size.
+    size_t total = map.size();
+    if (comm.rank() == 0)
+        printf("total map size after async insert is %lu\n", total);
+
+    BL_BENCH_REPORT_MPI_NAMED(test, name, comm);
+}
+
 /**
  *
  * @param argc
@@ -767,6 +812,7 @@ int main(int argc, char **argv)
     float missing_frac = 0.0;
 
     bool hybrid = false;
+    size_t async_batches = 0;
 
     // Wrap everything in a try block.  Do this every time,
     // because exceptions will be thrown for problems.
@@ -792,6 +838,9 @@ int main(int argc, char **argv)
 
         // TCLAP::SwitchArg balanceArg("b", "balance-input", "balance the input", cmd, balance_input);
         TCLAP::SwitchArg hybridArg("", "hybrid", "OMP MPI hybrid hash tables", cmd, hybrid);
+        TCLAP::ValueArg<size_t> asyncArg("", "async-batches",
+                                          "also run the one-sided async insert with this many batches on rank 0, one more per rank. default=0 (off)",
+                                          false, async_batches, "size_t", cmd);
         TCLAP::ValueArg<float> missingArg("",
                                           "missing-frac", "fraction of query keys not in table. default=0.0 (all in)",
                                           false, missing_frac, "float", cmd);
@@ -828,6 +877,7 @@ int main(int argc, char **argv)
 
         // balance_input = balanceArg.getValue();
         hybrid = hybridArg.getValue();
+        async_batches = asyncArg.getValue();
 
         missing_frac = missingArg.getValue();
 
@@ -1010,10 +1060,14 @@ if (hybrid) {
 #elif (pINDEX == FIRST)
     using REDUC = ::fsc::DiscardReducer;
     benchmark<::dsc::reduction_batched_robinhood_map<KeyType, ValType, MapParams, REDUC>, BROBINHOOD>(input, query, "robinhood_first", max_load, min_load, insert_prefetch, query_prefetch, comm);
+    if (async_batches > 0)
+        benchmark_async_insert<::dsc::reduction_batched_robinhood_map<KeyType, ValType, MapParams, REDUC>>(input, "robinhood_first_async", async_batches, comm);
     benchmark<::dsc::reduction_batched_radixsort_map<KeyType, ValType, MapParams, REDUC>, RADIXSORT>(input, query, "radixsort_first", max_load, min_load, insert_prefetch, query_prefetch, comm);
 #elif (pINDEX == LAST)
     using REDUC = ::fsc::ReplaceReducer;
     benchmark<::dsc::reduction_batched_robinhood_map<KeyType, ValType, MapParams, REDUC>, BROBINHOOD>(input, query, "robinhood_last", max_load, min_load, insert_prefetch, query_prefetch, comm);
+    if (async_batches > 0)
+        benchmark_async_insert<::dsc::reduction_batched_robinhood_map<KeyType, ValType, MapParams, REDUC>>(input, "robinhood_last_async", async_batches, comm);
     benchmark<::dsc::reduction_batched_radixsort_map<KeyType, ValType, MapParams, REDUC>, RADIXSORT>(input, query, "radixsort_last", max_load, min_load, insert_prefetch, query_prefetch, comm);
 #else
     static_assert(false, "UNSUPPORTED REDUCTION TYPE");
@@ -1021,6 +1075,12 @@ if (hybrid) {
 
 } // done hybrid
 
+#if defined(KHMXX_COMM_TRACE)
+    // per rank timeline of the overlapped exchanges as Chrome trace JSON, and the overlap summary.
+    ::khmxx::trace::comm_trace::get().dump(std::string("khmxx_comm_trace"), comm.rank());
+    ::khmxx::trace::report(comm, std::cout);
+#endif
+
     // mpi cleanup is automatic
     comm.barrier();
 
@@ -28,8 +28,13 @@
 #include <cstdlib>    // std::rand
 #include <sstream>
 #include <exception>
+#include <fstream>    // fastq input for hash quality
+#include <random>
+#include <chrono>
+#include <iomanip>
 
 #include "kmerhash/hash_new.hpp"
+#include "kmerhash/hyperloglog64.hpp"
 #include "utils/benchmark_utils.hpp"
 
 #include "tclap/CmdLine.h"
@@ -299,6 +304,20 @@ BL_BENCH_END(benchmark, "clhash", count);
   }
   BL_BENCH_END(benchmark, "CRC32C1", count);
 
+  BL_BENCH_START(benchmark);
+  {
+    ::fsc::hash::crc32c<DataStruct<N> > h;
+     benchmark_hash_batch(h, data, out, count);
+  }
+  BL_BENCH_END(benchmark, "CRC32Cbatch", count);
+
+  BL_BENCH_START(benchmark);
+  {
+    ::fsc::hash::crc32c64<DataStruct<N> > h;
+     benchmark_hash_batch(h, data, out64, count);
+  }
+  BL_BENCH_END(benchmark, "CRC32C64batch", count);
+
 //  BL_BENCH_START(benchmark);
 //  {
 //#ifdef VTUNE_ANALYSIS
@@ -324,6 +343,260 @@ BL_BENCH_END(benchmark, "clhash", count);
 }
 
 
+//============ hash quality.
+// distribution quality matters as much as speed: an uneven dist hash shows up as rank imbalance
+// (see the "up to 30% difference" note in incremental_mxx.hpp), an uneven storage hash
+// shows up as long robinhood probe distances, and both feed the HLL estimate used for table sizing.
+// the quality report evaluates each hash on 2-bit encoded k-mers (k <= 32, so one uint64_t per k-mer)
+// from a FASTQ file and on adversarial low-complexity k-mers.
+
+using kmer_word_type = uint64_t;
+
+// use batch mode if the hash function supports it.
+template <typename H, typename HT>
+inline auto compute_hashes(H const & hasher, kmer_word_type const * keys, size_t count, HT * hashes, int)
+-> decltype(hasher.hash(keys, count, hashes), void()) {
+  hasher.hash(keys, count, hashes);
+}
+template <typename H, typename HT>
+inline void compute_hashes(H const & hasher, kmer_word_type const * keys, size_t count, HT * hashes, long) {
+  for (size_t i = 0; i < count; ++i) {
+    hashes[i] = hasher(keys[i]);
+  }
+}
+
+/// 2-bit encode A/C/G/T.  others (N, etc) return 4.
+inline uint8_t encode_dna(char c) {
+  switch (c) {
+    case 'A': case 'a': return 0;
+    case 'C': case 'c': return 1;
+    case 'G': case 'g': return 2;
+    case 'T': case 't': return 3;
+    default: return 4;
+  }
+}
+
+/// reverse complement of a 2-bit encoded k-mer, k <= 32.
+inline kmer_word_type revcomp_word(kmer_word_type x, uint8_t k) {
+  x = ~x;  // complement, A<->T, C<->G
+  // reverse the 2-bit groups.
+  x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+  x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+  x = __builtin_bswap64(x);
+  return x >> (64 - 2 * k);
+}
+
+/// extract canonical k-mers from a sequence, skipping windows with non-ACGT characters.
+inline void sequence_to_kmers(std::string const & seq, uint8_t k, std::vector<kmer_word_type> & kmers) {
+  kmer_word_type kmer_mask = (k == 32) ? ~(0ULL) : ((0x1ULL << (2 * k)) - 1);
+  kmer_word_type kmer = 0;
+  uint8_t valid = 0;
+  uint8_t c;
+  for (size_t i = 0; i < seq.size(); ++i) {
+    c = encode_dna(seq[i]);
+    if (c > 3) { valid = 0; kmer = 0; continue; }
+
+    kmer = ((kmer << 2) | c) & kmer_mask;
+    if (valid < k) ++valid;
+    if (valid == k) kmers.emplace_back(::std::min(kmer, revcomp_word(kmer, k)));
+  }
+}
+
+/// read up to count k-mers from a FASTQ file.  sequence is line 2 of each 4-line record.
+std::vector<kmer_word_type> read_fastq_kmers(std::string const & filename, uint8_t k, size_t count) {
+  std::vector<kmer_word_type> kmers;
+  kmers.reserve(count);
+
+  std::ifstream ifs(filename);
+  if (!ifs.is_open()) {
+    throw std::invalid_argument("Unable to open FASTQ file.");
+  }
+
+  std::string line;
+  size_t line_id = 0;
+  while ((kmers.size() < count) && std::getline(ifs, line)) {
+    if ((line_id & 0x3) == 1) sequence_to_kmers(line, k, kmers);
+    ++line_id;
+  }
+  if (kmers.size() > count) kmers.resize(count);
+  return kmers;
+}
+
+/// low complexity k-mers:  homopolymer and short tandem repeats (telomere, dinucleotide, triplet) with rare
+/// substitutions, interleaved.  These have few distinct k-mers and long runs of identical high/low bits.
+std::vector<kmer_word_type> generate_low_complexity_kmers(uint8_t k, size_t count) {
+  std::vector<std::string> units = {"A", "AC", "AT", "CAG", "TTAGGG", "GGGGCC", "AAAAAAAAAC"};
+  std::vector<kmer_word_type> kmers;
+  kmers.reserve(count + 1024);
+
+  std::default_random_engine generator(1234);
+  std::uniform_int_distribution<size_t> pos_dist(0, 1023);
+  std::uniform_int_distribution<int> base_dist(0, 3);
+  const char bases[] = "ACGT";
+
+  std::string seq;
+  size_t u = 0;
+  while (kmers.size() < count) {
+    // 1024 bp "read" from a repeat unit, with about 1 substitution per 256 bp.
+    seq.clear();
+    while (seq.size() < 1024) seq.append(units[u]);
+    seq.resize(1024);
+    for (size_t m = 0; m < 4; ++m) seq[pos_dist(generator)] = bases[static_cast<uint8_t>(base_dist(generator))];
+
+    sequence_to_kmers(seq, k, kmers);
+    u = (u + 1) % units.size();
+  }
+  kmers.resize(count);
+  return kmers;
+}
+
+/// sequential k-mers:  only low bits vary.  stresses hashes that do not mix low into high bits.
+std::vector<kmer_word_type> generate_sequential_kmers(size_t count) {
+  std::vector<kmer_word_type> kmers(count);
+  for (size_t i = 0; i < count; ++i) kmers[i] = i;
+  return kmers;
+}
+
+/// uniformly random k-mers, as baseline.
+std::vector<kmer_word_type> generate_random_kmers(uint8_t k, size_t count) {
+  kmer_word_type kmer_mask = (k == 32) ? ~(0ULL) : ((0x1ULL << (2 * k)) - 1);
+  std::vector<kmer_word_type> kmers(count);
+  std::default_random_engine generator(4321);
+  std::uniform_int_distribution<kmer_word_type> distribution;
+  for (size_t i = 0; i < count; ++i) kmers[i] = distribution(generator) & kmer_mask;
+  return kmers;
+}
+
+
+/// bucket load skew when assigning hash values to p ranks, the same way as the distributed maps do (modulus or mask).
+/// returns max/mean, and sets min_max_diff to (max - min)/max.
+template <typename HT>
+double rank_skew(HT const * hashes, size_t count, size_t p, double & min_max_diff) {
+  std::vector<size_t> counts(p, 0);
+  bool is_pow2 = (p & (p - 1)) == 0;
+  if (is_pow2) {
+    HT mask = static_cast<HT>(p - 1);
+    for (size_t i = 0; i < count; ++i) ++counts[hashes[i] & mask];
+  } else {
+    for (size_t i = 0; i < count; ++i) ++counts[hashes[i] % p];
+  }
+  auto minmax = std::minmax_element(counts.begin(), counts.end());
+  min_max_diff = (*(minmax.second) == 0) ? 0.0 :
+      static_cast<double>(*(minmax.second) - *(minmax.first)) / static_cast<double>(*(minmax.second));
+  return static_cast<double>(*(minmax.second)) * static_cast<double>(p) / static_cast<double>(count);
+}
+
+/// max and mean probe distance of a robinhood table, given the hash values of distinct keys.
+/// table size and bucket selection follows hashmap_robinhood_offsets_reduction:  power of 2 buckets
+/// with max load factor 0.8, bucket = hash & mask, non-circular with overflow region.
+/// with robinhood, entries end up ordered by bucket, so an entry's position is max(bucket, prev pos + 1).
+template <typename HT>
+size_t max_probe_distance(HT const * hashes, size_t count, double & mean_dist, double const max_load = 0.8) {
+  size_t buckets = 1;
+  while (static_cast<double>(buckets) * max_load < static_cast<double>(count)) buckets <<= 1;
+  size_t mask = buckets - 1;
+
+  std::vector<uint32_t> counts(buckets, 0);
+  for (size_t i = 0; i < count; ++i) ++counts[static_cast<size_t>(hashes[i]) & mask];
+
+  size_t next_pos = 0, pos, max_dist = 0;
+  double total = 0;
+  for (size_t b = 0; b < buckets; ++b) {
+    for (uint32_t j = 0; j < counts[b]; ++j) {
+      pos = ::std::max(next_pos, b);
+      max_dist = ::std::max(max_dist, pos - b);
+      total += static_cast<double>(pos - b);
+      next_pos = pos + 1;
+    }
+  }
+  mean_dist = (count == 0) ? 0.0 : total / static_cast<double>(count);
+  return max_dist;
+}
+
+/// compute the quality metrics for one hash function and one input set.
+/// keys: all k-mers (with repeats).  uniq_keys: distinct k-mers.
+template <typename H>
+void hash_quality(std::string const & hash_name, std::string const & input_name,
+                  std::vector<kmer_word_type> const & keys,
+                  std::vector<kmer_word_type> const & uniq_keys,
+                  std::vector<size_t> const & rank_counts) {
+  H hasher;
+  using HT = decltype(hasher(::std::declval<kmer_word_type>()));
+
+  HT * hashes = ::utils::mem::aligned_alloc<HT>(keys.size() + 64);
+
+  // throughput and rank skew on all keys, as in the distributed insert.
+  auto start = std::chrono::high_resolution_clock::now();
+  compute_hashes(hasher, keys.data(), keys.size(), hashes, 0);
+  auto end = std::chrono::high_resolution_clock::now();
+  double secs = std::chrono::duration<double>(end - start).count();
+
+  std::stringstream ss;
+  ss << std::setprecision(4) << std::fixed;
+  ss << hash_name << "\t" << input_name << "\t" << (sizeof(HT) * 8) << "bit\t"
+     << (static_cast<double>(keys.size()) / secs / 1000000.0) << " Mkeys/s";
+
+  double diff;
+  for (size_t p : rank_counts) {
+    double skew = rank_skew(hashes, keys.size(), p, diff);
+    ss << "\tp=" << p << ":" << skew << "/" << diff;
+  }
+
+  // HLL estimate vs exact distinct count.
+  hyperloglog64<kmer_word_type, H, 12> hll;
+  hll.update_via_hashval(hashes, keys.size());
+  double est = hll.estimate();
+  ss << "\tHLL_err=" << ((est - static_cast<double>(uniq_keys.size())) / static_cast<double>(uniq_keys.size()));
+
+  // probe distance on the distinct keys, as in the local table.
+  compute_hashes(hasher, uniq_keys.data(), uniq_keys.size(), hashes, 0);
+  double mean_dist;
+  size_t max_dist = max_probe_distance(hashes, uniq_keys.size(), mean_dist);
+  ss << "\tprobe_max=" << max_dist << "\tprobe_mean=" << mean_dist;
+  if (max_dist > 127) ss << " (exceeds robinhood offset limit)";
+
+  std::cout << ss.str() << std::endl;
+
+  ::utils::mem::aligned_free(hashes);
+}
+
+/// compute the quality metrics for all hash functions on one input set.
+void hash_quality_all(std::string const & input_name, std::vector<kmer_word_type> const & keys) {
+  if (keys.size() == 0) {
+    std::cout << input_name << ": no k-mers." << std::endl;
+    return;
+  }
+
+  std::vector<kmer_word_type> uniq_keys(keys);
+  std::sort(uniq_keys.begin(), uniq_keys.end());
+  uniq_keys.erase(std::unique(uniq_keys.begin(), uniq_keys.end()), uniq_keys.end());
+
+  std::cout << "hash quality on " << input_name << ": " << keys.size() << " k-mers, " << uniq_keys.size() << " distinct." << std::endl;
+  std::cout << "\tp=RANKS:max/mean load / (max-min)/max load; HLL_err: relative error at precision 12; probe: robinhood offsets at load 0.8" << std::endl;
+
+  std::vector<size_t> rank_counts = {16, 64, 96, 256, 1000, 1024, 4096};
+
+  hash_quality<::std::hash<kmer_word_type> >("STD", input_name, keys, uniq_keys, rank_counts);
+  hash_quality<::fsc::hash::identity<kmer_word_type> >("IDEN", input_name, keys, uniq_keys, rank_counts);
+  hash_quality<::fsc::hash::murmur<kmer_word_type> >("MURMUR", input_name, keys, uniq_keys, rank_counts);
+  hash_quality<::fsc::hash::murmur32<kmer_word_type> >("MURMUR32", input_name, keys, uniq_keys, rank_counts);
+  hash_quality<::fsc::hash::farm<kmer_word_type> >("FARM", input_name, keys, uniq_keys, rank_counts);
+  hash_quality<::fsc::hash::farm32<kmer_word_type> >("FARM32", input_name, keys, uniq_keys, rank_counts);
+#if defined(__SSE4_1__)
+  hash_quality<::fsc::hash::murmur3sse32<kmer_word_type> >("MURMUR32sse", input_name, keys, uniq_keys, rank_counts);
+#endif
+#if defined(__SSE4_2__)
+  hash_quality<::fsc::hash::crc32c<kmer_word_type> >("CRC32C", input_name, keys, uniq_keys, rank_counts);
+  hash_quality<::fsc::hash::crc32c64<kmer_word_type> >("CRC32C64", input_name, keys, uniq_keys, rank_counts);
+#endif
+#if defined(__AVX2__)
+  hash_quality<::fsc::hash::murmur3avx32<kmer_word_type> >("MURMUR32avx", input_name, keys, uniq_keys, rank_counts);
+  hash_quality<::fsc::hash::murmur3avx64<kmer_word_type> >("MURMUR64avx", input_name, keys, uniq_keys, rank_counts);
+  hash_quality<::fsc::hash::clhash<kmer_word_type> >("CLHASH", input_name, keys, uniq_keys, rank_counts);
+#endif
+}
+
+
 int main(int argc, char** argv) {
 
 #ifdef VTUNE_ANALYSIS
@@ -332,6 +605,9 @@ int main(int argc, char** argv) {
 
       size_t count = 100000000;
       size_t el_size = 0;
+      bool quality = false;
+      std::string fastq_file;
+      uint8_t k = 31;
 
       try {
 
@@ -349,6 +625,9 @@ int main(int argc, char** argv) {
 
         TCLAP::ValueArg<size_t> countArg("c","count","number of elements to hash", false, count, "size_t", cmd);
         TCLAP::ValueArg<size_t> elSizeArg("e","el_size","size of elements in bytes. 0 to run all", false, el_size, "size_t", cmd);
+        TCLAP::SwitchArg qualityArg("q", "quality", "report hash quality (rank skew, robinhood probe distance, HLL error) instead of speed", cmd, quality);
+        TCLAP::ValueArg<std::string> fileArg("F","file","FASTQ file for hash quality k-mers.  random k-mers used if not specified", false, "", "string", cmd);
+        TCLAP::ValueArg<int> kArg("k","kmer_size","k-mer size for hash quality, up to 32", false, k, "int", cmd);
 
     #ifdef VTUNE_ANALYSIS
         std::vector<std::string> measure_modes;
@@ -370,6 +649,9 @@ int main(int argc, char** argv) {
 
         count = countArg.getValue();
         el_size = elSizeArg.getValue();
+        quality = qualityArg.getValue();
+        fastq_file = fileArg.getValue();
+        k = static_cast<uint8_t>(::std::min(32, ::std::max(1, kArg.getValue())));
         std::cout << "Executing for " << el_size << " element size. 0 means all" << std::endl;
 
     #ifdef VTUNE_ANALYSIS
@@ -407,6 +689,18 @@ int main(int argc, char** argv) {
         exit(-1);
       }
 
+  if (quality) {
+    if (fastq_file.length() > 0)
+      hash_quality_all(std::string("fastq ") + fastq_file, read_fastq_kmers(fastq_file, k, count));
+    else
+      hash_quality_all("random", generate_random_kmers(k, count));
+
+    hash_quality_all("low_complexity", generate_low_complexity_kmers(k, count));
+    hash_quality_all("sequential", generate_sequential_kmers(count));
+
+    // no measured region here, so collection stays paused.
+    return 0;
+  }
 
 
 
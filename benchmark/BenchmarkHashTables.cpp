@@ -120,6 +120,7 @@
 #define MURMUR64avx 28
 #define CRC32C 29
 #define CLHASH 30
+#define CRC32C64 36
 
 
 #define LOOK_AHEAD 16
@@ -152,6 +153,9 @@ using CountType = uint32_t;
 #elif (pStoreHash == CRC32C)
   template <typename KM>
   using StoreHash = fsc::hash::crc32c<KM>;
+#elif (pStoreHash == CRC32C64)
+  template <typename KM>
+  using StoreHash = fsc::hash::crc32c64<KM>;
 #elif (pStoreHash == CLHASH)
   template <typename KM>
   using StoreHash = fsc::hash::clhash<KM>;
@@ -104,6 +104,7 @@ static int measure_mode = MEASURE_DISABLED;
 #include "index/kmer_hash.hpp"   // workaround for distributed_map_base requiring farm hash.
 
 #include "kmerhash/hash_new.hpp"
+#include "kmerhash/kmer_transform_avx.hpp"
 #include "kmerhash/distributed_robinhood_map.hpp"
 #include "kmerhash/distributed_batched_robinhood_map.hpp"
 #include "kmerhash/distributed_batched_radixsort_map.hpp"
@@ -141,6 +142,7 @@ static int measure_mode = MEASURE_DISABLED;
 #define MURMUR64avx 28
 #define CRC32C 29
 #define CLHASH 30
+#define CRC32C64 36
 
 #define POS 31
 #define POSQUAL 32
@@ -226,6 +228,19 @@ using KmerType = bliss::common::Kmer<31, Alphabet, uint64_t>;
 //----- get them all. may not use subsequently.
 
 // distribution transforms
+#if (pMAP == MTRADIXSORT) || (pMAP == RADIXSORT) || (pMAP == MTROBINHOOD) || (pMAP == BROBINHOOD)
+// batched (SIMD) canonicalization for TransformedHash, same results as the bliss transforms.
+#if (pDistTrans == LEX)
+	template <typename KM>
+	using DistTrans = ::fsc::kmer::transform::lex_less<KM>;
+#elif (pDistTrans == XOR)
+	template <typename KM>
+	using DistTrans = ::fsc::kmer::transform::xor_rev_comp<KM>;
+#else //if (pDistTrans == IDEN)
+	template <typename KM>
+	using DistTrans = bliss::transform::identity<KM>;
+#endif
+#else
 #if (pDistTrans == LEX)
 	template <typename KM>
 	using DistTrans = bliss::kmer::transform::lex_less<KM>;
@@ -263,6 +278,9 @@ using KmerType = bliss::common::Kmer<31, Alphabet, uint64_t>;
 	#elif (pDistHash == CRC32C)
 	  template <typename KM>
 	  using DistHash = ::fsc::hash::crc32c<KM>;
+	#elif (pDistHash == CRC32C64)
+	  template <typename KM>
+	  using DistHash = ::fsc::hash::crc32c64<KM>;
 	#elif (pDistHash == CLHASH)
 	  template <typename KM>
 	  using DistHash = ::fsc::hash::clhash<KM>;
@@ -320,6 +338,9 @@ using KmerType = bliss::common::Kmer<31, Alphabet, uint64_t>;
 	#elif (pStoreHash == CRC32C)
 	  template <typename KM>
 	  using StoreHash = ::fsc::hash::crc32c<KM>;
+	#elif (pStoreHash == CRC32C64)
+	  template <typename KM>
+	  using StoreHash = ::fsc::hash::crc32c64<KM>;
 	#elif (pStoreHash == CLHASH)
 	  template <typename KM>
 	  using StoreHash = ::fsc::hash::clhash<KM>;
@@ -349,6 +370,9 @@ using KmerType = bliss::common::Kmer<31, Alphabet, uint64_t>;
 	#elif (pStoreHash == CRC32C)
 	  template <typename KM>
 	  using StoreHash = ::fsc::hash::crc32c<KM>;
+	#elif (pStoreHash == CRC32C64)
+	  template <typename KM>
+	  using StoreHash = ::fsc::hash::crc32c64<KM>;
 	#else
 	  static_assert(false, "DENSEHASH, unordered map, sorted, ordered, and ROBINHOOD do not support the specified store hash function");
 	#endif
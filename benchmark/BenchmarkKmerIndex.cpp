@@ -81,6 +81,7 @@ static int measure_mode = MEASURE_DISABLED;
 #include "index/kmer_hash.hpp"   // workaround for distributed_map_base requiring farm hash.
 
 #include "kmerhash/hash_new.hpp"
+#include "kmerhash/kmer_transform_avx.hpp"
 #include "kmerhash/distributed_robinhood_map.hpp"
 #include "kmerhash/distributed_batched_robinhood_map.hpp"
 #include "kmerhash/distributed_batched_radixsort_map.hpp"
@@ -120,6 +121,9 @@ static int measure_mode = MEASURE_DISABLED;
 #define MURMUR64avx 28
 #define CRC32C 29
 #define CLHASH 30
+#define CRC32C64 36
+// optional: -DpHashCapacityBits=<log2 of expected distinct k-mers>.  64 bit MURMUR64avx and CRC32C64 are narrowed
+//   to 32 bit hash values when <= 27.  see ::fsc::hash::hash_width_policy.
 
 #define POS 31
 #define POSQUAL 32
@@ -196,13 +200,26 @@ using CountType = uint32_t;
 //----- get them all. may not use subsequently.
 
 // distribution transforms
+#if (pMAP == MTRADIXSORT) || (pMAP == RADIXSORT) || (pMAP == MTROBINHOOD) || (pMAP == BROBINHOOD)
+// batched (SIMD) canonicalization for TransformedHash, same results as the bliss transforms.
+#if (pDistTrans == LEX)
+	template <typename KM>
+	using DistTrans = ::fsc::kmer::transform::lex_less<KM>;
+#elif (pDistTrans == XOR)
+	template <typename KM>
+	using DistTrans = ::fsc::kmer::transform::xor_rev_comp<KM>;
+#else //if (pDistTrans == IDEN)
+	template <typename KM>
+	using DistTrans = bliss::transform::identity<KM>;
+#endif
+#else
 #if (pDistTrans == LEX)
 	template <typename KM>
 	using DistTrans = bliss::kmer::transform::lex_less<KM>;
 #elif (pDistTrans == XOR)
 	template <typename KM>
 	using DistTrans = bliss::kmer::transform::xor_rev_comp<KM>;
-#elif (pDistTrans == IDEN) //if (pDistTrans == IDEN)
+#else //if (pDistTrans == IDEN)
 	template <typename KM>
 	using DistTrans = bliss::transform::identity<KM>;
 #endif
@@ -228,10 +245,21 @@ using CountType = uint32_t;
   using DistHash = ::fsc::hash::murmur3avx32<KM>;
 #elif (pDistHash == MURMUR64avx)
   template <typename KM>
+#if defined(pHashCapacityBits)
+  using DistHash = typename ::fsc::hash::hash_width_policy<::fsc::hash::murmur3avx64, pHashCapacityBits>::template hash<KM>;
+#else
   using DistHash = ::fsc::hash::murmur3avx64<KM>;
+#endif
 #elif (pDistHash == CRC32C)
   template <typename KM>
   using DistHash = ::fsc::hash::crc32c<KM>;
+#elif (pDistHash == CRC32C64)
+  template <typename KM>
+#if defined(pHashCapacityBits)
+  using DistHash = typename ::fsc::hash::hash_width_policy<::fsc::hash::crc32c64, pHashCapacityBits>::template hash<KM>;
+#else
+  using DistHash = ::fsc::hash::crc32c64<KM>;
+#endif
 #elif (pDistHash == CLHASH)
   template <typename KM>
   using DistHash = ::fsc::hash::clhash<KM>;
@@ -285,10 +313,21 @@ using CountType = uint32_t;
   using StoreHash = ::fsc::hash::murmur3avx32<KM>;
 #elif (pStoreHash == MURMUR64avx)
   template <typename KM>
+#if defined(pHashCapacityBits)
+  using StoreHash = typename ::fsc::hash::hash_width_policy<::fsc::hash::murmur3avx64, pHashCapacityBits>::template hash<KM>;
+#else
   using StoreHash = ::fsc::hash::murmur3avx64<KM>;
+#endif
 #elif (pStoreHash == CRC32C)
   template <typename KM>
   using StoreHash = ::fsc::hash::crc32c<KM>;
+#elif (pStoreHash == CRC32C64)
+  template <typename KM>
+#if defined(pHashCapacityBits)
+  using StoreHash = typename ::fsc::hash::hash_width_policy<::fsc::hash::crc32c64, pHashCapacityBits>::template hash<KM>;
+#else
+  using StoreHash = ::fsc::hash::crc32c64<KM>;
+#endif
 #elif (pStoreHash == CLHASH)
   template <typename KM>
   using StoreHash = ::fsc::hash::clhash<KM>;
@@ -318,6 +357,9 @@ using CountType = uint32_t;
 #elif (pStoreHash == CRC32C)
   template <typename KM>
   using StoreHash = ::fsc::hash::crc32c<KM>;
+#elif (pStoreHash == CRC32C64)
+  template <typename KM>
+  using StoreHash = ::fsc::hash::crc32c64<KM>;
 #else
   static_assert(false, "DENSEHASH, unordered map, sorted, ordered, and ROBINHOOD do not support the specified store hash function");
 #endif
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2017 Georgia Institute of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file    benchmark_hll.cpp
+ * @ingroup
+ * @author  tpan
+ * @brief   hyperloglog64 update throughput:  per hash value update vs batch update, from precomputed hash values.
+ * @details the per element loop is the scalar baseline (compare and conditional store per hash value).
+ *          usage:  benchmark_hll [log2 count, default 20]
+ */
+
+#include "kmerhash/hyperloglog64.hpp"
+
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>  // atoi
+#include <algorithm>  // min
+
+struct identity_hash {
+  using result_type = uint64_t;
+  inline uint64_t operator()(uint64_t const & x) const { return x; }
+};
+
+template <uint8_t precision>
+void run(std::vector<uint64_t> const & hashes, uint8_t const & ignore) {
+  using hll_type = hyperloglog64<uint64_t, identity_hash, precision>;
+
+  size_t reps = std::max(static_cast<size_t>(5), (static_cast<size_t>(1) << 26) / hashes.size());
+  double single = 1e30, batch = 1e30, est_s = 0, est_b = 0;
+
+  for (size_t r = 0; r < reps; ++r) {
+    hll_type hll;
+    hll.set_ignored_msb(ignore);
+    hll.make_dense();
+    auto t1 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < hashes.size(); ++i) hll.update_via_hashval(hashes[i]);
+    auto t2 = std::chrono::steady_clock::now();
+    single = std::min(single, std::chrono::duration<double, std::nano>(t2 - t1).count());
+    est_s = hll.estimate();
+
+    hll_type hll2;
+    hll2.set_ignored_msb(ignore);
+    hll2.make_dense();
+    t1 = std::chrono::steady_clock::now();
+    hll2.update_via_hashval(hashes.data(), hashes.size());
+    t2 = std::chrono::steady_clock::now();
+    batch = std::min(batch, std::chrono::duration<double, std::nano>(t2 - t1).count());
+    est_b = hll2.estimate();
+  }
+
+  printf("precision %d ignored_msb %d count %lu:  single %.3f ns/hash, batch %.3f ns/hash, speedup %.2f.  estimates %.0f %.0f\n",
+         static_cast<int>(precision), static_cast<int>(ignore), hashes.size(),
+         single / hashes.size(), batch / hashes.size(), single / batch, est_s, est_b);
+}
+
+int main(int argc, char** argv) {
+  int lg = (argc > 1) ? atoi(argv[1]) : 20;
+
+  std::mt19937_64 generator(1);
+  for (int l = 12; l <= lg; l += 4) {
+    std::vector<uint64_t> hashes(static_cast<size_t>(1) << l);
+    for (size_t i = 0; i < hashes.size(); ++i) hashes[i] = generator();
+
+    run<12>(hashes, 0);
+    run<12>(hashes, 8);
+    run<16>(hashes, 0);
+  }
+
+  return 0;
+}
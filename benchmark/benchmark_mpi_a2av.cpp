@@ -85,6 +85,42 @@ struct sim_work2 {
     }
 };
 
+// one-to-many query:  x % 3 responses per query x, i.e. 0 to 2, as for a multimap find.
+struct sim_query_n {
+    size_t cycles;
+
+    sim_query_n(size_t const & c = 20) : cycles(c) {}
+
+    template <typename T>
+    void operator()(int rank, T const * start, T const * end, std::vector<T> & out) {
+      for (T const * it = start; it != end; ++it) {
+        T x = *it;
+        for (size_t i = 0; i < cycles; ++i) {
+          x += i;
+        }
+        for (size_t j = 0; j < (*it % 3); ++j) out.emplace_back(x);
+      }
+    }
+};
+
+// one-to-one query:  one response per query, same as sim_work applied to the query.
+struct sim_query {
+    size_t cycles;
+
+    sim_query(size_t const & c = 20) : cycles(c) {}
+
+    template <typename T>
+    void operator()(int rank, T const * start, T const * end, T * out) {
+      for (T const * it = start; it != end; ++it, ++out) {
+        T x = *it;
+        for (size_t i = 0; i < cycles; ++i) {
+          x += i;
+        }
+        *out = x;
+      }
+    }
+};
+
 
 //template <typename T, typename OP>
 //T * compute(T* buf, size_t const & cnt,
@@ -506,6 +542,156 @@ int main(int argc, char** argv) {
     BL_BENCH_END(bm, "khmxx::a2av1B_32", src_size);
 
 
+    ///////////////// ============  pipelined bucket, exchange, and compute, for unbucketed input.
+
+    BL_BENCH_COLLECTIVE_START(bm, "khmxx::batch_a2av", comm);
+    size_t batch_recv = 0;
+    bool batch_owned = true;
+    {
+      BL_BENCH_INIT(bm1);
+
+      // route by value, so the receiver can check ownership.  blocks of 1/4 of the input exercise the pipeline.
+      auto to_rank = [comm_size](size_t const & x) { return static_cast<int>(x % comm_size); };
+      auto batch_compute = [&sw2, &batch_recv, &batch_owned, comm_size, comm_rank](int rank, size_t* b, size_t* e) {
+        sw2(rank, b, e);
+        batch_recv += ::std::distance(b, e);
+        for (size_t* it = b; it != e; ++it) batch_owned &= (static_cast<int>(*it % comm_size) == comm_rank);
+      };
+
+      BL_BENCH_COLLECTIVE_START(bm1, "khmxx::batch_a2av_comp", comm);
+      khmxx::incremental::batched_ialltoallv_modify(src, src + src_size, to_rank, batch_compute, comm,
+                                                    ::std::max(src_size / 4, static_cast<size_t>(1)));
+      BL_BENCH_END(bm1, "khmxx::batch_a2av_comp", src_size);
+
+      BL_BENCH_REPORT_MPI_NAMED(bm1, "khmxx::batch_a2av", comm);
+    }
+    BL_BENCH_END(bm, "khmxx::batch_a2av", batch_recv);
+
+    BL_BENCH_START(bm);
+    // every element delivered once, to its owner.
+    eq = batch_owned &&
+        (::mxx::allreduce(batch_recv, ::std::plus<size_t>(), comm) == ::mxx::allreduce(src_size, ::std::plus<size_t>(), comm));
+    BL_BENCH_END(bm, "compare_batch", eq ? 1 : 0);
+
+    ///////////////// ============  one-to-one query, variable size blocks vs padded fixed size blocks when balanced.
+
+    sim_query sq(work_cpe);
+    size_t * qgold = ::utils::mem::aligned_alloc<size_t>(src_size);
+    std::copy(src, src + src_size, qgold);
+    ::std::for_each(qgold, qgold + src_size, sw);
+    size_t * qres = ::utils::mem::aligned_alloc<size_t>(src_size);
+
+    BL_BENCH_COLLECTIVE_START(bm, "khmxx::a2av_query", comm);
+    {
+      BL_BENCH_INIT(bm1);
+
+      BL_BENCH_COLLECTIVE_START(bm1, "khmxx::a2av_query", comm);
+      khmxx::incremental::ialltoallv_and_query_one_to_one(src, src + src_size, send_counts, sq, qres, comm);
+      BL_BENCH_END(bm1, "khmxx::a2av_query", src_size);
+
+      BL_BENCH_REPORT_MPI_NAMED(bm1, "khmxx::a2av_query", comm);
+    }
+    BL_BENCH_END(bm, "khmxx::a2av_query", src_size);
+
+    BL_BENCH_START(bm);
+    eq = std::equal(qres, qres + src_size, qgold);
+    BL_BENCH_END(bm, "compare_query", eq ? 1 : 0);
+
+    BL_BENCH_COLLECTIVE_START(bm, "khmxx::a2av_query_adapt", comm);
+    {
+      BL_BENCH_INIT(bm1);
+
+      BL_BENCH_COLLECTIVE_START(bm1, "khmxx::a2av_query_adapt", comm);
+      khmxx::incremental::ialltoallv_and_query_one_to_one_adaptive(src, src + src_size, send_counts, sq, qres, comm);
+      BL_BENCH_END(bm1, "khmxx::a2av_query_adapt", src_size);
+
+      BL_BENCH_REPORT_MPI_NAMED(bm1, "khmxx::a2av_query_adapt", comm);
+    }
+    BL_BENCH_END(bm, "khmxx::a2av_query_adapt", src_size);
+
+    BL_BENCH_START(bm);
+    eq = std::equal(qres, qres + src_size, qgold);
+    ::utils::mem::aligned_free(qres);
+    ::utils::mem::aligned_free(qgold);
+    BL_BENCH_END(bm, "compare_query_adapt", eq ? 1 : 0);
+
+    ///////////////// ============  repeated small one-to-one queries, per call setup vs. a query session.
+
+    {
+      // round r queries the r-th slice of every bucket, so each round is a small bucketed batch.
+      constexpr size_t qrounds = 16;
+      std::vector<std::vector<size_t> > round_src(qrounds);
+      std::vector<std::vector<size_t> > round_counts(qrounds, std::vector<size_t>(comm_size, 0));
+      std::vector<std::vector<size_t> > round_gold(qrounds);
+      for (size_t r = 0; r < qrounds; ++r) {
+        for (int i = 0; i < comm_size; ++i) {
+          size_t b = send_displs[i] + send_counts[i] * r / qrounds;
+          size_t e = send_displs[i] + send_counts[i] * (r + 1) / qrounds;
+          round_counts[r][i] = e - b;
+          round_src[r].insert(round_src[r].end(), src + b, src + e);
+        }
+        round_gold[r] = round_src[r];
+        ::std::for_each(round_gold[r].begin(), round_gold[r].end(), sw);
+      }
+      std::vector<size_t> rres;
+
+      BL_BENCH_COLLECTIVE_START(bm, "khmxx::a2av_query_rounds", comm);
+      bool rounds_eq = true;
+      for (size_t r = 0; r < qrounds; ++r) {
+        rres.resize(round_src[r].size());
+        khmxx::incremental::ialltoallv_and_query_one_to_one(round_src[r].data(), round_src[r].data() + round_src[r].size(),
+                                                            round_counts[r], sq, rres.data(), comm);
+        rounds_eq &= std::equal(rres.begin(), rres.end(), round_gold[r].begin());
+      }
+      BL_BENCH_END(bm, "khmxx::a2av_query_rounds", rounds_eq ? 1 : 0);
+
+      BL_BENCH_COLLECTIVE_START(bm, "khmxx::query_session_rounds", comm);
+      rounds_eq = true;
+      {
+        khmxx::incremental::query_session sess(comm);
+        for (size_t r = 0; r < qrounds; ++r) {
+          rres.resize(round_src[r].size());
+          sess.query_one_to_one(round_src[r].data(), round_src[r].data() + round_src[r].size(),
+                                round_counts[r], sq, rres.data());
+          rounds_eq &= std::equal(rres.begin(), rres.end(), round_gold[r].begin());
+        }
+      }
+      BL_BENCH_END(bm, "khmxx::query_session_rounds", rounds_eq ? 1 : 0);
+    }
+
+    ///////////////// ============  one-to-many query, variable response count per query.
+
+    {
+      sim_query_n sqn(work_cpe);
+      std::vector<size_t> ngold;
+      std::vector<size_t> ngold_counts(comm_size, 0);
+      for (int r = 0; r < comm_size; ++r) {
+        size_t before = ngold.size();
+        sqn(r, src + send_displs[r], src + send_displs[r] + send_counts[r], ngold);
+        ngold_counts[r] = ngold.size() - before;
+      }
+      std::vector<size_t> nres;
+      std::vector<size_t> nres_counts;
+
+      BL_BENCH_COLLECTIVE_START(bm, "khmxx::a2av_query_n", comm);
+      {
+        BL_BENCH_INIT(bm1);
+
+        BL_BENCH_COLLECTIVE_START(bm1, "khmxx::a2av_query_n", comm);
+        khmxx::incremental::ialltoallv_and_query(src, src + src_size, send_counts, sqn, nres, nres_counts, comm);
+        BL_BENCH_END(bm1, "khmxx::a2av_query_n", nres.size());
+
+        BL_BENCH_REPORT_MPI_NAMED(bm1, "khmxx::a2av_query_n", comm);
+      }
+      BL_BENCH_END(bm, "khmxx::a2av_query_n", nres.size());
+
+      // responses are grouped by responding rank in rank order, so they match the local expansion of the bucketed queries.
+      BL_BENCH_START(bm);
+      eq = (nres == ngold) && (nres_counts == ngold_counts);
+      BL_BENCH_END(bm, "compare_query_n", eq ? 1 : 0);
+    }
+
+
 
     ///////////////// -----------
 
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2017 Georgia Institute of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * bounded_combiner, fixed size local pre-aggregation before distribution, companion to count_min_sketch.
+ *
+ * a 2-way set associative table of 2^bits (key, value) slots, small enough to stay in cache.  an element whose set holds
+ * the same key is reduced into it.  otherwise it takes a free slot, or evicts ("spills") the least recently used resident
+ * aggregate of the set to a callback and takes its place.  at the end, flush spills all residents.
+ *
+ * repeats that are close together in the stream, or that are frequent (high coverage k-mers), are absorbed, so the
+ * spilled stream is shorter than the input.  memory is fixed, unlike reducing through a temporary table over the whole input.
+ * the slot is taken from the hash value already computed for distribution, so the element is not hashed again.
+ *
+ * the reduction operator must be associative and commutative for the result to be independent of the eviction order,
+ * e.g. plus for counting, or keep-first for insert.
+ *
+ * TODO:
+ * [X] spill callback, so that the caller can route singletons and aggregates differently
+ * [X] 2-way set associative slots.  direct mapped thrashes on colliding frequent keys.
+ *
+ */
+
+#ifndef KMERHASH_BOUNDED_COMBINER_HPP_
+#define KMERHASH_BOUNDED_COMBINER_HPP_
+
+#include <vector>
+#include <utility>     // pair, swap
+#include <cstddef>    // size_t
+#include <stdint.h>
+#include <functional>  // plus, equal_to
+
+
+template <typename Key, typename T, typename Reducer = ::std::plus<T>, typename Equal = ::std::equal_to<Key> >
+class bounded_combiner {
+
+public:
+		using value_type = ::std::pair<Key, T>;
+
+protected:
+		/// log2 of number of slots.  2 slots per set, most recently used first.
+		uint8_t bits;
+		::std::vector<value_type> slots;
+		::std::vector<uint8_t> occupied;
+
+		/// number of elements absorbed, i.e. not spilled as separate aggregates.
+		size_t absorbed;
+
+		Reducer reduc;
+		Equal eq;
+
+		/// first slot of the set.
+		template <typename HVT>
+		inline size_t set_of(HVT const & hval) const {
+			// scramble, then take the high bits.  hash values used for distribution may have structured low bits.
+			return static_cast<size_t>((static_cast<uint64_t>(hval) * 0x9E3779B97F4A7C15ULL) >> (65 - bits)) << 1;
+		}
+
+public:
+
+		/// 2^bits slots, at least 4.  default is 16K slots, a few hundred KB for k-mer counts.
+		bounded_combiner(uint8_t const & _bits = 14) :
+			bits(_bits < 2 ? 2 : (_bits > 30 ? 30 : _bits)),
+			slots(0x1UL << bits), occupied(0x1UL << bits, 0), absorbed(0) {}
+
+		bounded_combiner(bounded_combiner const & other) = default;
+		bounded_combiner(bounded_combiner && other) = default;
+		bounded_combiner& operator=(bounded_combiner const & other) = default;
+		bounded_combiner& operator=(bounded_combiner && other) = default;
+
+		inline size_t capacity() const {
+			return slots.size();
+		}
+
+		/// number of inserted elements that were reduced into an existing aggregate.
+		inline size_t absorbed_count() const {
+			return absorbed;
+		}
+
+		/// insert (key, val) with the precomputed hash value of key.  spill(value_type const &) is called for an evicted aggregate.
+		template <typename HVT, typename SPILL>
+		inline void insert(Key const & key, HVT const & hval, T const & val, SPILL & spill) {
+			size_t s = set_of(hval);
+			if (occupied[s]) {
+				if (eq(slots[s].first, key)) {
+					slots[s].second = reduc(slots[s].second, val);
+					++absorbed;
+					return;
+				}
+				if (occupied[s + 1]) {
+					if (eq(slots[s + 1].first, key)) {
+						// reduce, and make most recently used.
+						slots[s + 1].second = reduc(slots[s + 1].second, val);
+						::std::swap(slots[s], slots[s + 1]);
+						++absorbed;
+						return;
+					}
+					// evict least recently used.
+					spill(slots[s + 1]);
+				}
+				slots[s + 1] = slots[s];
+				occupied[s + 1] = 1;
+			}
+			slots[s].first = key;
+			slots[s].second = val;
+			occupied[s] = 1;
+		}
+
+		/// spill all residents, and empty the table.
+		template <typename SPILL>
+		void flush(SPILL & spill) {
+			size_t s = slots.size();
+			for (size_t i = 0; i < s; ++i) {
+				if (occupied[i]) {
+					spill(slots[i]);
+					occupied[i] = 0;
+				}
+			}
+		}
+
+		/// empty the table without spilling, and reset the absorbed count.
+		void clear() {
+			occupied.assign(slots.size(), 0);
+			absorbed = 0;
+		}
+
+};
+
+
+#endif // KMERHASH_BOUNDED_COMBINER_HPP_
@@ -0,0 +1,292 @@
+/*
+ * Copyright 2017 Georgia Institute of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * comm_trace, per-rank event timeline for the overlapped exchanges in incremental_mxx.hpp.
+ *
+ * BL_BENCH reports phase totals, which cannot tell whether a receive was hidden behind compute or waited on.
+ * with KHMXX_COMM_TRACE defined (cmake ENABLE_COMM_TRACE), every exchange in incremental_mxx.hpp records intervals per peer:
+ *   call      the whole exchange call.  a wrapper that calls another exchange records both;  the summary takes their union
+ *   post      time spent posting a send
+ *   post_recv time spent posting a receive
+ *   inflight  from posting a receive to observing its completion
+ *   wait      time blocked in MPI_Wait*, i.e. exposed communication
+ *   compute   the compute callback
+ * each with the peer rank and byte count.  bytes are summed separately for send and receive posts, so a message is
+ * not counted twice.  without KHMXX_COMM_TRACE the macros are empty.
+ *
+ * the trace dumps as Chrome trace event JSON (chrome://tracing, Perfetto), one process per rank and one thread per lane.
+ * per rank files can be concatenated by merging their traceEvents arrays.
+ *
+ * summary per rank:
+ *   overlap efficiency = 1 - exposed / inflight, with inflight the union of inflight intervals, and exposed the part
+ *     of it spent waiting:  the fraction of receive time that was hidden behind other work.  1 if nothing was received.
+ *   busy = call - wait, the time the rank was doing work.  stragglers are ranks whose busy time exceeds the median
+ *     by more than 10%;  the other ranks wait for them.
+ *
+ * recording is not thread safe.  record from the thread that drives MPI.
+ *
+ * TODO:
+ * [X] Chrome trace JSON dump
+ * [X] collective summary with stragglers
+ *
+ */
+
+#ifndef KMERHASH_COMM_TRACE_HPP_
+#define KMERHASH_COMM_TRACE_HPP_
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <fstream>
+#include <chrono>
+#include <algorithm>  // sort, max
+#include <stdint.h>
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+
+namespace khmxx {
+
+namespace trace {
+
+	/// timeline lanes.  become thread ids in the Chrome trace.
+	enum lane : uint8_t { call = 0, post = 1, inflight = 2, wait = 3, compute = 4, post_recv = 5, num_lanes = 6 };
+
+	inline char const * lane_name(uint8_t const & l) {
+		static char const * names[num_lanes] = { "call", "post", "inflight", "wait", "compute", "post_recv" };
+		return (l < num_lanes) ? names[l] : "unknown";
+	}
+
+	/// one interval, in microseconds since the trace origin.
+	struct event {
+		char const * name;   // static string, e.g. the exchange function name.
+		double start;
+		double end;
+		uint64_t bytes;
+		int32_t peer;
+		uint8_t lane;
+	};
+
+	/// per rank totals, in microseconds.
+	struct summary {
+		double call;       // union of call intervals
+		double wait;
+		double compute;
+		double post;       // send and receive posts
+		double inflight;   // union of inflight intervals
+		double exposed;    // wait within inflight
+		double sent;       // bytes, from send posts
+		double received;   // bytes, from receive posts
+		double overlap;    // 1 - exposed / inflight, in [0, 1]
+
+		inline double busy() const { return call - wait; }
+	};
+
+
+	class comm_trace {
+	protected:
+		::std::vector<event> events;
+		::std::chrono::steady_clock::time_point origin;
+
+	public:
+		comm_trace() : origin(::std::chrono::steady_clock::now()) {}
+
+		/// the process wide trace.
+		static comm_trace & get() {
+			static comm_trace instance;
+			return instance;
+		}
+
+		/// microseconds since the trace origin.
+		inline double now() const {
+			return ::std::chrono::duration<double, ::std::micro>(::std::chrono::steady_clock::now() - origin).count();
+		}
+
+		inline void record(char const * name, uint8_t const & l, int const & peer,
+				double const & start, double const & end, size_t const & bytes = 0) {
+			events.push_back(event{name, start, end, static_cast<uint64_t>(bytes), static_cast<int32_t>(peer), l});
+		}
+
+		inline ::std::vector<event> const & get_events() const { return events; }
+
+		inline void clear() {
+			events.clear();
+		}
+
+		/// union of intervals, as disjoint sorted intervals.
+		static ::std::vector<::std::pair<double, double> > merge(::std::vector<::std::pair<double, double> > intervals) {
+			::std::sort(intervals.begin(), intervals.end());
+			::std::vector<::std::pair<double, double> > merged;
+			for (auto const & f : intervals) {
+				if (merged.empty() || (f.first > merged.back().second)) merged.emplace_back(f);
+				else merged.back().second = ::std::max(merged.back().second, f.second);
+			}
+			return merged;
+		}
+
+		summary summarize() const {
+			summary s{0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 1.0};
+			::std::vector<::std::pair<double, double> > calls;
+			::std::vector<::std::pair<double, double> > flights;
+			::std::vector<::std::pair<double, double> > waits;
+			for (auto const & e : events) {
+				double d = e.end - e.start;
+				switch (e.lane) {
+				case call:     calls.emplace_back(e.start, e.end); break;
+				case post:     s.post += d; s.sent += static_cast<double>(e.bytes); break;
+				case post_recv: s.post += d; s.received += static_cast<double>(e.bytes); break;
+				case inflight: flights.emplace_back(e.start, e.end); break;
+				case wait:     s.wait += d; waits.emplace_back(e.start, e.end); break;
+				case compute:  s.compute += d; break;
+				default: break;
+				}
+			}
+
+			// nested calls, e.g. an adaptive exchange falling back to the pairwise one, count once.
+			for (auto const & m : merge(calls)) s.call += m.second - m.first;
+
+			// union of the inflight intervals, as disjoint sorted intervals.
+			::std::vector<::std::pair<double, double> > merged = merge(flights);
+			for (auto const & m : merged) s.inflight += m.second - m.first;
+
+			// waits do not overlap each other.  intersect with the union.
+			::std::sort(waits.begin(), waits.end());
+			size_t j = 0;
+			for (auto const & w : waits) {
+				while ((j < merged.size()) && (merged[j].second <= w.first)) ++j;
+				for (size_t k = j; (k < merged.size()) && (merged[k].first < w.second); ++k) {
+					s.exposed += ::std::min(w.second, merged[k].second) - ::std::max(w.first, merged[k].first);
+				}
+			}
+
+			if (s.inflight > 0.0) s.overlap = 1.0 - ::std::min(s.exposed, s.inflight) / s.inflight;
+			return s;
+		}
+
+		/// write the events as a Chrome trace event JSON object, with rank as the process id.
+		void dump(::std::ostream & os, int const & rank = 0) const {
+			os << "{\"traceEvents\":[";
+			bool first = true;
+			for (int l = 0; l < num_lanes; ++l) {
+				os << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << rank
+				   << ",\"tid\":" << l << ",\"args\":{\"name\":\"" << lane_name(l) << "\"}}";
+				first = false;
+			}
+			for (auto const & e : events) {
+				os << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"" << lane_name(e.lane) << "\",\"ph\":\"X\",\"pid\":" << rank
+				   << ",\"tid\":" << static_cast<int>(e.lane) << ",\"ts\":" << e.start << ",\"dur\":" << (e.end - e.start)
+				   << ",\"args\":{\"peer\":" << e.peer << ",\"bytes\":" << e.bytes << "}}";
+			}
+			os << "\n],\"displayTimeUnit\":\"ms\"}" << ::std::endl;
+		}
+
+		/// write to prefix.<rank>.json
+		void dump(::std::string const & prefix, int const & rank) const {
+			::std::ofstream ofs(prefix + "." + ::std::to_string(rank) + ".json");
+			dump(ofs, rank);
+		}
+
+	};
+
+
+	/// ranks whose busy time exceeds the median by more than tolerance, slowest first.
+	inline ::std::vector<int> find_stragglers(::std::vector<summary> const & all, double const & tolerance = 0.1) {
+		::std::vector<int> stragglers;
+		if (all.size() == 0) return stragglers;
+
+		::std::vector<double> busy;
+		for (auto const & s : all) busy.emplace_back(s.busy());
+		::std::vector<double> sorted(busy);
+		::std::sort(sorted.begin(), sorted.end());
+		double median = sorted[sorted.size() / 2];
+
+		for (size_t i = 0; i < busy.size(); ++i) {
+			if (busy[i] > median * (1.0 + tolerance)) stragglers.emplace_back(static_cast<int>(i));
+		}
+		::std::sort(stragglers.begin(), stragglers.end(), [&busy](int const & x, int const & y){
+			return busy[x] > busy[y];
+		});
+		return stragglers;
+	}
+
+	/// print per rank summaries, the mean overlap efficiency, and the stragglers.
+	inline void print_summary(::std::vector<summary> const & all, ::std::ostream & os) {
+		os << "comm_trace rank\tcall_us\twait_us\tcompute_us\tpost_us\tinflight_us\texposed_us\tsent\treceived\toverlap" << ::std::endl;
+		double overlap = 0.0;
+		for (size_t i = 0; i < all.size(); ++i) {
+			summary const & s = all[i];
+			os << "comm_trace " << i << "\t" << s.call << "\t" << s.wait << "\t" << s.compute << "\t" << s.post << "\t"
+			   << s.inflight << "\t" << s.exposed << "\t" << s.sent << "\t" << s.received << "\t" << s.overlap << ::std::endl;
+			overlap += s.overlap;
+		}
+		if (all.size() > 0) os << "comm_trace mean overlap efficiency " << (overlap / static_cast<double>(all.size())) << ::std::endl;
+
+		::std::vector<int> stragglers = find_stragglers(all);
+		os << "comm_trace stragglers:";
+		for (int r : stragglers) os << " " << r;
+		os << ::std::endl;
+	}
+
+#ifdef USE_MPI
+	/// collective.  gathers every rank's summary, and prints on root.
+	inline void report(MPI_Comm comm, ::std::ostream & os, int const & root = 0) {
+		int rank, size;
+		MPI_Comm_rank(comm, &rank);
+		MPI_Comm_size(comm, &size);
+
+		summary s = comm_trace::get().summarize();
+		::std::vector<summary> all(rank == root ? size : 0);
+		MPI_Gather(&s, sizeof(summary), MPI_BYTE, all.data(), sizeof(summary), MPI_BYTE, root, comm);
+
+		if (rank == root) print_summary(all, os);
+	}
+#endif
+
+	/// records [start, scope exit) on the call lane.
+	struct scoped_call {
+		char const * name;
+		double start;
+		scoped_call(char const * _name) : name(_name), start(comm_trace::get().now()) {}
+		~scoped_call() {
+			comm_trace & t = comm_trace::get();
+			t.record(name, call, -1, start, t.now());
+		}
+	};
+
+} // namespace trace
+
+} // namespace khmxx
+
+
+#if defined(KHMXX_COMM_TRACE)
+/// trace the rest of the enclosing scope as one call.
+#define KHMXX_TRACE_CALL(name) ::khmxx::trace::scoped_call khmxx_trace_call_scope(name)
+/// start time for a later KHMXX_TRACE_END.
+#define KHMXX_TRACE_START(var) double var = ::khmxx::trace::comm_trace::get().now()
+/// record [var, now) on lane ln (call, post, post_recv, inflight, wait, compute), for peer, with bytes.
+#define KHMXX_TRACE_END(var, name, ln, peer, bytes) \
+	::khmxx::trace::comm_trace::get().record(name, ::khmxx::trace::ln, peer, var, ::khmxx::trace::comm_trace::get().now(), bytes)
+#else
+#define KHMXX_TRACE_CALL(name)
+#define KHMXX_TRACE_START(var)
+#define KHMXX_TRACE_END(var, name, ln, peer, bytes)
+#endif
+
+
+#endif // KMERHASH_COMM_TRACE_HPP_
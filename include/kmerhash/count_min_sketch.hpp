@@ -0,0 +1,202 @@
+/*
+ * Copyright 2017 Georgia Institute of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * count_min_sketch, frequency estimation for heavy hitter detection, companion to hyperloglog64.
+ *  based on
+ *  	Cormode and Muthukrishnan, "An improved data stream summary: the count-min sketch and its applications", 2005.
+ *
+ * like hyperloglog64, this works from hash values that are already computed, e.g. for data distribution,
+ * so the element is not hashed again.  depth row indices are derived from one hash value by double hashing
+ * (Kirsch and Mitzenmacher):  the hash value is scrambled by a multiplicative hash, and the high and low
+ * 32 bits are combined as h1 + r * h2 for row r.
+ *
+ * estimates are never below the true count, and over by at most e * N / 2^width_bits with probability 1 - e^-depth,
+ * where N is the total count.  sketches with the same parameters can be merged by addition, locally or with MPI allreduce.
+ * counters are 64 bit by default.  a merged global sketch of k-mer counts routinely exceeds 2^32 in total.
+ *
+ * TODO:
+ * [X] batch update
+ * [X] distributed merge
+ * [ ] conservative update.
+ *
+ */
+
+#ifndef KMERHASH_COUNT_MIN_SKETCH_HPP_
+#define KMERHASH_COUNT_MIN_SKETCH_HPP_
+
+#include <vector>
+#include <stdint.h>
+#include <algorithm>  // min
+#include <limits>
+#include <functional>  // plus
+
+#ifdef USE_MPI
+#include <mxx/comm.hpp>
+#include <mxx/collective.hpp>
+#include <mxx/reduction.hpp>
+#endif
+
+
+template <typename T, typename Hash, uint8_t width_bits = 11U, uint8_t depth = 4U, typename COUNT_T = uint64_t>
+class count_min_sketch {
+	  static_assert((width_bits >= 4U) && (width_bits <= 24U),
+			  "ERROR: width_bits for count min sketch should be in [4, 24].");
+	  static_assert((depth >= 1U) && (depth <= 16U),
+			  "ERROR: depth for count min sketch should be in [1, 16].");
+
+public:
+		using HVT = decltype(::std::declval<Hash>().operator()(::std::declval<T>()));
+		using count_type = COUNT_T;
+
+protected:
+		static constexpr uint32_t width = 0x1U << width_bits;
+		static constexpr uint32_t width_mask = width - 1U;
+
+		/// depth x width counters, row major.
+		::std::vector<COUNT_T> counters;
+		/// total count inserted, i.e. the sum of any row.
+		COUNT_T total_count;
+
+		Hash h;
+
+		/// first row index, and the stride for the subsequent rows.
+		inline void row_hashes(HVT const & hval, uint32_t & h1, uint32_t & h2) const {
+			uint64_t g = static_cast<uint64_t>(hval) * 0x9E3779B97F4A7C15ULL;
+			h1 = static_cast<uint32_t>(g >> 32);
+			h2 = static_cast<uint32_t>(g) | 0x1U;   // odd, so rows do not repeat the same column.
+		}
+
+		inline void internal_update(HVT const & hval, COUNT_T const & count) {
+			uint32_t h1, h2;
+			row_hashes(hval, h1, h2);
+			COUNT_T* row = counters.data();
+			for (uint8_t r = 0; r < depth; ++r, row += width, h1 += h2) {
+				row[h1 & width_mask] += count;
+			}
+			total_count += count;
+		}
+
+public:
+
+		/// fraction of the total count by which an estimate may exceed the true count, with probability 1 - e^-depth.
+		static constexpr double est_error_rate = static_cast<double>(2.718281828459045) / static_cast<double>(0x1U << width_bits);
+
+		count_min_sketch() : counters(static_cast<size_t>(depth) * width, static_cast<COUNT_T>(0)), total_count(0) {}
+
+		count_min_sketch(count_min_sketch const & other) = default;
+		count_min_sketch(count_min_sketch && other) = default;
+		count_min_sketch& operator=(count_min_sketch const & other) = default;
+		count_min_sketch& operator=(count_min_sketch && other) = default;
+
+		void swap(count_min_sketch && other) {
+			std::swap(counters, other.counters);
+			std::swap(total_count, other.total_count);
+		}
+
+		inline HVT update(T const & val) {
+			HVT hval = h(val);
+			internal_update(hval, 1);
+			return hval;
+		}
+
+		inline void update_via_hashval(HVT const & hval, COUNT_T const & count = 1) {
+			internal_update(hval, count);
+		}
+
+		/// batch update.  columns for a block of hash values are computed first, then the counters are incremented row by row.
+		inline void update_via_hashval(HVT const * hashes, size_t const & count) {
+			constexpr size_t block = 64;
+			uint32_t h1[block], h2[block];
+			COUNT_T* row;
+
+			size_t n, j;
+			for (size_t i = 0; i < count; i += block) {
+				n = ::std::min(block, count - i);
+				for (j = 0; j < n; ++j) {
+					row_hashes(hashes[i + j], h1[j], h2[j]);
+				}
+				row = counters.data();
+				for (uint8_t r = 0; r < depth; ++r, row += width) {
+					for (j = 0; j < n; ++j) {
+						++row[h1[j] & width_mask];
+						h1[j] += h2[j];
+					}
+				}
+			}
+			total_count += static_cast<COUNT_T>(count);
+		}
+
+		/// estimated count of the element with the hash value.  never less than the true count.
+		inline COUNT_T estimate_via_hashval(HVT const & hval) const {
+			uint32_t h1, h2;
+			row_hashes(hval, h1, h2);
+			COUNT_T const * row = counters.data();
+			COUNT_T est = ::std::numeric_limits<COUNT_T>::max();
+			for (uint8_t r = 0; r < depth; ++r, row += width, h1 += h2) {
+				est = ::std::min(est, row[h1 & width_mask]);
+			}
+			return est;
+		}
+
+		inline COUNT_T estimate(T const & val) const {
+			return estimate_via_hashval(h(val));
+		}
+
+		/// total count inserted
+		inline COUNT_T total() const {
+			return total_count;
+		}
+
+		/// heavy hitter if estimated count is at least the threshold.
+		inline bool is_heavy_via_hashval(HVT const & hval, COUNT_T const & threshold) const {
+			return estimate_via_hashval(hval) >= threshold;
+		}
+
+		void merge(count_min_sketch const & other) {
+			COUNT_T* target = counters.data();
+			COUNT_T const * src = other.counters.data();
+			size_t s = counters.size();
+			for (size_t i = 0; i < s; ++i) {   // vectorized by compiler.
+				target[i] += src[i];
+			}
+			total_count += other.total_count;
+		}
+
+		void clear() {
+			counters.assign(static_cast<size_t>(depth) * width, static_cast<COUNT_T>(0));
+			total_count = 0;
+		}
+
+
+#ifdef USE_MPI
+		/// distributed merge.  afterwards all ranks hold the global sketch.   one allreduce of depth * 2^width_bits counters.
+		void merge_distributed(::mxx::comm const & comm) {
+			::mxx::allreduce(counters, ::std::plus<COUNT_T>(), comm).swap(counters);
+			total_count = ::mxx::allreduce(total_count, ::std::plus<COUNT_T>(), comm);
+		}
+#endif
+
+};
+template <typename T, typename Hash, uint8_t width_bits, uint8_t depth, typename COUNT_T>
+constexpr uint32_t count_min_sketch<T, Hash, width_bits, depth, COUNT_T>::width;
+template <typename T, typename Hash, uint8_t width_bits, uint8_t depth, typename COUNT_T>
+constexpr uint32_t count_min_sketch<T, Hash, width_bits, depth, COUNT_T>::width_mask;
+template <typename T, typename Hash, uint8_t width_bits, uint8_t depth, typename COUNT_T>
+constexpr double count_min_sketch<T, Hash, width_bits, depth, COUNT_T>::est_error_rate;
+
+
+#endif // KMERHASH_COUNT_MIN_SKETCH_HPP_
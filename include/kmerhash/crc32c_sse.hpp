@@ -329,6 +329,189 @@ public:
 template <typename T>
 constexpr size_t crc32c<T>::batch_size;
 
+
+/**
+ * @brief crc, 64 bit output.
+ * @details  crc32c produces only 32 bits, which is not enough for the 64 bit hyperloglog estimate
+ *           or for tables with more than 2^32 buckets.  here 2 crc lanes are computed per key and combined.
+ *
+ *           CRC is affine over GF(2):  crc(s1, d) ^ crc(s2, d) depends only on s1 ^ s2 and length of d,
+ *           so 2 lanes over the same data with different seeds would produce a high word that is the low word
+ *           xor a constant.  The high lane therefore consumes the byte-reversed words, which is a different
+ *           linear map of the key, and the lanes are combined with one multiply-xorshift to break linearity.
+ *
+ *           _mm_crc32_u64 has 3 cycle latency and 1 cycle throughput.  hash4 runs 4 keys x 2 lanes = 8
+ *           independent crc streams, which is enough to keep the crc unit busy.
+ *           require SSE4.2
+ */
+template <typename T>
+class crc32c64
+{
+
+protected:
+  uint32_t seed_lo;
+  uint32_t seed_hi;
+  static constexpr size_t blocks = sizeof(T) >> 3; // divide by 8
+  static constexpr size_t rem = sizeof(T) & 0x7;   // remainder.
+  static constexpr size_t offset = (sizeof(T) >> 3) << 3;
+  static constexpr uint64_t mult = 0x9E3779B97F4A7C15ULL;  // golden ratio, odd
+
+  FSC_FORCE_INLINE uint64_t combine(uint32_t const & lo, uint32_t const & hi) const
+  {
+    uint64_t h = (static_cast<uint64_t>(hi) << 32) | static_cast<uint64_t>(lo);
+    h *= mult;
+    return h ^ (h >> 32);
+  }
+
+  FSC_FORCE_INLINE uint64_t hash1(const T &key) const
+  {
+    uint64_t lo64 = seed_lo;
+    uint64_t hi64 = seed_hi;
+    if (sizeof(T) >= 8)
+    {
+      uint64_t const *data64 = reinterpret_cast<uint64_t const *>(&key);
+      for (size_t i = 0; i < blocks; ++i)
+      {
+        lo64 = _mm_crc32_u64(lo64, data64[i]);
+        hi64 = _mm_crc32_u64(hi64, __builtin_bswap64(data64[i]));
+      }
+    }
+
+    uint32_t lo = static_cast<uint32_t>(lo64);
+    uint32_t hi = static_cast<uint32_t>(hi64);
+
+    unsigned char const *data = reinterpret_cast<unsigned char const *>(&key);
+
+    // rest.  do it cleanly
+    size_t off = offset; // * 8
+    if (rem & 0x4)
+    { // has 4 bytes
+      uint32_t d = *(reinterpret_cast<uint32_t const *>(data + off));
+      lo = _mm_crc32_u32(lo, d);
+      hi = _mm_crc32_u32(hi, __builtin_bswap32(d));
+      off += 4;
+    }
+    if (rem & 0x2)
+    { // has 2 bytes extra
+      uint16_t d = *(reinterpret_cast<uint16_t const *>(data + off));
+      lo = _mm_crc32_u16(lo, d);
+      hi = _mm_crc32_u16(hi, __builtin_bswap16(d));
+      off += 2;
+    }
+    if (rem & 0x1)
+    { // has 1 byte extra
+      uint8_t d = *(reinterpret_cast<uint8_t const *>(data + off));
+      lo = _mm_crc32_u8(lo, d);
+      hi = _mm_crc32_u8(hi, d);
+    }
+
+    return combine(lo, hi);
+  }
+
+  FSC_FORCE_INLINE void hash4(T const *keys, uint64_t *results) const
+  {
+    // 8 independent streams:  4 keys, 2 lanes each.
+    uint64_t lo64[4] = {seed_lo, seed_lo, seed_lo, seed_lo};
+    uint64_t hi64[4] = {seed_hi, seed_hi, seed_hi, seed_hi};
+
+    if (sizeof(T) >= 8)
+    {
+      // block of 8 bytes
+      for (size_t i = 0; i < blocks; ++i)
+      {
+        for (size_t j = 0; j < 4; ++j)
+        {
+          uint64_t d = reinterpret_cast<uint64_t const *>(&(keys[j]))[i];
+          lo64[j] = _mm_crc32_u64(lo64[j], d);
+          hi64[j] = _mm_crc32_u64(hi64[j], __builtin_bswap64(d));
+        }
+      }
+    }
+    uint32_t lo[4], hi[4];
+    for (size_t j = 0; j < 4; ++j)
+    {
+      lo[j] = static_cast<uint32_t>(lo64[j]);
+      hi[j] = static_cast<uint32_t>(hi64[j]);
+    }
+
+    // rest.  do it cleanly
+    size_t off = offset; // * 8
+    if (rem & 0x4)
+    { // has 4 bytes
+      for (size_t j = 0; j < 4; ++j)
+      {
+        uint32_t d = *(reinterpret_cast<uint32_t const *>(reinterpret_cast<unsigned char const *>(&(keys[j])) + off));
+        lo[j] = _mm_crc32_u32(lo[j], d);
+        hi[j] = _mm_crc32_u32(hi[j], __builtin_bswap32(d));
+      }
+      off += 4;
+    }
+    if (rem & 0x2)
+    { // has 2 bytes extra
+      for (size_t j = 0; j < 4; ++j)
+      {
+        uint16_t d = *(reinterpret_cast<uint16_t const *>(reinterpret_cast<unsigned char const *>(&(keys[j])) + off));
+        lo[j] = _mm_crc32_u16(lo[j], d);
+        hi[j] = _mm_crc32_u16(hi[j], __builtin_bswap16(d));
+      }
+      off += 2;
+    }
+    if (rem & 0x1)
+    { // has 1 byte extra
+      for (size_t j = 0; j < 4; ++j)
+      {
+        uint8_t d = *(reinterpret_cast<uint8_t const *>(reinterpret_cast<unsigned char const *>(&(keys[j])) + off));
+        lo[j] = _mm_crc32_u8(lo[j], d);
+        hi[j] = _mm_crc32_u8(hi[j], d);
+      }
+    }
+
+    for (size_t j = 0; j < 4; ++j)
+    {
+      results[j] = combine(lo[j], hi[j]);
+    }
+  }
+
+public:
+  static constexpr size_t batch_size = 4;
+
+  using result_type = uint64_t;
+  using argument_type = T;
+
+  crc32c64(uint32_t const &_seed = 37) : seed_lo(_seed), seed_hi(_seed ^ 0x5bd1e995U){};
+
+  // do 1 element.
+  FSC_FORCE_INLINE uint64_t operator()(const T &key) const
+  {
+    return hash1(key);
+  }
+
+  FSC_FORCE_INLINE void operator()(T const *keys, size_t count, uint64_t *results) const
+  {
+    hash(keys, count, results);
+  }
+
+  // results always 64 bit.
+  FSC_FORCE_INLINE void hash(T const *keys, size_t count, uint64_t *results) const
+  {
+    // loop over 4 keys at a time
+    size_t max = count - (count & 3);
+    size_t i = 0;
+    for (; i < max; i += 4)
+    {
+      hash4(keys + i, results + i);
+    }
+
+    // handle the remainder
+    for (; i < count; ++i)
+    {
+      results[i] = hash1(keys[i]);
+    }
+  }
+};
+template <typename T>
+constexpr size_t crc32c64<T>::batch_size;
+
 #endif
 
 } // namespace hash
@@ -359,7 +359,7 @@ namespace dsc  // distributed std container
       // outputs: bucket sizes
       //		  permuted output
       // 		  hyperloglog
-      // TODO: [ ] hyperloglog64 with 32 bit hash values....
+      // TODO: [X] hyperloglog64 with 32 bit hash values....  use ::fsc::hash::hash_width_policy to narrow the hash.
       template <typename IT, typename ASSIGN_TYPE, typename OT, typename HLL >
       void
       assign_count_estimate_permute(IT _begin, IT _end,
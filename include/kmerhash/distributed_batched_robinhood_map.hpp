@@ -55,6 +55,9 @@
 #include <ostream>  // std::flush
 
 #include <type_traits>
+#include <memory>  // shared_ptr
+#include <queue>   // priority_queue
+#include <numeric>  // iota, accumulate
 
 #include <mxx/collective.hpp>
 #include <mxx/reduction.hpp>
@@ -78,6 +81,9 @@
 
 #include "mem_utils.hpp"
 
+#include "count_min_sketch.hpp"
+#include "bounded_combiner.hpp"
+
 namespace dsc  // distributed std container
 {
 
@@ -165,10 +171,17 @@ namespace dsc  // distributed std container
   		static constexpr size_t batch_size = 1; // (sizeof(S) == 4 ? 8 : 4);
   		mutable bool is_pow2;
   		mutable OUT count;
+  		/// balanced partition:  optional virtual bucket to rank table, indexed by the low hash bits.  size is a power of 2.
+  		uint32_t const * table;
+  		IN table_mask;
 
-  		modulus(OUT const & _count) : is_pow2((_count & (_count - 1)) == 0), count(_count - (is_pow2 ? 1 : 0)) {}
+  		modulus(OUT const & _count, uint32_t const * _table = nullptr, size_t const & _table_size = 0) :
+  			is_pow2((_count & (_count - 1)) == 0), count(_count - (is_pow2 ? 1 : 0)),
+  			table(_table_size == 0 ? nullptr : _table), table_mask(_table_size == 0 ? 0 : _table_size - 1) {}
 
-  		inline OUT operator()(IN const & x) const { return is_pow2 ? (x & count) : (x % count); }
+  		inline OUT operator()(IN const & x) const {
+  			return (table != nullptr) ? static_cast<OUT>(table[x & table_mask]) : (is_pow2 ? (x & count) : (x % count));
+  		}
 
   		// template <typename IN, typename OUT>
   		// inline void operator()(IN const * x, size_t const & _count, OUT * y) const {
@@ -194,8 +207,15 @@ namespace dsc  // distributed std container
 //      template <typename K>
 //      using TransHash = typename MapParams<K>::template StoreTransFuncTemplate<K>;
 
+    // hyperloglog precision, MapParams<K>::hll_precision, default 12.  also used by the local container's estimator.
+    // with MapParams<K>::hll_sparse, the estimators start sparse (hyperloglog++), for low cardinality inserts.
+    static constexpr uint8_t hll_precision = ::hll_precision_param<MapParams<Key> >::value;
+    using hll_type = hyperloglog64<Key, InternalHash, hll_precision>;
+
     // own hyperloglog definition.  separate from the local container's.  this estimates using the transformed distribute hash.
-    hyperloglog64<Key, InternalHash, 12> hll;
+    // it is the running sketch across insert batches, so each batch's global estimate includes all previous batches.
+    hll_type hll;
+    hll_growth_predictor hll_growth;
 
 
 	template <typename K>
@@ -209,12 +229,92 @@ namespace dsc  // distributed std container
     template <typename K>
     using StoreTransEqual = typename MapParams<K>::template StoreTransEqualTemplate<K>;
 
+    // single hash mode:  MapParams<K>::single_hash == true.
+    //   the local container uses the distribution hash function, byte swapped, so distribution uses the low bits and
+    //   local bucketing the high bits, and one hash function (and its seed) serves both.  only keys are exchanged, through
+    //   the usual (overlapped) exchange:  shipping the 8 byte hash with each key would double the payload for k-mers,
+    //   which costs more than the receiver recomputing it.
+    //   StorageFunction is not used, and StorageTransform has to match DistTransform for StoreTransEqual to be consistent.
+    template <typename MP, typename = void>
+    struct is_single_hash : public ::std::false_type {};
+    template <typename MP>
+    struct is_single_hash<MP, typename ::std::enable_if<MP::single_hash>::type> : public ::std::true_type {};
+
+    static constexpr bool single_hash = is_single_hash<MapParams<Key> >::value;
+
+    static_assert(!single_hash || ::std::is_same<DistTrans<Key>, StoreTrans<Key> >::value,
+    		"single hash mode requires the same distribution and storage transforms.");
+
+    /// distribution hash with the same seed as key_to_hash, default constructible for the local container.
+    template <typename K>
+    struct SeededDistHash : public DistHash<K> {
+    	SeededDistHash() : DistHash<K>(9876543) {}
+    };
+    template <typename K>
+    using SharedTransHash = ::fsc::hash::TransformedHash<K, SeededDistHash, DistTrans, ::fsc::hash::byte_swap>;
+
+    template <typename K>
+    using LocalTransHash = typename ::std::conditional<single_hash, SharedTransHash<K>, StoreTransHash<K> >::type;
+
+    // node-aware exchange:  MapParams<K>::hierarchical_comm == true.  the overlapped exchanges aggregate within the node
+    //   and send between nodes, instead of sending to every rank.  node_layout is built once, in the constructor.
+    static constexpr bool hierarchical_comm = ::khmxx::incremental::hierarchical_comm_param<MapParams<Key> >::value;
+    ::std::shared_ptr<::khmxx::incremental::node_layout> node_layout;
+
+    // with ENABLE_LZ4_COMM, the pairwise modify compresses blocks in flight when measured comm is slower than the codec.
+    mutable ::khmxx::incremental::compression_advisor comm_advisor;
+    // the compressed exchange may sort a block only if the order of equal keys does not matter:  key only blocks, or
+    // a sum reduction.  the discard reducer keeps the first value, so sorting the pairs would change the result.
+    static constexpr bool order_free_reducer = ::std::is_same<Reducer, ::std::plus<T> >::value;
+
+    // one-sided asynchronous insert.  exists between async_insert_begin and async_insert_end.
+    ::std::shared_ptr<::khmxx::incremental::rma_mailbox<::std::pair<Key, T> > > mailbox;
+
+    // persistent requests and buffers for repeated one-to-one queries.  exists between start_query_session and stop_query_session.
+    ::std::shared_ptr<::khmxx::incremental::query_session> query_sess;
+
+    /// incremental alltoallv and modify, pairwise or node-aware.
+    template <typename V, typename OP>
+    void exchange_and_modify(V* permuted, V* permuted_end, ::std::vector<size_t> const & send_counts, OP compute) const {
+    	if (hierarchical_comm)
+    		::khmxx::incremental::ialltoallv_and_modify_hierarchical(permuted, permuted_end, send_counts, compute,
+    				*node_layout, this->comm);
+    	else
+#if defined(ENABLE_LZ4_COMM)
+    		::khmxx::incremental::ialltoallv_and_modify_compressed(permuted, permuted_end, send_counts, compute,
+    				comm_advisor, !(::std::is_same<V, Key>::value || order_free_reducer), this->comm);
+#else
+    		::khmxx::incremental::ialltoallv_and_modify(permuted, permuted_end, send_counts, compute, this->comm);
+#endif
+    }
+
+    // padded fixed block one-to-one query when send counts are balanced:  MapParams<K>::adaptive_query == true.
+    static constexpr bool adaptive_query = ::khmxx::incremental::adaptive_query_param<MapParams<Key> >::value;
+
+    /// incremental alltoallv and one-to-one query, via the query session if one is open, else pairwise or node-aware.
+    /// with adaptive_query, pairwise uses fixed size blocks if send counts are balanced.
+    template <typename V, typename OP, typename U>
+    void exchange_and_query_one_to_one(V* permuted, V* permuted_end, ::std::vector<size_t> const & send_counts,
+    		OP compute, U* result) const {
+    	if (query_sess)
+    		query_sess->query_one_to_one(permuted, permuted_end, send_counts, compute, result);
+    	else if (hierarchical_comm)
+    		::khmxx::incremental::ialltoallv_and_query_one_to_one_hierarchical(permuted, permuted_end, send_counts, compute,
+    				result, *node_layout, this->comm);
+    	else if (adaptive_query)
+    		::khmxx::incremental::ialltoallv_and_query_one_to_one_adaptive(permuted, permuted_end, send_counts, compute,
+    				result, this->comm);
+    	else
+    		::khmxx::incremental::ialltoallv_and_query_one_to_one(permuted, permuted_end, send_counts, compute,
+    				result, this->comm);
+    }
+
     public:
     	// NOTE: if there is a hyperloglog estimator in local container, it is usign the transformed storage hash.
       using local_container_type = Container<Key, T,
-    		  StoreTransHash,
+    		  LocalTransHash,
     		  StoreTransEqual, Reducer,
-    		  Alloc>;
+    		  Alloc, ::std::integral_constant<uint8_t, hll_precision> >;
 
       // std::batched_robinhood_multimap public members.
       using key_type              = typename local_container_type::key_type;
@@ -237,8 +337,97 @@ namespace dsc  // distributed std container
 
       mutable bool local_changed;
 
+      /// log2 of the combiner slot count.  0 disables local pre-aggregation before distribution.
+      uint8_t combiner_bits;
+
+      /// balanced partition:  virtual bucket (low distribution hash bits) to rank.  empty means hash modulo comm size.
+      /// see the "balance step" note on ialltoallv_and_modify.
+      ::std::vector<uint32_t> rank_table;
+      /// build rank_table from the next insert batch.
+      bool balance_pending;
+
+      /// rank of a distribution hash value under the balanced partition.
+      inline uint32_t rank_of(transhash_val_type const & h) const {
+    	  return this->rank_table[h & (this->rank_table.size() - 1)];
+      }
+
+      /// build the balanced partition from a sample of this batch.  collective.
+      /// sampled elements are histogrammed into 64 virtual buckets per rank by the low bits of the distribution hash,
+      /// and the virtual buckets are assigned heaviest first to the least loaded rank (LPT).  duplicates count, so the
+      /// weight is the communication volume.  contiguous splitters on the prefix sum put adjacent hot buckets on one rank.
+      /// every rank computes the same table from the same global histogram.  a single hot virtual bucket cannot be split.
+      template <typename V>
+      void build_rank_table(::std::vector<V> const & input) {
+    	  constexpr size_t virtual_per_rank = 64;
+    	  constexpr size_t max_sample = 65536;
+
+    	  BL_BENCH_INIT(balance);
+
+    	  BL_BENCH_START(balance);
+    	  int comm_size = this->comm.size();
+    	  size_t vbuckets = 1;
+    	  while (vbuckets < virtual_per_rank * comm_size) vbuckets <<= 1;
+
+    	  size_t step = (input.size() > max_sample) ? (input.size() / max_sample) : 1;
+    	  ::std::vector<V> sample;
+    	  sample.reserve(input.size() / step + 1);
+    	  for (size_t i = 0; i < input.size(); i += step) sample.emplace_back(input[i]);
+    	  this->transform_input(sample);
+
+    	  transhash_val_type* hvals = ::utils::mem::aligned_alloc<transhash_val_type>(sample.size() + InternalHash::batch_size);
+    	  if (InternalHash::batch_size > 1) {
+    		  if (sample.size() > 0) this->key_to_hash(sample.data(), sample.size(), hvals);
+    	  } else {
+    		  for (size_t i = 0; i < sample.size(); ++i) hvals[i] = this->key_to_hash(sample[i]);
+    	  }
+    	  ::std::vector<size_t> hist(vbuckets, 0);
+    	  for (size_t i = 0; i < sample.size(); ++i) ++hist[hvals[i] & (vbuckets - 1)];
+    	  ::utils::mem::aligned_free(hvals);
+    	  BL_BENCH_END(balance, "sample", sample.size());
+
+    	  BL_BENCH_COLLECTIVE_START(balance, "reduce", this->comm);
+    	  ::mxx::allreduce(hist, ::std::plus<size_t>(), this->comm).swap(hist);
+    	  BL_BENCH_END(balance, "reduce", vbuckets);
+
+    	  BL_BENCH_START(balance);
+    	  ::std::vector<size_t> order(vbuckets);
+    	  ::std::iota(order.begin(), order.end(), 0);
+    	  ::std::stable_sort(order.begin(), order.end(), [&hist](size_t const & x, size_t const & y){
+    		  return hist[x] > hist[y];
+    	  });
+    	  // (load, rank), least loaded first.  ties go to the lower rank.
+    	  using load_type = ::std::pair<size_t, uint32_t>;
+    	  ::std::priority_queue<load_type, ::std::vector<load_type>, ::std::greater<load_type> > loads;
+    	  for (int r = 0; r < comm_size; ++r) loads.emplace(0, r);
+    	  this->rank_table.resize(vbuckets);
+    	  for (size_t i = 0; i < vbuckets; ++i) {
+    		  load_type l = loads.top();
+    		  loads.pop();
+    		  this->rank_table[order[i]] = l.second;
+    		  l.first += hist[order[i]];
+    		  loads.push(l);
+    	  }
+    	  BL_BENCH_END(balance, "assign", vbuckets);
+
+    	  this->ignore_routing_bits();
+
+    	  BL_BENCH_REPORT_MPI_NAMED(balance, "hashmap:balance_partition", this->comm);
+      }
+
+      /// single hash mode:  the local container's hll takes its registers from the top bits of the byte swapped
+      /// distribution hash, i.e. from the low bytes that select the rank (or virtual bucket).  on one rank those bits
+      /// are nearly constant, so ignore the whole bytes that hold them.
+      void ignore_routing_bits() {
+    	  if (!single_hash) return;
+    	  size_t routes = this->rank_table.empty() ? static_cast<size_t>(this->comm.size()) : this->rank_table.size();
+    	  uint8_t bits = 0;
+    	  while ((static_cast<size_t>(1) << bits) < routes) ++bits;
+    	  this->c.set_ignored_msb(static_cast<uint8_t>((bits + 7) & ~0x7));
+      }
+
       /// local reduction via a copy of local container type (i.e. batched_robinhood_map).
       /// this takes quite a bit of memory due to use of batched_robinhood_map, but is significantly faster than sorting.
+      /// see combine_pairs for a fixed memory alternative that removes most repeats.
       virtual void local_reduction(::std::vector<::std::pair<Key, T> >& input, bool & sorted_input) {
 
         if (input.size() == 0) return;
@@ -263,6 +452,47 @@ namespace dsc  // distributed std container
         BL_BENCH_REPORT_NAMED(reduce_tuple, "reduction_hashmap:local_reduce");
       }
 
+      /// local pre-aggregation with a cache sized combiner, in place.  input is replaced by the spilled aggregates.
+      /// repeats that the combiner absorbs are not distributed.  requires an associative and commutative Reducer.
+      /// keys are compared with the local container's key_equal, so keys that the table would merge (e.g. a k-mer and
+      /// its reverse complement, which also share the distribution hash and thus the combiner set) are combined.
+      void combine_pairs(::std::vector<::std::pair<Key, T> >& input) {
+        BL_BENCH_INIT(combine);
+
+        BL_BENCH_START(combine);
+        bounded_combiner<Key, T, Reducer, key_equal> combiner(this->combiner_bits);
+        size_t j = 0;
+        // spilled aggregates overwrite input already consumed:  at most one spill per element inserted before.
+        auto spill = [&input, &j](::std::pair<Key, T> const & x) {
+          input[j] = x;
+          ++j;
+        };
+
+        // hash in blocks, so the temporaries stay small.
+        constexpr size_t block = 4096;
+        Key* keys = ::utils::mem::aligned_alloc<Key>(block + InternalHash::batch_size);
+        transhash_val_type* hvals = ::utils::mem::aligned_alloc<transhash_val_type>(block + InternalHash::batch_size);
+        size_t input_size = input.size();
+        size_t n, k;
+        for (size_t i = 0; i < input_size; i += block) {
+          n = ::std::min(block, input_size - i);
+          for (k = 0; k < n; ++k) {
+            keys[k] = input[i + k].first;
+          }
+          this->key_to_hash(keys, n, hvals);
+          for (k = 0; k < n; ++k) {
+            combiner.insert(input[i + k].first, hvals[k], input[i + k].second, spill);
+          }
+        }
+        combiner.flush(spill);
+        input.resize(j);
+        ::utils::mem::aligned_free(keys);
+        ::utils::mem::aligned_free(hvals);
+        BL_BENCH_END(combine, "combine", input_size);
+
+        BL_BENCH_REPORT_NAMED(combine, "reduction_hashmap:combine");
+      }
+
       // CASES FOR PERMUTE:
       // appropriate when the input needs to be permuted (count, exists) to match results.
       // appropriate when the input does not need to be permuted (insert, find, erase, update), when no output to match up, or output embeds the keys.
@@ -392,7 +622,7 @@ namespace dsc  // distributed std container
       // outputs: bucket sizes
       //		  permuted output
       // 		  hyperloglog
-      // TODO: [ ] hyperloglog64 with 32 bit hash values....
+      // TODO: [X] hyperloglog64 with 32 bit hash values....  use ::fsc::hash::hash_width_policy to narrow the hash.
       template <typename IT, typename ASSIGN_TYPE, typename OT, typename HLL >
       void
       assign_count_estimate_permute(IT _begin, IT _end,
@@ -486,6 +716,7 @@ namespace dsc  // distributed std container
 
 
           bool is_pow2 = (num_buckets & (num_buckets - 1)) == 0;
+          bool use_table = !(this->rank_table.empty());
         
 //        BL_BENCH_START(permute_est);
 
@@ -510,7 +741,36 @@ namespace dsc  // distributed std container
 
         	  size_t max = (input_size / block_size) * block_size;
 
-        	  if (is_pow2) {
+        	  if (use_table) {
+				  for (; i < max; i += block_size, it += block_size) {
+					  this->key_to_hash(&(*it), block_size, hashvals);
+
+					  for (j = 0; j < block_size; ++j) {
+						  hll.update_via_hashval(hashvals[j]);
+
+						  rank = this->rank_of(hashvals[j]);
+						  *i2o_it = rank;
+						  ++i2o_it;
+
+						  ++bucket_sizes[rank];
+					  }
+				  }
+	        	  // finish remainder.
+				  rem = input_size - i;
+
+				  this->key_to_hash(&(*it), rem, hashvals);
+
+				  for (j = 0; j < rem; ++j) {
+					  hll.update_via_hashval(hashvals[j]);
+
+					  rank = this->rank_of(hashvals[j]);
+					  *i2o_it = rank;
+					  ++i2o_it;
+
+					  ++bucket_sizes[rank];
+				  }
+
+        	  } else if (is_pow2) {
                   ASSIGN_TYPE bucket_mask = num_buckets - 1;
 
 				  for (; i < max; i += block_size, it += block_size) {
@@ -581,7 +841,17 @@ namespace dsc  // distributed std container
           } else {  // batch size of 1.
         	  transhash_val_type h;
 
-        	  if (is_pow2) {
+        	  if (use_table) {
+				  for (; it != _end; ++it, ++i2o_it) {
+					  h = this->key_to_hash(*it);
+					  hll.update_via_hashval(h);
+
+					  rank = this->rank_of(h);
+					  *i2o_it = rank;
+
+					  ++bucket_sizes[rank];
+				  }
+        	  } else if (is_pow2) {
                   ASSIGN_TYPE bucket_mask = num_buckets - 1;
 				  for (; it != _end; ++it, ++i2o_it) {
 					  h = this->key_to_hash(*it);
@@ -649,7 +919,8 @@ namespace dsc  // distributed std container
                 typename ::std::conditional<::std::is_same<uint16_t, ASSIGN_TYPE>::value,
                 ::fsc::hash::TransformedHash<Key, DistHash, DistTrans, mod_short>,
                 ::fsc::hash::TransformedHash<Key, DistHash, DistTrans, mod_int> >::type>::type;
-        InternalHashMod key_to_rank2(DistHash<trans_val_type>(9876543), DistTrans<Key>(), modulus<transhash_val_type, ASSIGN_TYPE>(num_buckets));
+        InternalHashMod key_to_rank2(DistHash<trans_val_type>(9876543), DistTrans<Key>(),
+        		modulus<transhash_val_type, ASSIGN_TYPE>(num_buckets, this->rank_table.data(), this->rank_table.size()));
 
 
 //        		decltype(declval<decltype(declval<KeyToRank>().proc_trans_hash)>().h)::batch_size;
@@ -746,17 +1017,44 @@ namespace dsc  // distributed std container
     public:
 
       batched_robinhood_map_base(const mxx::comm& _comm) : Base(_comm),
-		  key_to_hash(DistHash<trans_val_type>(9876543), DistTrans<Key>(), ::bliss::transform::identity<hash_val_type>())
+		  key_to_hash(DistHash<trans_val_type>(9876543), DistTrans<Key>(), ::bliss::transform::identity<hash_val_type>()),
 		  //hll(ceilLog2(_comm.size()))  // top level hll. no need to ignore bits.
+		  hll(0, ::hll_sparse_param<MapParams<Key> >::value),
+		  combiner_bits(0), balance_pending(false)
     //	don't bother initializing c.
     {
- //   	  this->c.set_ignored_msb(ceilLog2(_comm.size()));   // NOTE THAT THIS SHOULD MATCH KEY_TO_RANK use of bits in hash table.
+    	if (hierarchical_comm) node_layout = ::std::make_shared<::khmxx::incremental::node_layout>(_comm);
+#if defined(ENABLE_LZ4_COMM)
+    	comm_advisor = ::khmxx::incremental::compression_advisor(true);
+#endif
+    	this->ignore_routing_bits();   // NOTE THAT THIS SHOULD MATCH KEY_TO_RANK use of bits in hash table.
       }
 
 
 
       virtual ~batched_robinhood_map_base() {};
 
+      /// pre-aggregate inserted (key, value) pairs locally with a combiner of 2^bits slots before distribution.
+      /// 0 (default) disables.  the Reducer must be associative and commutative.
+      void set_combiner_bits(uint8_t const & bits) {
+    	  this->combiner_bits = bits;
+      }
+
+      /// balanced partition mode.  collective.  the next insert samples its batch, and the resulting hash range to rank
+      /// mapping replaces hash modulo comm size for all later inserts and queries.  the map must be empty,
+      /// since existing entries would not be found under the new mapping.
+      void balance_partition() {
+    	  size_t global = ::mxx::allreduce(this->c.size(), ::std::plus<size_t>(), this->comm);
+    	  if (global > 0) throw std::logic_error("balance_partition requires an empty map.");
+    	  this->rank_table.clear();
+    	  this->balance_pending = (this->comm.size() > 1);
+      }
+
+      /// true if a balanced partition is in use.
+      bool is_balanced_partition() const {
+    	  return !(this->rank_table.empty());
+      }
+
 
 
       /// returns the local storage.  please use sparingly.
@@ -769,6 +1067,8 @@ namespace dsc  // distributed std container
       virtual void local_reset() noexcept {
     	  this->c.clear();
     	  this->c.rehash(128);
+    	  this->hll.clear();
+    	  this->hll_growth.reset();
       }
 
       virtual void local_clear() noexcept {
@@ -1033,7 +1333,7 @@ namespace dsc  // distributed std container
 #if defined(OVERLAPPED_COMM) || defined(OVERLAPPED_COMM_BATCH) || defined(OVERLAPPED_COMM_FULLBUFFER) || defined(OVERLAPPED_COMM_2P)
   	  	  	  if (estimate) {
   	        BL_BENCH_COLLECTIVE_START(insert, "alloc_hashtable", this->comm);
-  			size_t est = this->hll.estimate_average_per_rank(this->comm);
+  			size_t est = this->hll_growth.predict(this->hll.estimate_global(this->comm)) / static_cast<double>(this->comm.size());
   			if (est > (this->c.get_max_load_factor() * this->c.capacity()))
   				// add 10% just to be safe.
   	        this->c.reserve(static_cast<size_t>(static_cast<double>(est) * (1.0 + this->hll.est_error_rate + 0.1)));
@@ -1048,11 +1348,10 @@ namespace dsc  // distributed std container
 
   	      BL_BENCH_COLLECTIVE_START(insert, "a2av_insert", this->comm);
 
-  	      ::khmxx::incremental::ialltoallv_and_modify(input.data(), input.data() + input.size(), send_counts,
+  	      this->exchange_and_modify(input.data(), input.data() + input.size(), send_counts,
   	                                                  [this](int rank, ::std::pair<Key, T>* b, ::std::pair<Key, T>* e){
   	                                                     this->c.insert_no_estimate(b, e);
-  	                                                  },
-  	                                                  this->comm);
+  	                                                  });
 
   	      BL_BENCH_END(insert, "a2av_insert", this->c.size());
 
@@ -1188,9 +1487,119 @@ namespace dsc  // distributed std container
 
     	  if (this->comm.size() == 1) {
     		  return this->template insert_1<estimate>(input, sorted_input, pred);
-    	  } else {
-    		  return this->template insert_p<estimate>(input, sorted_input, pred);
     	  }
+
+    	  if (this->combiner_bits > 0) {
+    		  // combining reorders the input.
+    		  this->combine_pairs(input);
+    		  sorted_input = false;
+    	  }
+
+    	  return this->template insert_combined<estimate>(input, sorted_input, pred);
+      }
+
+    protected:
+      /// distributed insert of (key, value) pairs that are already combined, or are not to be combined.
+      template <bool estimate, typename Predicate = ::bliss::filter::TruePredicate>
+      size_t insert_combined(std::vector<::std::pair<Key, T> >& input, bool sorted_input = false, Predicate const & pred = Predicate()) {
+    	  if (this->balance_pending) {
+    		  this->build_rank_table(input);
+    		  this->balance_pending = false;
+    	  }
+
+    	  return this->template insert_p<estimate>(input, sorted_input, pred);
+      }
+
+    public:
+
+      /**
+       * @brief open a query session.  collective.
+       * @details subsequent overlapped count and find calls reuse persistent receives and preallocated per-peer buffers,
+       *          instead of setting them up per call.  for query loops with many small batches.
+       * @param block_bytes  maximum per-peer message payload.  only the used part is sent;  larger batches take multiple messages.
+       */
+      void start_query_session(size_t const & block_bytes = (0x1UL << 12)) {
+    	  this->query_sess = ::std::make_shared<::khmxx::incremental::query_session>(this->comm, block_bytes);
+      }
+
+      /// close the query session and release its requests and buffers.  collective.
+      void stop_query_session() {
+    	  this->query_sess.reset();
+      }
+
+      /**
+       * @brief start asynchronous insert.  collective.
+       * @details async_insert puts (key, value) pairs directly into per-source ring buffers on the owner ranks (MPI-3 RMA),
+       *          and the owners insert whatever has arrived whenever they call async_insert.  ranks can call async_insert
+       *          different numbers of times, with no synchronization per batch.  async_insert_end waits for everyone.
+       *          received pairs are inserted with the local table's hll estimate and reserve, as in the non-overlapped
+       *          insert.  a global estimate, as in the overlapped insert, would need a collective.
+       * @param capacity  number of pairs in each (source, target) ring buffer.  memory is comm size * capacity pairs per rank.
+       */
+      void async_insert_begin(size_t const & capacity = (0x1UL << 16)) {
+    	  this->mailbox = ::std::make_shared<::khmxx::incremental::rma_mailbox<::std::pair<Key, T> > >(this->comm, capacity);
+      }
+
+      /**
+       * @brief insert asynchronously.  not collective.  must be between async_insert_begin and async_insert_end.
+       * @param input  vector.  will be permuted.
+       * @return  number of new local entries, from own input and from pairs received so far.
+       */
+      size_t async_insert(std::vector<::std::pair<Key, T> >& input) {
+    	  if (!(this->mailbox)) throw std::logic_error("async_insert called before async_insert_begin");
+
+    	  size_t before = this->c.size();
+    	  auto insert_op = [this](int rank, ::std::pair<Key, T>* b, ::std::pair<Key, T>* e){
+    		  this->c.insert(b, e);
+    	  };
+
+    	  if (input.size() > 0) {
+    		  int comm_size = this->comm.size();
+    		  ::std::pair<Key, T>* buffer = ::utils::mem::aligned_alloc<::std::pair<Key, T> >(input.size() + InternalHash::batch_size);
+    		  this->transform_input(input.begin(), input.end(), buffer);
+
+    		  std::vector<size_t> send_counts(comm_size, 0);
+    		  if (comm_size <= std::numeric_limits<uint8_t>::max())
+    			  this->assign_count_permute(buffer, buffer + input.size(), static_cast<uint8_t>(comm_size), send_counts,
+    					  input.data());
+    		  else if (comm_size <= std::numeric_limits<uint16_t>::max())
+    			  this->assign_count_permute(buffer, buffer + input.size(), static_cast<uint16_t>(comm_size), send_counts,
+    					  input.data() );
+    		  else    // mpi supports only 31 bit worth of ranks.
+    			  this->assign_count_permute(buffer, buffer + input.size(), static_cast<uint32_t>(comm_size), send_counts,
+    					  input.data());
+    		  ::utils::mem::aligned_free(buffer);
+
+    		  // start with the next rank so that not everyone writes to rank 0 first.
+    		  std::vector<size_t> send_displs(comm_size, 0);
+    		  for (int i = 1; i < comm_size; ++i) send_displs[i] = send_displs[i - 1] + send_counts[i - 1];
+    		  int comm_rank = this->comm.rank();
+    		  for (int i = 1; i <= comm_size; ++i) {
+    			  int target = (comm_rank + i) % comm_size;
+    			  this->mailbox->put(target, input.data() + send_displs[target],
+    					  input.data() + send_displs[target] + send_counts[target], insert_op);
+    		  }
+    	  }
+
+    	  this->mailbox->drain(insert_op);
+
+    	  return this->c.size() - before;
+      }
+
+      /**
+       * @brief finish asynchronous insert.  collective.  inserts everything still in flight, then releases the ring buffers.
+       * @return  number of new local entries since the last async_insert call.
+       */
+      size_t async_insert_end() {
+    	  if (!(this->mailbox)) return 0;
+
+    	  size_t before = this->c.size();
+    	  this->mailbox->finish([this](int rank, ::std::pair<Key, T>* b, ::std::pair<Key, T>* e){
+    		  this->c.insert(b, e);
+    	  });
+    	  this->mailbox.reset();
+
+    	  return this->c.size() - before;
       }
 
     protected:
@@ -1371,13 +1780,12 @@ namespace dsc  // distributed std container
 
   	      BL_BENCH_COLLECTIVE_START(count, "a2av_count", this->comm);
 
-  	      ::khmxx::incremental::ialltoallv_and_query_one_to_one(
+  	      this->exchange_and_query_one_to_one(
   	    		  input.data(), input.data() + input.size(), send_counts,
   	                                                  [this, &pred](int rank, Key* b, Key* e, count_result_type * out){
   	                                                     this->c.count(out, b, e, pred, pred);
   	                                                  },
-													  results,
-  	                                                  this->comm);
+													  results);
 
   	      BL_BENCH_END(count, "a2av_count", this->c.size());
 
@@ -1732,13 +2140,12 @@ if (measure_mode == MEASURE_A2A)
 
   	      BL_BENCH_COLLECTIVE_START(find, "a2av_find", this->comm);
 
-  	      ::khmxx::incremental::ialltoallv_and_query_one_to_one(
+  	      this->exchange_and_query_one_to_one(
   	    		  input.data(), input.data() + input.size(), send_counts,
   	                                                  [this, &pred, &nonexistent](int rank, Key* b, Key* e, mapped_type * out){
   	                                                     this->c.find(out, b, e, nonexistent, pred, pred);
   	                                                  },
-													  results,
-  	                                                  this->comm);
+													  results);
 
   	      BL_BENCH_END(find, "a2av_find", this->c.size());
 
@@ -2284,12 +2691,11 @@ if (measure_mode == MEASURE_A2A)
 
   	      BL_BENCH_COLLECTIVE_START(erase, "a2av_erase", this->comm);
 
-  	      ::khmxx::incremental::ialltoallv_and_modify(
+  	      this->exchange_and_modify(
   	    		  input.data(), input.data() + input.size(), send_counts,
   	                                                  [this, &pred](int rank, Key* b, Key* e){
   	                                                     this->c.erase(b, e, pred, pred);
-  	                                                  },
-  	                                                  this->comm);
+  	                                                  });
 
   	      BL_BENCH_END(erase, "a2av_erase", this->c.size());
 
@@ -2567,7 +2973,7 @@ if (measure_mode == MEASURE_A2A)
 
 
 
-      counting_batched_robinhood_map(const mxx::comm& _comm) : Base(_comm) {}
+      counting_batched_robinhood_map(const mxx::comm& _comm) : Base(_comm), heavy_hitter_fraction(0.0) {}
 
       virtual ~counting_batched_robinhood_map() {};
 
@@ -2577,8 +2983,131 @@ if (measure_mode == MEASURE_A2A)
       using Base::erase;
       using Base::unique_size;
 
+      /// keys that made up at least this fraction of the previous insert call, globally, are counted locally before
+      /// distribution, so each rank sends each heavy key once.  0 (default) disables.  should be the same on all ranks.
+      void set_heavy_hitter_fraction(double const & fraction) {
+    	  this->heavy_hitter_fraction = fraction;
+      }
+
 protected:
 
+      // heavy hitter detection.  frequency sketch over the distribution hash values, global over the previous insert call.
+      using cms_type = count_min_sketch<Key, typename Base::InternalHash>;
+      double heavy_hitter_fraction;
+      cms_type cms;
+
+      /// this call's sketch, reduced into cms once at the end of the insert call.
+      cms_type cms_local;
+      /// heavy keys of the current insert_p call, counted locally.
+      std::vector<::std::pair<Key, T> > heavy_counts;
+
+      /// bucketing pass of insert_p with heavy hitter detection fused in.  one distribution hash per key:  it updates
+      /// this call's sketch (and the hll when estimating), tests the key against the previous call's global sketch, and
+      /// assigns the rank, with the same rank mapping as assign_count_permute.  nothing is heavy on the first call.
+      /// heavy keys are taken from input untransformed, since insert_combined transforms again, and counted into
+      /// heavy_counts.  the rest are permuted from buffer into input, which is resized to match.
+      template <bool estimate>
+      void assign_count_permute_heavy(std::vector<Key>& input, Key* buffer, std::vector<size_t> & send_counts) {
+    	  using count_type = typename cms_type::count_type;
+    	  constexpr size_t block_size = 16 * Base::InternalHash::batch_size;
+
+    	  size_t input_size = input.size();
+    	  int comm_size = this->comm.size();
+
+    	  this->heavy_counts.clear();
+    	  send_counts.assign(comm_size, 0);
+    	  if (input_size == 0) return;
+
+    	  bool detect = (this->cms.total() > 0);
+    	  count_type threshold = ::std::max(static_cast<count_type>(2),
+    			  static_cast<count_type>(this->heavy_hitter_fraction * static_cast<double>(this->cms.total())));
+    	  bool use_table = !(this->rank_table.empty());
+    	  bool is_pow2 = (comm_size & (comm_size - 1)) == 0;
+    	  uint32_t bucket_mask = comm_size - 1;
+
+    	  uint32_t* bucketIds = ::utils::mem::aligned_alloc<uint32_t>(input_size + Base::InternalHash::batch_size);
+    	  typename Base::transhash_val_type hashvals[block_size];
+    	  std::vector<Key> heavy_keys;
+
+    	  // light keys are compacted to the front of buffer.  j never passes the block being read.
+    	  size_t j = 0, n, k;
+    	  uint32_t rank;
+    	  for (size_t i = 0; i < input_size; i += n) {
+    		  n = ::std::min(block_size, input_size - i);
+    		  this->key_to_hash(buffer + i, n, hashvals);
+
+    		  this->cms_local.update_via_hashval(hashvals, n);
+#if defined(OVERLAPPED_COMM) || defined(OVERLAPPED_COMM_BATCH) || defined(OVERLAPPED_COMM_FULLBUFFER) || defined(OVERLAPPED_COMM_2P)
+    		  if (estimate) this->hll.update_via_hashval(hashvals, n);
+#endif
+
+    		  for (k = 0; k < n; ++k) {
+    			  if (detect && this->cms.is_heavy_via_hashval(hashvals[k], threshold)) {
+    				  heavy_keys.emplace_back(input[i + k]);
+    				  continue;
+    			  }
+    			  rank = use_table ? this->rank_of(hashvals[k]) :
+    					  (is_pow2 ? (hashvals[k] & bucket_mask) : (hashvals[k] % comm_size));
+    			  buffer[j] = buffer[i + k];
+    			  bucketIds[j] = rank;
+    			  ++send_counts[rank];
+    			  ++j;
+    		  }
+    	  }
+
+    	  this->permute_by_bucketid(buffer, buffer + j, bucketIds, send_counts, input.data());
+    	  input.resize(j);
+    	  ::utils::mem::aligned_free(bucketIds);
+
+    	  if (heavy_keys.size() > 0) {
+    		  local_container_type counts;
+    		  counts.insert_no_estimate(heavy_keys.data(), heavy_keys.data() + heavy_keys.size(), T(1));
+    		  counts.to_vector().swap(this->heavy_counts);
+    	  }
+      }
+
+      /// count repeats locally with a cache sized combiner.  aggregates with count > 1 are returned as (key, count) pairs,
+      /// and spilled singletons are compacted back into input, so they still travel as keys only.
+      /// keys are compared with the local container's key_equal, as in combine_pairs.
+      void combine_keys(std::vector<Key>& input, std::vector<::std::pair<Key, T> > & combined) {
+    	  BL_BENCH_INIT(combine);
+
+    	  combined.clear();
+    	  size_t input_size = input.size();
+
+    	  BL_BENCH_START(combine);
+    	  bounded_combiner<Key, T, ::std::plus<T>, typename Base::key_equal> combiner(this->combiner_bits);
+    	  size_t j = 0;
+    	  // singletons overwrite input already consumed:  at most one spill per key inserted before.
+    	  auto spill = [&input, &combined, &j](::std::pair<Key, T> const & x) {
+    		  if (x.second == T(1)) {
+    			  input[j] = x.first;
+    			  ++j;
+    		  } else {
+    			  combined.emplace_back(x);
+    		  }
+    	  };
+
+    	  // hash in blocks, so the temporary stays small.
+    	  constexpr size_t block = 4096;
+    	  typename Base::transhash_val_type* hvals =
+    			  ::utils::mem::aligned_alloc<typename Base::transhash_val_type>(block + Base::InternalHash::batch_size);
+    	  size_t n, k;
+    	  for (size_t i = 0; i < input_size; i += block) {
+    		  n = ::std::min(block, input_size - i);
+    		  this->key_to_hash(input.data() + i, n, hvals);
+    		  for (k = 0; k < n; ++k) {
+    			  combiner.insert(input[i + k], hvals[k], T(1), spill);
+    		  }
+    	  }
+    	  combiner.flush(spill);
+    	  input.resize(j);
+    	  ::utils::mem::aligned_free(hvals);
+    	  BL_BENCH_END(combine, "combine", combiner.absorbed_count());
+
+    	  BL_BENCH_REPORT_MPI_NAMED(combine, "hashmap:combine", this->comm);
+      }
+
   /**
    * @brief insert new elements in the distributed batched_robinhood_multimap.
    * @param input  vector.  will be permuted.
@@ -2720,6 +3249,9 @@ if (measure_mode == MEASURE_TRANSFORM)
         // allocate the bucket sizes array
     std::vector<size_t> send_counts(comm_size, 0);
     
+    if (this->heavy_hitter_fraction > 0.0) {
+      this->template assign_count_permute_heavy<estimate>(input, buffer, send_counts);
+    } else {
 #if defined(OVERLAPPED_COMM) || defined(OVERLAPPED_COMM_BATCH) || defined(OVERLAPPED_COMM_FULLBUFFER) || defined(OVERLAPPED_COMM_2P)
     if (estimate) {
 	  if (comm_size <= std::numeric_limits<uint8_t>::max())
@@ -2745,6 +3277,7 @@ if (measure_mode == MEASURE_TRANSFORM)
 #if defined(OVERLAPPED_COMM) || defined(OVERLAPPED_COMM_BATCH) || defined(OVERLAPPED_COMM_FULLBUFFER) || defined(OVERLAPPED_COMM_2P)
     }
 #endif
+    }
     #ifdef VTUNE_ANALYSIS
     if (measure_mode == MEASURE_TRANSFORM)
         __itt_pause();
@@ -2775,7 +3308,7 @@ if (measure_mode == MEASURE_A2A)
 
 	  	  	  if (estimate) {
 	  	        BL_BENCH_COLLECTIVE_START(insert, "alloc_hashtable", this->comm);
-	  	        size_t est = this->hll.estimate_average_per_rank(this->comm);
+	  	        size_t est = this->hll_growth.predict(this->hll.estimate_global(this->comm)) / static_cast<double>(this->comm.size());
 	  			if (est > (this->c.get_max_load_factor() * this->c.capacity()))
 	  				// add 10% just to be safe.
 	  	        	this->c.reserve(static_cast<size_t>(static_cast<double>(est) * (1.0 + this->hll.est_error_rate + 0.1)));
@@ -2789,11 +3322,10 @@ if (measure_mode == MEASURE_A2A)
 
 	      BL_BENCH_COLLECTIVE_START(insert, "a2av_insert", this->comm);
 
-	      ::khmxx::incremental::ialltoallv_and_modify(input.data(), input.data() + input.size(), send_counts,
+	      this->exchange_and_modify(input.data(), input.data() + input.size(), send_counts,
 	                                                  [this](int rank, Key* b, Key* e){
 	                                                     this->c.insert_no_estimate(b, e, T(1));
-	                                                  },
-	                                                  this->comm);
+	                                                  });
 
 	      BL_BENCH_END(insert, "a2av_insert", this->c.size());
 
@@ -2936,9 +3468,36 @@ public:
         // even if count is 0, still need to participate in mpi calls.  if (input.size() == 0) return;
     	  if (this->comm.size() == 1) {
     		  return this->template insert_1<estimate>(input, sorted_input, pred);
-    	  } else {
-    		  return this->template insert_p<estimate>(input, sorted_input, pred);
     	  }
+
+    	  if (this->balance_pending) {
+    		  this->build_rank_table(input);
+    		  this->balance_pending = false;
+    	  }
+
+    	  size_t count = 0;
+    	  if (this->combiner_bits > 0) {
+    		  // repeated keys go as (key, count) pairs.  singletons stay as keys.
+    		  std::vector<::std::pair<Key, T> > combined;
+    		  this->combine_keys(input, combined);
+    		  count += Base::template insert_combined<estimate>(combined);
+    		  // the compacted singletons are in spill order.
+    		  sorted_input = false;
+    	  }
+
+    	  count += this->template insert_p<estimate>(input, sorted_input, pred);
+
+    	  if (this->heavy_hitter_fraction > 0.0) {
+    		  // heavy hitters split off during bucketing go as (key, count) pairs.  then one sketch allreduce per call,
+    		  // for detection in the next call.
+    		  count += Base::template insert_combined<estimate>(this->heavy_counts);
+    		  this->heavy_counts.clear();
+
+    		  this->cms_local.merge_distributed(this->comm);
+    		  this->cms.swap(::std::move(this->cms_local));
+    		  this->cms_local.clear();
+    	  }
+    	  return count;
       }
 
   };
@@ -71,6 +71,7 @@
 #include <type_traits> // enable_if
 #include <cstring>     // memcpy
 #include <stdexcept>   // logic error
+#include <algorithm>   // min
 // std int strings
 #include <iostream>    // cout
 
@@ -374,6 +375,121 @@ public:
 };
 
 
+/// hash value narrowed to 32 bit by folding the high half into the low half.
+/// result_type is uint32_t, so TransformedHash, hyperloglog64, the permute scratch arrays,
+/// and the local tables all use 32 bit hash values.  batch mode is provided if Hash has one.
+template <typename T, template <typename> class Hash>
+class narrowed_hash
+{
+protected:
+  using HASH_T = Hash<T>;
+  using HASH_VAL_TYPE = decltype(::std::declval<HASH_T>().operator()(::std::declval<T>()));
+
+  static_assert(sizeof(HASH_VAL_TYPE) == 8, "narrowed_hash is for 64 bit hash values.");
+
+  HASH_T h;
+
+  FSC_FORCE_INLINE static uint32_t fold(HASH_VAL_TYPE const & x)
+  {
+    return static_cast<uint32_t>(x ^ (x >> 32));
+  }
+
+  // batch mode available
+  template <typename HT = HASH_T>
+  FSC_FORCE_INLINE auto hash_block(T const *keys, size_t const &count, HASH_VAL_TYPE *hvals, int) const
+      -> decltype(::std::declval<HT>()(keys, count, hvals), void())
+  {
+    h(keys, count, hvals);
+  }
+  template <typename HT = HASH_T>
+  FSC_FORCE_INLINE void hash_block(T const *keys, size_t const &count, HASH_VAL_TYPE *hvals, long) const
+  {
+    for (size_t i = 0; i < count; ++i)
+      hvals[i] = h(keys[i]);
+  }
+
+public:
+  static constexpr size_t batch_size = batch_traits<HASH_T>::get_batch_size(0);
+
+  using result_type = uint32_t;
+  using argument_type = T;
+
+  narrowed_hash() : h(){};
+
+  // forward the seed to the wrapped hash.
+  template <typename S, typename ::std::enable_if<!::std::is_same<typename ::std::decay<S>::type, narrowed_hash>::value, int>::type = 1>
+  narrowed_hash(S const &_seed) : h(_seed){};
+
+  inline uint32_t operator()(const T &key) const
+  {
+    return fold(h(key));
+  }
+
+  // 64 bit hash values go through a small stack buffer, so the caller's buffers are all 32 bit.
+  FSC_FORCE_INLINE void operator()(T const *keys, size_t count, uint32_t *results) const
+  {
+    constexpr size_t block = (batch_size > 64) ? batch_size : 64;
+    HASH_VAL_TYPE hvals[block] __attribute__((aligned(64)));
+
+    size_t i = 0, j, n;
+    for (; i < count; i += block)
+    {
+      n = ::std::min(block, count - i);
+      hash_block(keys + i, n, hvals, 0);
+      for (j = 0; j < n; ++j)
+        results[i + j] = fold(hvals[j]);
+    }
+  }
+};
+template <typename T, template <typename> class Hash>
+constexpr size_t narrowed_hash<T, Hash>::batch_size;
+
+
+/// compile time hash value width policy.
+/// CAPACITY_BITS is log2 of the expected number of distinct keys (global, for the distribution hash).
+/// a 32 bit hash is sufficient when
+///   1. hyperloglog64 stays below the 32 bit large range correction threshold, 2^32/30 (about 2^27), and
+///   2. the local table bucket count (capacity / load factor) fits in 32 bits.
+/// in that case a 64 bit Hash is narrowed to 32 bits, halving hash scratch memory and bandwidth.
+/// Hash that already produces 32 bit values is passed through.
+/// usage, as DistFunction or StorageFunction in map parameters:
+///     ::fsc::hash::hash_width_policy<::fsc::hash::murmur3avx64, 25>::template hash
+template <template <typename> class Hash, unsigned int CAPACITY_BITS>
+struct hash_width_policy
+{
+  static constexpr bool narrow = (CAPACITY_BITS <= 27);
+
+  template <typename T>
+  using hash = typename ::std::conditional<
+      narrow && (sizeof(decltype(::std::declval<Hash<T>>().operator()(::std::declval<T>()))) == 8),
+      narrowed_hash<T, Hash>,
+      Hash<T> >::type;
+};
+template <template <typename> class Hash, unsigned int CAPACITY_BITS>
+constexpr bool hash_width_policy<Hash, CAPACITY_BITS>::narrow;
+
+
+/// post transform that reverses the bytes of a 32 or 64 bit hash value.
+/// used when one hash value serves both data distribution and local bucketing:
+/// distribution takes the low bits (hash % p) and the local table masks the low bits of the byte swapped hash,
+/// i.e. the high bits of the original.  the two do not overlap while log2(buckets) + 8 * ceil(log2(p) / 8) <= hash bits.
+template <typename T>
+struct byte_swap
+{
+  static_assert((sizeof(T) == 4) || (sizeof(T) == 8), "byte_swap supports 32 and 64 bit hash values.");
+
+  static constexpr size_t batch_size = 1;
+
+  template <typename S = T, typename ::std::enable_if<(sizeof(S) == 4), int>::type = 1>
+  inline T operator()(T const & x) const { return __builtin_bswap32(x); }
+
+  template <typename S = T, typename ::std::enable_if<(sizeof(S) == 8), int>::type = 1>
+  inline T operator()(T const & x) const { return __builtin_bswap64(x); }
+};
+template <typename T>
+constexpr size_t byte_swap<T>::batch_size;
+
+
 
 
 /// custom version of transformed hash that does a few things:
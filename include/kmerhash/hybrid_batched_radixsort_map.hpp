@@ -203,6 +203,11 @@ namespace hsc  // hybrid std container
     //hyperloglog64<Key, InternalHash, 12> *hlls;
     std::vector<hyperloglog64<Key, InternalHash, 12> > hlls;
 
+    // receive side of the non-overlapped modify_p:  a thread's pieces, one per source rank, are inserted in place when
+    //   they average at least min_inplace_piece elements, else gathered into one buffer and inserted once.  every insert
+    //   call has a fixed setup cost, so at high rank counts the pieces are too small to insert one by one.
+    static constexpr size_t min_inplace_piece = 256;
+
 	template <typename K>
 	using StoreHash = typename MapParams<K>::template StorageFunction<K>;
 	template <typename K>
@@ -484,7 +489,7 @@ namespace hsc  // hybrid std container
       // outputs: bucket sizes
       //		  permuted output
       // 		  hyperloglog
-      // TODO: [ ] hyperloglog64 with 32 bit hash values....
+      // TODO: [X] hyperloglog64 with 32 bit hash values....  use ::fsc::hash::hash_width_policy to narrow the hash.
       template <typename IT, typename ASSIGN_TYPE, typename HLL >
       void
       assign_count_estimate(IT _begin, IT _end,
@@ -1207,10 +1212,8 @@ namespace hsc  // hybrid std container
 //	        BL_BENCH_END(modify, "transform", input.size());
 
 
-// NOTE: overlap comm is incrementally inserting so we estimate before transmission, thus global estimate, and 64 bit
-//            hash is needed.
-//       non-overlap comm can estimate just before insertion for more accurate estimate based on actual input received.
-//          so 32 bit hashes are sufficient.
+// NOTE: estimate before transmission, thus global estimate, and 64 bit hash is needed.  overlap comm inserts incrementally,
+//       and non-overlap comm inserts each received piece in place, so the tables are sized before the a2a in both cases.
             // count and estimate and save the bucket ids.
 //    BL_BENCH_COLLECTIVE_START(modify, "permute_estimate", this->comm);
         // allocate an HLL
@@ -1220,7 +1223,6 @@ namespace hsc  // hybrid std container
     
         uint32_t* bid_buf = ::utils::mem::aligned_alloc<uint32_t>(r_end - r_start + batch_size);
 
-    #if defined(OVERLAPPED_COMM) //|| defined(OVERLAPPED_COMM_BATCH) || defined(OVERLAPPED_COMM_FULLBUFFER) || defined(OVERLAPPED_COMM_2P)
         if (estimate) {
             if ( nthreads_global <= std::numeric_limits<uint8_t>::max()) {
             
@@ -1249,7 +1251,6 @@ namespace hsc  // hybrid std container
             }
 
         } else {
-    #endif
             if (nthreads_global <= std::numeric_limits<uint8_t>::max()) {
                 this->assign_count(buffer, buffer + block, static_cast<uint8_t>(nthreads_global), thread_bucket_sizes[tid],
                             reinterpret_cast<uint8_t*>(bid_buf) );
@@ -1260,9 +1261,7 @@ namespace hsc  // hybrid std container
                     this->assign_count(buffer, buffer + block, static_cast<uint32_t>(nthreads_global), thread_bucket_sizes[tid],
                             reinterpret_cast<uint32_t*>(bid_buf) );
             }
-    #if defined(OVERLAPPED_COMM) //|| defined(OVERLAPPED_COMM_BATCH) || defined(OVERLAPPED_COMM_FULLBUFFER) || defined(OVERLAPPED_COMM_2P)
         }
-    #endif
         // do some calc with thread_bucket_sizes to get offsets for each bucket for each thread in node-wide permuted input array.
         thread_bucket_offsets[tid].resize(nthreads_global, 0);
         
@@ -1444,13 +1443,10 @@ namespace hsc  // hybrid std container
 
     size_t after = 0;
 
-#if defined(OVERLAPPED_COMM) //|| defined(OVERLAPPED_COMM_BATCH) || defined(OVERLAPPED_COMM_FULLBUFFER) || defined(OVERLAPPED_COMM_2P)
-
     if (estimate) {
         BL_BENCH_COLLECTIVE_START(modify, "alloc_hashtable", this->comm);
         size_t est = this->hlls[0].estimate_average_per_rank(this->comm);
-        if (this->comm.rank() == 0)
-        	printf("rank %d estimated size %ld\n", this->comm.rank(), est);
+        BL_DEBUGF("rank %d estimated size %ld\n", this->comm.rank(), est);
 
         #pragma omp parallel
         {
@@ -1466,7 +1462,6 @@ namespace hsc  // hybrid std container
         }
         BL_BENCH_END(modify, "alloc_hashtable", est);
     }  // allocation threads.
-#endif
 
 #if defined(OVERLAPPED_COMM)
 
@@ -1516,10 +1511,14 @@ namespace hsc  // hybrid std container
         int tid = omp_get_thread_num();
         int tcnt = omp_get_num_threads();
 
+        //======= received buffer is (src rank, dest thread) major, so each thread's piece from each src rank is
+        // already contiguous.  large pieces are inserted in place, small ones are gathered first.
+        bool inplace = (tcnt > 1) && (rthread_total[tid] >= min_inplace_piece * comm_size);
+
         //======= shuffle received to get contiguous memory.  (CN buckets)
         V* shuffled;
         
-        if (tcnt > 1) {   // only need to shuffle if more than 1 thread
+        if ((tcnt > 1) && !inplace) {   // only need to shuffle if more than 1 thread
             shuffled = ::utils::mem::aligned_alloc<V>(rthread_total[tid] + batch_size);
             V* it = shuffled;
             for (int i = 0; i < this->comm.size(); ++i) {
@@ -1536,18 +1535,22 @@ namespace hsc  // hybrid std container
         // local compute part.  called by the communicator.
         // TODO: predicated version.
 
-        // if (estimate)
-        // NOTE: local cardinality estimation.
-        c1(tid, shuffled, shuffled + rthread_total[tid], estimate); 
-            // this->c[tid].insert(shuffled, shuffled + rthread_total[tid], T(1));
-        // else
-        //     c2(tid, shuffled, shuffled + rthread_total[tid]); // this->c[tid].insert_no_estimate(shuffled, shuffled + rthread_total[tid], T(1));
+        // NOTE: tables were sized from the global estimate before the a2a, so no local cardinality estimation here.
+        if (inplace) {
+            for (int i = 0; i < comm_size; ++i) {
+                V* b = distributed + rnode_bucket_offsets[i * tcnt + tid];
+                c1(tid, b, b + rnode_bucket_sizes[i * tcnt + tid], false);
+            }
+        } else {
+            c1(tid, shuffled, shuffled + rthread_total[tid], false);
+            // this->c[tid].insert_no_estimate(shuffled, shuffled + rthread_total[tid], T(1));
+        }
 
         after = this->c[tid].size();
 
         //printf("rank %d of %d, thread %d of %d before %ld after count %ld\n", comm_rank, comm_size, tid, tcnt, before, after);
 
-        if (tcnt > 1) {
+        if ((tcnt > 1) && !inplace) {
             ::utils::mem::aligned_free(shuffled);
         }
 
@@ -56,6 +56,7 @@
 #include <ostream>  // std::flush
 
 #include <type_traits>
+#include <memory>  // shared_ptr
 
 #include <mxx/collective.hpp>
 #include <mxx/reduction.hpp>
@@ -91,6 +92,23 @@ namespace hsc  // hybrid std container
 	// =================
 
 
+  /// parameter for the hybrid maps:  MapParams<K>::task_sched == true runs the bucketing, permute, and local insert/query
+  /// as OpenMP tasks instead of barrier separated phases.  see batched_robinhood_map_base::task_bucket_permute.
+  template <typename MP, typename = void>
+  struct task_sched_param : public ::std::false_type {};
+  template <typename MP>
+  struct task_sched_param<MP, typename ::std::enable_if<MP::task_sched>::type> : public ::std::true_type {};
+
+  /// parameter for the hybrid maps:  MapParams<K>::partition_factor, local partitions (containers) per thread, default 1.
+  /// with more partitions than threads, the partitions are claimed dynamically by the threads, so skewed partitions spread
+  /// over the cores, and the map can be used with a different thread count than it was built with.
+  template <typename MP, typename = void>
+  struct partition_factor_param : public ::std::integral_constant<uint8_t, 1U> {};
+  template <typename MP>
+  struct partition_factor_param<MP, typename ::std::enable_if<(MP::partition_factor > 0)>::type> :
+    public ::std::integral_constant<uint8_t, MP::partition_factor> {};
+
+
   /**
    * @brief  hybrid robinhood map following some of std unordered map's interface.
    * @details
@@ -197,8 +215,67 @@ namespace hsc  // hybrid std container
 //      template <typename K>
 //      using TransHash = typename MapParams<K>::template StoreTransFuncTemplate<K>;
 
+    // hyperloglog precision, MapParams<K>::hll_precision, default 12.  also used by the local container's estimator.
+    // with MapParams<K>::hll_sparse, the estimators start sparse (hyperloglog++), for low cardinality inserts.
+    static constexpr uint8_t hll_precision = ::hll_precision_param<MapParams<Key> >::value;
+    using hll_type = hyperloglog64<Key, InternalHash, hll_precision>;
+
     // own hyperloglog definition.  separate from the local container's.  this estimates using the transformed distribute hash.
-    std::vector<hyperloglog64<Key, InternalHash, 12> > hlls;
+    // hlls[0] accumulates the thread sketches, and is the running sketch across insert batches.
+    std::vector<hll_type> hlls;
+    hll_growth_predictor hll_growth;
+
+    // node-aware exchange:  MapParams<K>::hierarchical_comm == true.  the overlapped exchanges aggregate within the node
+    //   and send between nodes, instead of sending to every rank.  node_layout is built once, in the constructor.
+    static constexpr bool hierarchical_comm = ::khmxx::incremental::hierarchical_comm_param<MapParams<Key> >::value;
+    ::std::shared_ptr<::khmxx::incremental::node_layout> node_layout;
+
+    // task scheduling:  MapParams<K>::task_sched == true.  the input is cut into task_chunks chunks per thread, of at least
+    //   min_task_chunk elements, and idle threads pick up the next chunk or partition instead of waiting at a barrier.
+    static constexpr bool task_sched = ::hsc::task_sched_param<MapParams<Key> >::value;
+    static constexpr size_t task_chunks = 4;
+    static constexpr size_t min_task_chunk = 4096;
+
+    // receive side of the non-overlapped modify_p:  a partition's pieces, one per source rank, are inserted in place when
+    //   they average at least min_inplace_piece elements, else gathered into one buffer and inserted once.  every insert
+    //   call restarts the hash and prefetch pipeline, so at high rank counts the pieces are too small to insert one by one.
+    static constexpr size_t min_inplace_piece = 256;
+
+    // partitions:  c holds partition_factor * (threads at construction) local containers.  the barrier versions of
+    //   insert/query assume one partition per thread, so the task versions are used whenever the counts differ.
+    static constexpr size_t partition_factor = ::hsc::partition_factor_param<MapParams<Key> >::value;
+
+    inline bool use_tasks() const {
+      return task_sched || (this->c.size() != static_cast<size_t>(omp_get_max_threads()));
+    }
+
+    /// one sketch per thread.  the thread count may have grown since construction.
+    inline void fit_thread_hlls() {
+      for (size_t t = hlls.size(); t < static_cast<size_t>(omp_get_max_threads()); ++t)
+        hlls.emplace_back(0, ::hll_sparse_param<MapParams<Key> >::value);
+    }
+
+    /// incremental alltoallv and modify, pairwise or node-aware.
+    template <typename V, typename OP>
+    void exchange_and_modify(V* permuted, V* permuted_end, ::std::vector<size_t> const & send_counts, OP compute) const {
+    	if (hierarchical_comm)
+    		::khmxx::incremental::ialltoallv_and_modify_hierarchical(permuted, permuted_end, send_counts, compute,
+    				*node_layout, this->comm);
+    	else
+    		::khmxx::incremental::ialltoallv_and_modify(permuted, permuted_end, send_counts, compute, this->comm);
+    }
+
+    /// incremental alltoallv and one-to-one query, pairwise or node-aware.
+    template <typename V, typename OP, typename U>
+    void exchange_and_query_one_to_one(V* permuted, V* permuted_end, ::std::vector<size_t> const & send_counts,
+    		OP compute, U* result) const {
+    	if (hierarchical_comm)
+    		::khmxx::incremental::ialltoallv_and_query_one_to_one_hierarchical(permuted, permuted_end, send_counts, compute,
+    				result, *node_layout, this->comm);
+    	else
+    		::khmxx::incremental::ialltoallv_and_query_one_to_one(permuted, permuted_end, send_counts, compute,
+    				result, this->comm);
+    }
 
 
 	template <typename K>
@@ -218,7 +295,7 @@ namespace hsc  // hybrid std container
     		  StoreTransHash,
     		  StoreTransEqual, 
               Reducer,
-    		  Alloc>;
+    		  Alloc, ::std::integral_constant<uint8_t, hll_precision> >;
 
       // std::batched_robinhood_multimap public members.
       using key_type              = typename local_container_type::key_type;
@@ -483,7 +560,7 @@ namespace hsc  // hybrid std container
       // outputs: bucket sizes
       //		  permuted output
       // 		  hyperloglog
-      // TODO: [ ] hyperloglog64 with 32 bit hash values....
+      // TODO: [X] hyperloglog64 with 32 bit hash values....  use ::fsc::hash::hash_width_policy to narrow the hash.
       template <typename IT, typename ASSIGN_TYPE, typename HLL >
       void
       assign_count_estimate(IT _begin, IT _end,
@@ -753,6 +830,252 @@ namespace hsc  // hybrid std container
       }  // end of assign_estimate_count
 
 
+      //============= task scheduled bucketing.
+      // the barrier version steps all threads through transform/count, scan, permute, and compute, each on a 1/T block
+      // of the input, so the slowest thread, e.g. one whose partition resizes, sets the pace of every phase.
+      // with task_sched, the input is cut into more chunks than threads, and each phase is a set of OpenMP tasks,
+      // run by whichever thread is idle:
+      //   count:    one task per chunk.  transform, assign bucket ids, count, and update the running thread's hll.
+      //   scan:     one task per block of buckets, for the chunk offsets within each bucket.  then a serial scan of bucket totals.
+      //   permute:  one task per chunk, into the input.
+      //   piece:    one task per non-empty (chunk, bucket) piece, once that chunk is permuted.  the pieces of one bucket run
+      //             one at a time, in chunk order (task dependence on the bucket), as the local containers are not thread safe.
+      // a slow partition delays only its own pieces, while other threads permute the remaining chunks and compute on the other
+      // partitions.  chunk order is input order, so the permuted input, and the insertion order per partition, are the same as
+      // in the barrier version.
+      // with more buckets than threads (partition_factor > 1, or ranks x partitions), the pieces of a bucket are not split by
+      // chunk:  after all chunks are permuted, there is one task per bucket, and the threads claim buckets as they finish.
+
+      /**
+       * @brief transform and permute the input in place by bucket, with tasks.  see above.
+       * @param hll             per thread sketches, indexed by omp thread id, updated during counting and merged into hll[0].
+       *                        nullptr to skip estimation.
+       * @param bucket_sizes    output.  element count per bucket.
+       * @param bucket_offsets  output.  offset of each bucket in the permuted input.
+       * @param ready           ready() is called once, after counting and before permuting.  bucket_sizes is set then.
+       * @param piece           piece(bucket, b, e) is called as a task for each piece of permuted input.  nullptr to only permute.
+       * @param own             own(tid, nthreads) is called by every thread of the team after ready, before permuting.  for
+       *                        per thread setup that must run on that thread, e.g. first touch of its partition's table.
+       */
+      template <typename V, typename READY, typename PIECE = void (*)(int, V*, V*), typename OWN = void (*)(int, int)>
+      void task_bucket_permute(V* input, size_t const & in_size, size_t const & num_buckets, hll_type * hll,
+                               std::vector<size_t> & bucket_sizes, std::vector<size_t> & bucket_offsets,
+                               READY const & ready, PIECE const * piece = nullptr, OWN const * own = nullptr) const {
+
+        size_t tcnt = omp_get_max_threads();
+        size_t batch_size = InternalHash::batch_size;
+
+        // the per chunk counts take nchunks * num_buckets words.  with many buckets (ranks x threads), keep that
+        // to about the input size.
+        size_t nchunks = ::std::min(tcnt * task_chunks, in_size / min_task_chunk);
+        nchunks = ::std::min(nchunks, ::std::max(tcnt, (in_size * sizeof(V)) / (num_buckets * sizeof(size_t))));
+        if (nchunks == 0) nchunks = 1;
+        size_t block = in_size / nchunks;
+        size_t rem = in_size % nchunks;
+        size_t nblocks = ::std::min(nchunks, num_buckets);
+
+        std::vector< std::vector<size_t> > chunk_sizes(nchunks);
+        std::vector< std::vector<size_t> > chunk_offsets(nchunks);
+        std::vector<V*> buffers(nchunks, nullptr);
+        std::vector<uint32_t*> bids(nchunks, nullptr);
+        bucket_sizes.assign(num_buckets, 0);
+        bucket_offsets.assign(num_buckets, 0);
+
+        // task dependence tokens:  chunk k is permuted, and bucket j is being computed on.
+        std::vector<char> chunk_deps(nchunks);
+        std::vector<char> bucket_deps(num_buckets);
+        char * cdeps = chunk_deps.data();
+        char * bdeps = bucket_deps.data();
+
+#pragma omp parallel
+        {
+#pragma omp single
+        {
+          //===== transform, assign, and count.
+          for (size_t k = 0; k < nchunks; ++k) {
+#pragma omp task firstprivate(k)
+            {
+              size_t start = block * k + ::std::min(rem, k);
+              size_t cnt = block + (k < rem ? 1 : 0);
+              buffers[k] = ::utils::mem::aligned_alloc<V>(cnt + batch_size);
+              bids[k] = ::utils::mem::aligned_alloc<uint32_t>(cnt + batch_size);
+
+              this->transform_input(input + start, input + start + cnt, buffers[k]);
+
+              if (hll != nullptr) {
+                hll_type & h = hll[omp_get_thread_num()];
+                if (num_buckets <= std::numeric_limits<uint8_t>::max()) {
+                  this->assign_count_estimate(buffers[k], buffers[k] + cnt, static_cast<uint8_t>(num_buckets),
+                      chunk_sizes[k], reinterpret_cast<uint8_t*>(bids[k]), h);
+                } else if (num_buckets <= std::numeric_limits<uint16_t>::max()) {
+                  this->assign_count_estimate(buffers[k], buffers[k] + cnt, static_cast<uint16_t>(num_buckets),
+                      chunk_sizes[k], reinterpret_cast<uint16_t*>(bids[k]), h);
+                } else {
+                  this->assign_count_estimate(buffers[k], buffers[k] + cnt, static_cast<uint32_t>(num_buckets),
+                      chunk_sizes[k], reinterpret_cast<uint32_t*>(bids[k]), h);
+                }
+              } else {
+                if (num_buckets <= std::numeric_limits<uint8_t>::max()) {
+                  this->assign_count(buffers[k], buffers[k] + cnt, static_cast<uint8_t>(num_buckets),
+                      chunk_sizes[k], reinterpret_cast<uint8_t*>(bids[k]));
+                } else if (num_buckets <= std::numeric_limits<uint16_t>::max()) {
+                  this->assign_count(buffers[k], buffers[k] + cnt, static_cast<uint16_t>(num_buckets),
+                      chunk_sizes[k], reinterpret_cast<uint16_t*>(bids[k]));
+                } else {
+                  this->assign_count(buffers[k], buffers[k] + cnt, static_cast<uint32_t>(num_buckets),
+                      chunk_sizes[k], reinterpret_cast<uint32_t*>(bids[k]));
+                }
+              }
+              // an empty chunk returns with no counts.
+              chunk_sizes[k].resize(num_buckets, 0);
+              chunk_offsets[k].resize(num_buckets, 0);
+            }
+          }
+#pragma omp taskwait
+
+          if (hll != nullptr) {
+            for (size_t t = 1; t < tcnt; ++t) hll[0].merge(hll[t]);
+          }
+
+          //===== offsets of each chunk within each bucket, and bucket totals.
+          size_t bblock = num_buckets / nblocks;
+          size_t brem = num_buckets % nblocks;
+          for (size_t b = 0; b < nblocks; ++b) {
+#pragma omp task firstprivate(b)
+            {
+              size_t j = bblock * b + ::std::min(brem, b);
+              size_t jmax = j + bblock + (b < brem ? 1 : 0);
+              for (; j < jmax; ++j) {
+                size_t offset = 0;
+                for (size_t k = 0; k < nchunks; ++k) {
+                  chunk_offsets[k][j] = offset;
+                  offset += chunk_sizes[k][j];
+                }
+                bucket_sizes[j] = offset;
+              }
+            }
+          }
+#pragma omp taskwait
+
+          size_t offset = 0;
+          for (size_t j = 0; j < num_buckets; ++j) {
+            bucket_offsets[j] = offset;
+            offset += bucket_sizes[j];
+          }
+
+          ready();
+        }  // implicit barrier:  counts and offsets are ready on all threads.
+
+        if (own != nullptr) (*own)(omp_get_thread_num(), omp_get_num_threads());
+#pragma omp barrier
+
+#pragma omp single
+        {
+          //===== permute, and compute on each piece as soon as its chunk is done.
+          for (size_t k = 0; k < nchunks; ++k) {
+#pragma omp task firstprivate(k) depend(out: cdeps[k])
+            {
+              size_t cnt = block + (k < rem ? 1 : 0);
+              for (size_t j = 0; j < num_buckets; ++j) chunk_offsets[k][j] += bucket_offsets[j];
+
+              if (num_buckets == 1) {
+                // permute_by_bucketid copies a single bucket to the start of the output.
+                ::std::copy(buffers[k], buffers[k] + cnt, input + chunk_offsets[k][0]);
+                chunk_offsets[k][0] += cnt;
+              } else if (num_buckets <= std::numeric_limits<uint8_t>::max()) {
+                this->permute_by_bucketid(buffers[k], buffers[k] + cnt, reinterpret_cast<uint8_t*>(bids[k]),
+                    chunk_sizes[k], chunk_offsets[k], input);
+              } else if (num_buckets <= std::numeric_limits<uint16_t>::max()) {
+                this->permute_by_bucketid(buffers[k], buffers[k] + cnt, reinterpret_cast<uint16_t*>(bids[k]),
+                    chunk_sizes[k], chunk_offsets[k], input);
+              } else {
+                this->permute_by_bucketid(buffers[k], buffers[k] + cnt, reinterpret_cast<uint32_t*>(bids[k]),
+                    chunk_sizes[k], chunk_offsets[k], input);
+              }
+              // chunk_offsets[k] now holds the end of each piece.
+
+              ::utils::mem::aligned_free(bids[k]);
+              ::utils::mem::aligned_free(buffers[k]);
+            }
+
+            if ((piece == nullptr) || (num_buckets > tcnt)) continue;
+
+            for (size_t j = 0; j < num_buckets; ++j) {
+              if (chunk_sizes[k][j] == 0) continue;
+#pragma omp task firstprivate(k, j) depend(in: cdeps[k]) depend(inout: bdeps[j])
+              {
+                V* e = input + chunk_offsets[k][j];
+                (*piece)(static_cast<int>(j), e - chunk_sizes[k][j], e);
+              }
+            }
+          }
+
+          if ((piece != nullptr) && (num_buckets > tcnt)) {
+#pragma omp taskwait
+            for (size_t j = 0; j < num_buckets; ++j) {
+              if (bucket_sizes[j] == 0) continue;
+#pragma omp task firstprivate(j)
+              (*piece)(static_cast<int>(j), input + bucket_offsets[j], input + bucket_offsets[j] + bucket_sizes[j]);
+            }
+          }
+        }  // all tasks are done at the end of the single region.
+        }  // omp parallel
+      }
+
+
+      /// run op(p) as a task for each partition p.
+      template <typename OP>
+      void task_each_partition(OP const & op) const {
+        int nparts = this->c.size();
+#pragma omp parallel
+#pragma omp single
+        {
+          for (int p = 0; p < nparts; ++p) {
+#pragma omp task firstprivate(p)
+            op(p);
+          }
+        }
+      }
+
+      /// exchange the per (rank, partition) bucket counts, and compute send and receive counts per rank, and
+      /// the offset and count of each (source rank, partition) in the received buffer.  with OVERLAPPED_COMM the
+      /// offsets are within each source rank's message.
+      /// routing is fused:  one hash modulo (comm_size * nparts) gives bucket rank * nparts + partition, so a single
+      /// bucketing pass orders the send buffer by destination rank then partition, and the received buffer is grouped
+      /// by (source rank, partition), with no second assign or permute.
+      void exchange_bucket_counts(std::vector<size_t> const & node_bucket_sizes,
+                                    std::vector<size_t> & send_counts, std::vector<size_t> & recv_counts,
+                                    std::vector<size_t> & rnode_bucket_sizes, std::vector<size_t> & rnode_bucket_offsets,
+                                    std::vector<size_t> & rthread_total) const {
+        int comm_size = this->comm.size();
+        int jmax = this->c.size();
+
+        rnode_bucket_sizes.assign(node_bucket_sizes.size(), 0);
+        rnode_bucket_offsets.assign(node_bucket_sizes.size(), 0);
+        mxx::all2all(node_bucket_sizes.data(), jmax, rnode_bucket_sizes.data(), this->comm);
+
+        send_counts.assign(comm_size, 0);
+        recv_counts.assign(comm_size, 0);
+        rthread_total.assign(jmax, 0);
+
+        size_t recv_offset = 0;
+        for (int i = 0; i < comm_size; ++i) {
+#if defined(OVERLAPPED_COMM)
+          // if overlap, then we reset the offset for each rank-pair's message.
+          recv_offset = 0;
+#endif
+          for (int j = 0; j < jmax; ++j) {
+            send_counts[i] += node_bucket_sizes[i * jmax + j];
+            recv_counts[i] += rnode_bucket_sizes[i * jmax + j];
+
+            rnode_bucket_offsets[i * jmax + j] = recv_offset;
+            recv_offset += rnode_bucket_sizes[i * jmax + j];
+
+            rthread_total[j] += rnode_bucket_sizes[i * jmax + j];
+          }
+        }
+      }
+
 
 
     public:
@@ -763,10 +1086,11 @@ namespace hsc  // hybrid std container
         {
 
     	  if (_comm.rank() == 0)
-    		  printf("rank %d initializing for %d threads\n", _comm.rank(), omp_get_max_threads());
+    		  printf("rank %d initializing for %d threads, %lu partitions\n", _comm.rank(), omp_get_max_threads(),
+    				  omp_get_max_threads() * partition_factor);
 //		c = new local_container_type[omp_get_max_threads()];
-//		hlls = new hyperloglog64<Key, InternalHash, 12>[omp_get_max_threads()];
-  	  c.resize(omp_get_max_threads());
+//		hlls = new hll_type[omp_get_max_threads()];
+  	  c.resize(omp_get_max_threads() * partition_factor);
   	  hlls.resize(omp_get_max_threads());
 
  //   	  this->c.set_ignored_msb(ceilLog2(_comm.size()));   // NOTE THAT THIS SHOULD MATCH KEY_TO_RANK use of bits in hash table.
@@ -774,9 +1098,12 @@ namespace hsc  // hybrid std container
 	#pragma omp parallel
 	{
 			int tid = omp_get_thread_num();
-			c[tid].swap(local_container_type());  // get thread local allocation
-			hlls[tid].swap(hyperloglog64<Key, InternalHash, 12>());
+			int tcnt = omp_get_num_threads();
+			for (size_t p = tid; p < c.size(); p += tcnt)
+				c[p].swap(local_container_type());  // get thread local allocation
+			hlls[tid].swap(hll_type(0, ::hll_sparse_param<MapParams<Key> >::value));
 	}
+	if (hierarchical_comm) node_layout = ::std::make_shared<::khmxx::incremental::node_layout>(_comm);
       }
 
 
@@ -799,30 +1126,64 @@ namespace hsc  // hybrid std container
 
       /// clears the batched_robinhood_map
       virtual void local_reset() noexcept {
-        for (int i = 0; i < omp_get_max_threads(); ++i) {
+        for (size_t i = 0; i < this->c.size(); ++i) {
             this->c[i].clear();
     	    this->c[i].rehash(128);
           }
+        for (size_t i = 0; i < this->hlls.size(); ++i)
+    	    this->hlls[i].clear();
+        this->hll_growth.reset();
       }
 
       virtual void local_clear() noexcept {
-        for (int i = 0; i < omp_get_max_threads(); ++i)
+        for (size_t i = 0; i < this->c.size(); ++i)
             this->c[i].clear();
     
       }
 
       /// reserve space.  n is the local container size.  this allows different processes to individually adjust its own size.
       virtual void local_reserve( size_t n ) {
-          #pragma omp parallel
-          {
-        	  this->c[omp_get_thread_num()].reserve(n);
+          int nparts = this->c.size();
+          #pragma omp parallel for schedule(static, 1)
+          for (int p = 0; p < nparts; ++p) {
+        	  this->c[p].reserve(n);
           }
       }
 
+    protected:
+      /// capacity of one thread's (partition's) table for the coming insert.  est is the predicted distinct count for this process,
+      /// split evenly among partitions by the distribution hash.  the table cannot end up larger than its current size plus
+      /// the number of elements the thread receives, so that bounds the safety margin for small batches.
+      inline size_t thread_capacity(size_t const & est, int const & tcnt, int const & tid, size_t const & recv) const {
+        size_t lest = (est + tcnt - 1) / tcnt;
+        // add 10% just to be safe.
+        size_t padded = static_cast<size_t>(static_cast<double>(lest) * (1.0 + hll_type::est_error_rate + 0.1));
+        return ::std::max(lest, ::std::min(padded, this->c[tid].size() + recv));
+      }
+
+      /// grow one thread's table.  call from within the parallel region, by thread tid, so the new table is first touched
+      /// (and placed) by the thread that inserts into it.
+      inline void reserve_thread(int const & tid, size_t const & n) {
+        if (n > (this->c[tid].get_max_load_factor() * this->c[tid].capacity()))
+          this->c[tid].reserve(n);
+      }
+
+      /// grow the tables of the partitions that thread tid of nthreads owns, p = tid, tid + nthreads, ..., as in the barrier
+      /// versions.  call from every thread of a parallel region, not from tasks:  a task runs on any thread, and would
+      /// first touch the table on that thread's NUMA node.  recv is the element count per partition.
+      inline void reserve_owned(int const & tid, int const & nthreads, size_t const & est, std::vector<size_t> const & recv) {
+        int nparts = this->c.size();
+        for (int p = tid; p < nparts; p += nthreads)
+          this->reserve_thread(p, this->thread_capacity(est, nparts, p, recv[p]));
+      }
+
+    public:
+
       virtual void local_rehash( size_t b ) {
-        #pragma omp parallel
-        {
-    	  this->c[omp_get_thread_num()].rehash(b);
+        int nparts = this->c.size();
+        #pragma omp parallel for schedule(static, 1)
+        for (int p = 0; p < nparts; ++p) {
+    	  this->c[p].rehash(b);
         }
       }
 
@@ -832,7 +1193,7 @@ namespace hsc  // hybrid std container
       /// check if empty.
       virtual bool local_empty() const {
         bool res = true;
-        for (int i = 0; i < omp_get_max_threads(); ++i)
+        for (size_t i = 0; i < this->c.size(); ++i)
           res &= (this->c[i].size() == 0);
           
         return res;
@@ -841,14 +1202,14 @@ namespace hsc  // hybrid std container
       /// get number of entries in local container
       virtual size_t local_size() const {
         size_t res = 0;
-        for (int i = 0; i < omp_get_max_threads(); ++i)
+        for (size_t i = 0; i < this->c.size(); ++i)
             res += this->c[i].size();
         return res;
       }
 
       virtual size_t local_capacity() const {
           size_t res = 0;
-        for (int i = 0; i < omp_get_max_threads(); ++i)
+        for (size_t i = 0; i < this->c.size(); ++i)
             res += this->c[i].capacity();
         return res;
       }
@@ -861,8 +1222,8 @@ namespace hsc  // hybrid std container
 
 
       virtual std::vector<bool> local_empties() const {
-        std::vector<bool> res(omp_get_max_threads());
-        for (int i = 0; i < omp_get_max_threads(); ++i)
+        std::vector<bool> res(this->c.size());
+        for (size_t i = 0; i < this->c.size(); ++i)
           res[i] = (this->c[i].size() == 0);
           
         return res;
@@ -870,15 +1231,15 @@ namespace hsc  // hybrid std container
 
       /// get number of entries in local container
       virtual std::vector<size_t> local_sizes() const {
-        std::vector<size_t> res(omp_get_max_threads());
-        for (int i = 0; i < omp_get_max_threads(); ++i)
+        std::vector<size_t> res(this->c.size());
+        for (size_t i = 0; i < this->c.size(); ++i)
             res[i] = this->c[i].size();
         return res;
       }
 
       virtual std::vector<size_t> local_capacitys() const {
-        std::vector<size_t> res(omp_get_max_threads());
-        for (int i = 0; i < omp_get_max_threads(); ++i)
+        std::vector<size_t> res(this->c.size());
+        for (size_t i = 0; i < this->c.size(); ++i)
             res[i] = this->c[i].capacity();
         return res;
       }
@@ -898,25 +1259,25 @@ namespace hsc  // hybrid std container
       }
 
       virtual void set_max_load_factor(double const & max_load) {
-        for (int i = 0; i < omp_get_max_threads(); ++i)
+        for (size_t i = 0; i < this->c.size(); ++i)
         {
               this->c[i].set_max_load_factor(max_load);
         }
       }
       virtual void set_min_load_factor(double const & min_load) {
-        for (int i = 0; i < omp_get_max_threads(); ++i)
+        for (size_t i = 0; i < this->c.size(); ++i)
         {
               this->c[i].set_min_load_factor(min_load);
           }
       }
       virtual void set_insert_lookahead(uint8_t insert_prefetch) {
-        for (int i = 0; i < omp_get_max_threads(); ++i)
+        for (size_t i = 0; i < this->c.size(); ++i)
         {
               this->c[i].set_insert_lookahead(insert_prefetch);
         }
       }
       virtual void set_query_lookahead(uint8_t query_prefetch) {
-        for (int i = 0; i < omp_get_max_threads(); ++i)
+        for (size_t i = 0; i < this->c.size(); ++i)
         {
               this->c[i].set_query_lookahead(query_prefetch);
         }
@@ -934,7 +1295,7 @@ namespace hsc  // hybrid std container
       const_iterator cbegin() const {
         const_iterator iter; 
 
-        for (int i = 0; i < omp_get_max_threads(); ++i)
+        for (size_t i = 0; i < this->c.size(); ++i)
         {  
             iter.addRange(this->c[i].cbegin(), this->c[i].cend() );
         }
@@ -942,7 +1303,7 @@ namespace hsc  // hybrid std container
       }
 
       const_iterator cend() const {
-        return const_iterator(this->c[omp_get_max_threads() - 1].cend());
+        return const_iterator(this->c.back().cend());
       }
 
       using Base::size;
@@ -952,37 +1313,37 @@ namespace hsc  // hybrid std container
       /// convert the map to a vector
       virtual void to_vector(std::vector<std::pair<Key, T> > & results) const {
         std::vector<size_t> sizes = this->local_sizes();
-        std::vector<size_t> offsets(omp_get_max_threads());
+        std::vector<size_t> offsets(this->c.size());
         size_t sum = 0;
-        for (int i = 0; i < omp_get_max_threads(); ++i) {
+        for (size_t i = 0; i < this->c.size(); ++i) {
             offsets[i] = sum;
             sum += sizes[i];
         }
         results.clear();
         results.resize(sum);
 
-        #pragma omp parallel
-        {
-            int tid = omp_get_thread_num();
-            std::copy(this->c[tid].cbegin(), this->c[tid].cend(), results.begin() + offsets[tid]);
+        int nparts = this->c.size();
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int p = 0; p < nparts; ++p) {
+            std::copy(this->c[p].cbegin(), this->c[p].cend(), results.begin() + offsets[p]);
         }
       }
       /// extract the unique keys of a map.
       virtual void keys(std::vector<Key> & results) const {
         std::vector<size_t> sizes = this->local_sizes();
-        std::vector<size_t> offsets(omp_get_max_threads());
+        std::vector<size_t> offsets(this->c.size());
         size_t sum = 0;
-        for (int i = 0; i < omp_get_max_threads(); ++i) {
+        for (size_t i = 0; i < this->c.size(); ++i) {
             offsets[i] = sum;
             sum += sizes[i];
         }
         results.clear();
         results.resize(sum);
 
-        #pragma omp parallel
-        {
-            int tid = omp_get_thread_num();
-            std::transform(this->c[tid].cbegin(), this->c[tid].cend(), results.begin() + offsets[tid],
+        int nparts = this->c.size();
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int p = 0; p < nparts; ++p) {
+            std::transform(this->c[p].cbegin(), this->c[p].cend(), results.begin() + offsets[p],
                 [](std::pair<Key,T> const & x){
                     return x.first;
                 });
@@ -998,6 +1359,10 @@ namespace hsc  // hybrid std container
    */
   template <bool estimate, typename V, typename OP, typename Predicate = ::bliss::filter::TruePredicate>
   int64_t modify_1(std::vector<V>& input, OP const & compute) {
+    this->fit_thread_hlls();
+    if (this->use_tasks() && ((this->c.size() > 1) || (omp_get_max_threads() > 1)))
+      return this->template modify_1_tasks<estimate>(input, compute);
+
     // even if count is 0, still need to participate in mpi calls.  if (input.size() == 0) return;
     BL_BENCH_INIT(modify);
 
@@ -1066,6 +1431,7 @@ namespace hsc  // hybrid std container
 
 
     BL_BENCH_START(modify);
+    size_t est = 0;
     #pragma omp parallel reduction(+ : cnt)
     {
         int tid = omp_get_thread_num();
@@ -1091,15 +1457,40 @@ namespace hsc  // hybrid std container
             uint32_t* bid_buf = ::utils::mem::aligned_alloc<uint32_t>(r_end - r_start + batch_size);
 
 
-            if (nthreads_global <= std::numeric_limits<uint8_t>::max()) {
-                this->assign_count(buffer, buffer + block, static_cast<uint8_t>(nthreads_global),
-                 thread_bucket_sizes[tid], reinterpret_cast<uint8_t*>(bid_buf) );
-            } else if (nthreads_global <= std::numeric_limits<uint16_t>::max()) {
-                this->assign_count(buffer, buffer + block, static_cast<uint16_t>(nthreads_global),
-                 thread_bucket_sizes[tid], reinterpret_cast<uint16_t*>(bid_buf) );
-            } else {   // mpi supports only 31 bit worth of ranks.
-                this->assign_count(buffer, buffer + block, static_cast<uint32_t>(nthreads_global),
-                 thread_bucket_sizes[tid], reinterpret_cast<uint32_t*>(bid_buf) );
+            if (estimate) {
+                // estimate during bucketing, so the thread tables can be sized before the insert.
+                if (nthreads_global <= std::numeric_limits<uint8_t>::max()) {
+                    this->assign_count_estimate(buffer, buffer + block, static_cast<uint8_t>(nthreads_global),
+                     thread_bucket_sizes[tid], reinterpret_cast<uint8_t*>(bid_buf), hlls[tid] );
+                } else if (nthreads_global <= std::numeric_limits<uint16_t>::max()) {
+                    this->assign_count_estimate(buffer, buffer + block, static_cast<uint16_t>(nthreads_global),
+                     thread_bucket_sizes[tid], reinterpret_cast<uint16_t*>(bid_buf), hlls[tid] );
+                } else {
+                    this->assign_count_estimate(buffer, buffer + block, static_cast<uint32_t>(nthreads_global),
+                     thread_bucket_sizes[tid], reinterpret_cast<uint32_t*>(bid_buf), hlls[tid] );
+                }
+
+                //==== now that hll is done, merge in binary way.
+                int mask = 0;
+                for (int i = 1; i < tcnt; i <<= 1) {
+                    mask = (mask << 1) | 1;
+                    if (((tid & mask) == 0) &  // select only power of 2 to merge into.
+                        ((tid ^ i) < tcnt)) {  // flip the bit to get the current peer.
+                            this->hlls[tid].merge(this->hlls[tid ^ i]);
+                        }
+                        #pragma omp barrier
+                }
+            } else {
+                if (nthreads_global <= std::numeric_limits<uint8_t>::max()) {
+                    this->assign_count(buffer, buffer + block, static_cast<uint8_t>(nthreads_global),
+                     thread_bucket_sizes[tid], reinterpret_cast<uint8_t*>(bid_buf) );
+                } else if (nthreads_global <= std::numeric_limits<uint16_t>::max()) {
+                    this->assign_count(buffer, buffer + block, static_cast<uint16_t>(nthreads_global),
+                     thread_bucket_sizes[tid], reinterpret_cast<uint16_t*>(bid_buf) );
+                } else {   // mpi supports only 31 bit worth of ranks.
+                    this->assign_count(buffer, buffer + block, static_cast<uint32_t>(nthreads_global),
+                     thread_bucket_sizes[tid], reinterpret_cast<uint32_t*>(bid_buf) );
+                }
             }
             thread_bucket_offsets[tid].resize(nthreads_global, 0);
 
@@ -1223,6 +1614,14 @@ namespace hsc  // hybrid std container
             it = input.data() + node_bucket_offsets[tid];
             et = it + node_bucket_sizes[tid]; 
 
+            if (estimate) {
+                // size all thread tables before the insert.  each thread allocates (first touch) its own.
+                #pragma omp single
+                {
+                    est = this->hll_growth.predict(this->hlls[0].estimate());
+                }  // implicit barrier.
+                this->reserve_thread(tid, this->thread_capacity(est, tcnt, tid, node_bucket_sizes[tid]));
+            }
 
 #ifdef MT_DEBUG
 #pragma omp barrier
@@ -1260,7 +1659,8 @@ namespace hsc  // hybrid std container
         }
 #endif
 
-        compute(tid, it, et, estimate);
+        // with more than 1 thread, the table is already sized.  a single thread estimates in the local container.
+        compute(tid, it, et, estimate && (tcnt == 1));
         //printf("rank %d of %d, thread %d of %d before %ld after count %ld\n", 0, 1, tid, tcnt, before, this->c[tid].size());
 
         cnt = static_cast<int64_t>(this->c[tid].size()) - static_cast<int64_t>(before);
@@ -1294,6 +1694,9 @@ namespace hsc  // hybrid std container
 
   template <bool estimate, typename V, typename C1, typename C2, typename Predicate = ::bliss::filter::TruePredicate>
   int64_t modify_p(std::vector<V >& input, C1 const & c1, C2 const & c2) {
+    this->fit_thread_hlls();
+    if (this->use_tasks()) return this->template modify_p_tasks<estimate>(input, c1, c2);
+
     // even if count is 0, still need to participate in mpi calls.  if (input.size() == 0) return;
     BL_BENCH_INIT(modify);
 
@@ -1441,10 +1844,8 @@ namespace hsc  // hybrid std container
 //	        BL_BENCH_END(modify, "transform", input.size());
 
 
-// NOTE: overlap comm is incrementally inserting so we estimate before transmission, thus global estimate, and 64 bit
-//            hash is needed.
-//       non-overlap comm can estimate just before insertion for more accurate estimate based on actual input received.
-//          so 32 bit hashes are sufficient.
+// NOTE: estimate before transmission, thus global estimate.  all thread tables are then sized before any data arrives,
+//       for overlapped comm which inserts incrementally, and for non-overlapped comm so the insert loop does not resize.
             // count and estimate and save the bucket ids.
 //    BL_BENCH_COLLECTIVE_START(modify, "permute_estimate", this->comm);
         // allocate an HLL
@@ -1454,7 +1855,6 @@ namespace hsc  // hybrid std container
     
         uint32_t* bid_buf = ::utils::mem::aligned_alloc<uint32_t>(r_end - r_start + batch_size);
 
-    #if defined(OVERLAPPED_COMM) //|| defined(OVERLAPPED_COMM_BATCH) || defined(OVERLAPPED_COMM_FULLBUFFER) || defined(OVERLAPPED_COMM_2P)
         if (estimate) {
             if ( nthreads_global <= std::numeric_limits<uint8_t>::max()) {
             
@@ -1483,7 +1883,6 @@ namespace hsc  // hybrid std container
             }
 
         } else {
-    #endif
             if (nthreads_global <= std::numeric_limits<uint8_t>::max()) {
                 this->assign_count(buffer, buffer + block, static_cast<uint8_t>(nthreads_global), thread_bucket_sizes[tid],
                             reinterpret_cast<uint8_t*>(bid_buf) );
@@ -1494,9 +1893,7 @@ namespace hsc  // hybrid std container
                     this->assign_count(buffer, buffer + block, static_cast<uint32_t>(nthreads_global), thread_bucket_sizes[tid],
                             reinterpret_cast<uint32_t*>(bid_buf) );
             }
-    #if defined(OVERLAPPED_COMM) //|| defined(OVERLAPPED_COMM_BATCH) || defined(OVERLAPPED_COMM_FULLBUFFER) || defined(OVERLAPPED_COMM_2P)
         }
-    #endif
         // do some calc with thread_bucket_sizes to get offsets for each bucket for each thread in node-wide permuted input array.
         thread_bucket_offsets[tid].resize(nthreads_global,0);
         
@@ -1776,34 +2173,26 @@ namespace hsc  // hybrid std container
 
     size_t after = 0;
 
-#if defined(OVERLAPPED_COMM) //|| defined(OVERLAPPED_COMM_BATCH) || defined(OVERLAPPED_COMM_FULLBUFFER) || defined(OVERLAPPED_COMM_2P)
-
     if (estimate) {
         BL_BENCH_COLLECTIVE_START(modify, "alloc_hashtable", this->comm);
-        size_t est = this->hlls[0].estimate_average_per_rank(this->comm);
-        printf("rank %d estimated size %ld\n", this->comm.rank(), est);
+        size_t est = this->hll_growth.predict(this->hlls[0].estimate_global(this->comm)) / static_cast<double>(this->comm.size());
+        BL_DEBUGF("rank %d estimated size %ld\n", this->comm.rank(), est);
 
+        // each thread sizes its own table, so the pages are first touched by the thread that inserts into them.
         #pragma omp parallel
         {
             int tid = omp_get_thread_num();
-            int tcnt = omp_get_num_threads();
-
-            // further divide by number of threads.
-            size_t lest = (est + tcnt - 1) / tcnt;
-            if (lest > (this->c[tid].get_max_load_factor() * this->c[tid].capacity()))
-            // add 10% just to be safe.
-                this->c[tid].reserve(static_cast<size_t>(static_cast<double>(lest) * (1.0 + this->hlls[tid].est_error_rate + 0.1)));
+            this->reserve_thread(tid, this->thread_capacity(est, omp_get_num_threads(), tid, rthread_total[tid]));
         }
         BL_BENCH_END(modify, "alloc_hashtable", est);
     }  // allocation threads.
-#endif
 
 #if defined(OVERLAPPED_COMM)
 
     BL_BENCH_COLLECTIVE_START(modify, "a2av_modify", this->comm);
 
     // need to be threaded.
-    ::khmxx::incremental::ialltoallv_and_modify(
+    this->exchange_and_modify(
         input.data(), input.data() + input.size(),
         send_counts,
         [this, &rnode_bucket_offsets, &rnode_bucket_sizes, &c2](int rank, V* b, V* e){
@@ -1817,8 +2206,7 @@ namespace hsc  // hybrid std container
 
                 c2(tid, bb, ee); // this->c[tid].insert_no_estimate(bb, ee, T(1));
             }  // finished parallel modify.
-        },
-        this->comm);
+        });
     #pragma omp parallel reduction(+: after)
     {
         int tid = omp_get_thread_num();
@@ -1846,10 +2234,14 @@ namespace hsc  // hybrid std container
         int tid = omp_get_thread_num();
         int tcnt = omp_get_num_threads();
 
+        //======= received buffer is (src rank, dest thread) major, so each thread's piece from each src rank is
+        // already contiguous.  large pieces are inserted in place, small ones are gathered first.
+        bool inplace = (tcnt > 1) && (rthread_total[tid] >= min_inplace_piece * comm_size);
+
         //======= shuffle received to get contiguous memory.  (CN buckets)
         V* shuffled;
         
-        if (tcnt > 1) {   // only need to shuffle if more than 1 thread
+        if ((tcnt > 1) && !inplace) {   // only need to shuffle if more than 1 thread
             shuffled = ::utils::mem::aligned_alloc<V>(rthread_total[tid] + batch_size);
             V* it = shuffled;
             for (int i = 0; i < this->comm.size(); ++i) {
@@ -1870,18 +2262,22 @@ namespace hsc  // hybrid std container
         // local compute part.  called by the communicator.
         // TODO: predicated version.
 
-        // if (estimate)
-        // NOTE: local cardinality estimation.
-        c1(tid, shuffled, shuffled + rthread_total[tid], estimate); 
-            // this->c[tid].insert(shuffled, shuffled + rthread_total[tid], T(1));
-        // else
-        //     c2(tid, shuffled, shuffled + rthread_total[tid]); // this->c[tid].insert_no_estimate(shuffled, shuffled + rthread_total[tid], T(1));
+        // NOTE: tables were sized from the global estimate before the a2a, so no local cardinality estimation here.
+        if (inplace) {
+            for (int i = 0; i < comm_size; ++i) {
+                V* b = distributed + rnode_bucket_offsets[i * tcnt + tid];
+                c1(tid, b, b + rnode_bucket_sizes[i * tcnt + tid], false);
+            }
+        } else {
+            c1(tid, shuffled, shuffled + rthread_total[tid], false);
+            // this->c[tid].insert_no_estimate(shuffled, shuffled + rthread_total[tid], T(1));
+        }
 
         after = this->c[tid].size();
 
         //printf("rank %d of %d, thread %d of %d before %ld after count %ld\n", comm_rank, comm_size, tid, tcnt, before, after);
 
-        if (tcnt > 1) {
+        if ((tcnt > 1) && !inplace) {
             ::utils::mem::aligned_free(shuffled);
         }
 
@@ -1920,6 +2316,168 @@ namespace hsc  // hybrid std container
   }
 
 
+  /// modify_1 with task scheduling.  each partition's pieces are inserted as soon as they are permuted.
+  template <bool estimate, typename V, typename OP>
+  int64_t modify_1_tasks(std::vector<V>& input, OP const & compute) {
+    BL_BENCH_INIT(modify);
+
+    if (::dsc::empty(input, this->comm)) {
+        BL_BENCH_REPORT_MPI_NAMED(modify, "hashmap:modify_1_tasks", this->comm);
+        return 0;
+    }
+
+    BL_BENCH_START(modify);
+    int nparts = this->c.size();
+    std::vector<size_t> part_sizes;
+    std::vector<size_t> part_offsets;
+    size_t est = 0;
+    int64_t before = 0;
+    for (int p = 0; p < nparts; ++p) before += this->c[p].size();
+    BL_BENCH_END(modify, "alloc", nparts);
+
+    BL_BENCH_START(modify);
+    auto ready = [this, &est](){
+        if (estimate) est = this->hll_growth.predict(this->hlls[0].estimate());
+    };
+    // tables are sized by their owning threads before any piece is inserted.
+    auto reserve = [this, &est, &part_sizes](int tid, int nthreads){
+        this->reserve_owned(tid, nthreads, est, part_sizes);
+    };
+    auto insert_piece = [&compute](int p, V* b, V* e){
+        compute(p, b, e, false);
+    };
+    this->task_bucket_permute(input.data(), input.size(), static_cast<size_t>(nparts),
+        estimate ? this->hlls.data() : nullptr, part_sizes, part_offsets, ready, &insert_piece,
+        estimate ? &reserve : nullptr);
+
+    int64_t after = 0;
+    for (int p = 0; p < nparts; ++p) after += this->c[p].size();
+    BL_BENCH_END(modify, "task_trans_permute_modify", after - before);
+
+    BL_BENCH_REPORT_MPI_NAMED(modify, "hashmap:modify_1_tasks", this->comm);
+
+    return after - before;
+  }
+
+
+  /// modify_p with task scheduling.  tasks for bucketing and permuting, and for the per partition insert after the exchange.
+  template <bool estimate, typename V, typename C1, typename C2>
+  int64_t modify_p_tasks(std::vector<V >& input, C1 const & c1, C2 const & c2) {
+    BL_BENCH_INIT(modify);
+
+    if (::dsc::empty(input, this->comm)) {
+      BL_BENCH_REPORT_MPI_NAMED(modify, "hashmap:modify_p_tasks", this->comm);
+      return 0;
+    }
+
+    BL_BENCH_START(modify);
+    int nparts = this->c.size();
+    size_t nthreads_global = this->comm.size() * nparts;
+    int batch_size = InternalHash::batch_size;
+    std::vector<size_t> node_bucket_sizes;
+    std::vector<size_t> node_bucket_offsets;
+    size_t before = 0;
+    for (int p = 0; p < nparts; ++p) before += this->c[p].size();
+    BL_BENCH_END(modify, "alloc", nthreads_global);
+
+    BL_BENCH_COLLECTIVE_START(modify, "permute_estimate", this->comm);
+    this->task_bucket_permute(input.data(), input.size(), nthreads_global,
+        estimate ? this->hlls.data() : nullptr, node_bucket_sizes, node_bucket_offsets, [](){});
+    BL_BENCH_END(modify, "permute_estimate", input.size());
+
+    BL_BENCH_COLLECTIVE_START(modify, "a2a_count", this->comm);
+    std::vector<size_t> send_counts;
+    std::vector<size_t> recv_counts;
+    std::vector<size_t> rnode_bucket_sizes;
+    std::vector<size_t> rnode_bucket_offsets;
+    std::vector<size_t> rthread_total;
+    this->exchange_bucket_counts(node_bucket_sizes, send_counts, recv_counts,
+        rnode_bucket_sizes, rnode_bucket_offsets, rthread_total);
+    BL_BENCH_END(modify, "a2a_count", recv_counts.size());
+
+    if (estimate) {
+        BL_BENCH_COLLECTIVE_START(modify, "alloc_hashtable", this->comm);
+        size_t est = this->hll_growth.predict(this->hlls[0].estimate_global(this->comm)) / static_cast<double>(this->comm.size());
+
+        // on the owning threads, not in tasks, for first touch.
+        #pragma omp parallel
+        this->reserve_owned(omp_get_thread_num(), omp_get_num_threads(), est, rthread_total);
+        BL_BENCH_END(modify, "alloc_hashtable", est);
+    }
+
+    size_t after = 0;
+
+#if defined(OVERLAPPED_COMM)
+
+    BL_BENCH_COLLECTIVE_START(modify, "a2av_modify", this->comm);
+
+    this->exchange_and_modify(
+        input.data(), input.data() + input.size(),
+        send_counts,
+        [this, nparts, &rnode_bucket_offsets, &rnode_bucket_sizes, &c2](int rank, V* b, V* e){
+            this->task_each_partition([nparts, rank, b, &rnode_bucket_offsets, &rnode_bucket_sizes, &c2](int p){
+                V* bb = b + rnode_bucket_offsets[rank * nparts + p];
+                c2(p, bb, bb + rnode_bucket_sizes[rank * nparts + p]);
+            });
+        });
+    for (int p = 0; p < nparts; ++p) after += this->c[p].size();
+
+    BL_BENCH_END(modify, "a2av_modify", after);
+
+#else
+    size_t recv_total = rnode_bucket_offsets.back() + rnode_bucket_sizes.back();
+
+    BL_BENCH_START(modify);
+    V* distributed = ::utils::mem::aligned_alloc<V>(recv_total + batch_size);
+    BL_BENCH_END(modify, "alloc_output", recv_total);
+
+    BL_BENCH_COLLECTIVE_START(modify, "a2a", this->comm);
+    ::khmxx::distribute_permuted(input.data(), input.data() + input.size(),
+                send_counts, distributed, recv_counts, this->comm);
+    BL_BENCH_END(modify, "a2a", input.size());
+
+    BL_BENCH_COLLECTIVE_START(modify, "modify", this->comm);
+    int comm_size = this->comm.size();
+    this->task_each_partition([this, comm_size, nparts, batch_size, distributed,
+                               &rnode_bucket_offsets, &rnode_bucket_sizes, &rthread_total, &c1](int p){
+        // NOTE: tables were sized from the global estimate before the a2a, so no local cardinality estimation here.
+        //======= large pieces:  insert each source rank's piece in place.
+        if (rthread_total[p] >= min_inplace_piece * comm_size) {
+            for (int i = 0; i < comm_size; ++i) {
+                V* b = distributed + rnode_bucket_offsets[i * nparts + p];
+                c1(p, b, b + rnode_bucket_sizes[i * nparts + p], false);
+            }
+            return;
+        }
+
+        //======= gather the partition's pieces from each source rank into contiguous memory.
+        V* shuffled = ::utils::mem::aligned_alloc<V>(rthread_total[p] + batch_size);
+        V* it = shuffled;
+        for (int i = 0; i < comm_size; ++i) {
+            memcpy(it, distributed + rnode_bucket_offsets[i * nparts + p],
+                rnode_bucket_sizes[i * nparts + p] * sizeof(V));
+            it += rnode_bucket_sizes[i * nparts + p];
+        }
+
+        c1(p, shuffled, shuffled + rthread_total[p], false);
+
+        ::utils::mem::aligned_free(shuffled);
+    });
+    for (int p = 0; p < nparts; ++p) after += this->c[p].size();
+    BL_BENCH_END(modify, "modify", after);
+
+    BL_BENCH_START(modify);
+    ::utils::mem::aligned_free(distributed);
+    BL_BENCH_END(modify, "clean up", recv_total);
+
+#endif // non overlap
+
+    BL_BENCH_REPORT_MPI_NAMED(modify, "hashmap:modify_p_tasks", this->comm);
+
+    return static_cast<int64_t>(after) - static_cast<int64_t>(before);
+  }
+
+
 
 
     public:
@@ -1960,6 +2518,9 @@ namespace hsc  // hybrid std container
       void query_1(std::vector<Key> & input,
     		  V* results,
               OP compute) const {
+        if (this->use_tasks() && ((this->c.size() > 1) || (omp_get_max_threads() > 1)))
+          return this->query_1_tasks(input, results, compute);
+
         // even if count is 0, still need to participate in mpi calls.  if (input.size() == 0) return;
         BL_BENCH_INIT(query);
 
@@ -2254,6 +2815,8 @@ namespace hsc  // hybrid std container
       void query_p(std::vector<Key >& input,
     		  V * results,
               OP compute) const {
+        if (this->use_tasks()) return this->query_p_tasks(input, results, compute);
+
         // even if count is 0, still need to participate in mpi calls.  if (input.size() == 0) return;
         BL_BENCH_INIT(query);
 
@@ -2639,7 +3202,7 @@ namespace hsc  // hybrid std container
 
     BL_BENCH_COLLECTIVE_START(query, "a2av_query", this->comm);
 
-    ::khmxx::incremental::ialltoallv_and_query_one_to_one(
+    this->exchange_and_query_one_to_one(
         input.data(), input.data() + input.size(), send_counts,
         [this, &rnode_bucket_offsets, &rnode_bucket_sizes, &compute](int rank, 
                                                         Key* b, Key* e, V* r){
@@ -2655,8 +3218,7 @@ namespace hsc  // hybrid std container
                 compute(tid, bb, ee, rr); // this->c[tid].insert_no_estimate(bb, ee, T(1));
             }  // finished parallel modify.
         },
-        results,
-        this->comm);
+        results);
 
     BL_BENCH_END(query, "a2av_query", input.size());
 
@@ -2741,6 +3303,123 @@ namespace hsc  // hybrid std container
     }
 
 
+      /// query_1 with task scheduling.  each piece is queried as soon as it is permuted.
+      template <typename V, typename OP>
+      void query_1_tasks(std::vector<Key> & input, V* results, OP compute) const {
+        BL_BENCH_INIT(query);
+
+        if (::dsc::empty(input, this->comm)) {
+          BL_BENCH_REPORT_MPI_NAMED(query, "base_hashmap:query_tasks", this->comm);
+          return;
+        }
+
+        BL_BENCH_START(query);
+        std::vector<size_t> part_sizes;
+        std::vector<size_t> part_offsets;
+        Key* in = input.data();
+        auto query_piece = [in, results, &compute](int p, Key* b, Key* e){
+            compute(p, b, e, results + (b - in));
+        };
+        this->task_bucket_permute(input.data(), input.size(), this->c.size(), nullptr,
+            part_sizes, part_offsets, [](){}, &query_piece);
+        BL_BENCH_END(query, "task_local_find", input.size());
+
+        BL_BENCH_REPORT_MPI_NAMED(query, "base_hashmap:query_tasks", this->comm);
+      }
+
+
+      /// query_p with task scheduling.  tasks for bucketing and permuting, and for the per partition query after the exchange.
+      template <typename V, typename OP>
+      void query_p_tasks(std::vector<Key >& input, V * results, OP compute) const {
+        BL_BENCH_INIT(query);
+
+        if (::dsc::empty(input, this->comm)) {
+          BL_BENCH_REPORT_MPI_NAMED(query, "hashmap:query_p_tasks", this->comm);
+          return;
+        }
+
+        BL_BENCH_START(query);
+        int nparts = this->c.size();
+        size_t nthreads_global = this->comm.size() * nparts;
+        size_t batch_size = InternalHash::batch_size;
+        std::vector<size_t> node_bucket_sizes;
+        std::vector<size_t> node_bucket_offsets;
+        BL_BENCH_END(query, "alloc", nthreads_global);
+
+        BL_BENCH_COLLECTIVE_START(query, "permute", this->comm);
+        this->task_bucket_permute(input.data(), input.size(), nthreads_global, nullptr,
+            node_bucket_sizes, node_bucket_offsets, [](){});
+        BL_BENCH_END(query, "permute", input.size());
+
+        BL_BENCH_COLLECTIVE_START(query, "a2a_count", this->comm);
+        std::vector<size_t> send_counts;
+        std::vector<size_t> recv_counts;
+        std::vector<size_t> rnode_bucket_sizes;
+        std::vector<size_t> rnode_bucket_offsets;
+        std::vector<size_t> rthread_total;
+        this->exchange_bucket_counts(node_bucket_sizes, send_counts, recv_counts,
+            rnode_bucket_sizes, rnode_bucket_offsets, rthread_total);
+        BL_BENCH_END(query, "a2a_count", recv_counts.size());
+
+#if defined(OVERLAPPED_COMM)
+
+        BL_BENCH_COLLECTIVE_START(query, "a2av_query", this->comm);
+
+        this->exchange_and_query_one_to_one(
+            input.data(), input.data() + input.size(), send_counts,
+            [this, nparts, &rnode_bucket_offsets, &rnode_bucket_sizes, &compute](int rank, Key* b, Key* e, V* r){
+                this->task_each_partition([nparts, rank, b, r, &rnode_bucket_offsets, &rnode_bucket_sizes, &compute](int p){
+                    Key* bb = b + rnode_bucket_offsets[rank * nparts + p];
+                    compute(p, bb, bb + rnode_bucket_sizes[rank * nparts + p], r + rnode_bucket_offsets[rank * nparts + p]);
+                });
+            },
+            results);
+
+        BL_BENCH_END(query, "a2av_query", input.size());
+
+#else
+        size_t recv_total = rnode_bucket_offsets.back() + rnode_bucket_sizes.back();
+
+        BL_BENCH_START(query);
+        Key* distributed = ::utils::mem::aligned_alloc<Key>(recv_total + batch_size);
+        V* dist_results = ::utils::mem::aligned_alloc<V>(recv_total + batch_size);
+        BL_BENCH_END(query, "alloc_intermediates", recv_total);
+
+        BL_BENCH_COLLECTIVE_START(query, "a2a", this->comm);
+        ::khmxx::distribute_permuted(input.data(), input.data() + input.size(),
+                send_counts, distributed, recv_counts, this->comm);
+        BL_BENCH_END(query, "a2av", input.size());
+
+        BL_BENCH_COLLECTIVE_START(query, "query", this->comm);
+        int comm_size = this->comm.size();
+        this->task_each_partition([comm_size, nparts, distributed, dist_results,
+                                   &rnode_bucket_offsets, &rnode_bucket_sizes, &compute](int p){
+            // no shuffling, to avoid 2 memcopies.
+            for (int i = 0; i < comm_size; ++i) {
+                Key* it = distributed + rnode_bucket_offsets[i * nparts + p];
+                compute(p, it, it + rnode_bucket_sizes[i * nparts + p], dist_results + rnode_bucket_offsets[i * nparts + p]);
+            }
+        });
+        BL_BENCH_END(query, "query", recv_total);
+
+        BL_BENCH_START(query);
+        ::utils::mem::aligned_free(distributed);
+        BL_BENCH_END(query, "cleanup", recv_total);
+
+        BL_BENCH_COLLECTIVE_START(query, "a2a2", this->comm);
+        ::khmxx::distribute_permuted(dist_results, dist_results + recv_total,
+                recv_counts, results, send_counts, this->comm);
+
+        ::utils::mem::aligned_free(dist_results);
+
+        BL_BENCH_END(query, "a2a2", input.size());
+
+#endif // non overlap
+
+        BL_BENCH_REPORT_MPI_NAMED(query, "hashmap:query_p_tasks", this->comm);
+      }
+
+
 
     public:
 
@@ -3058,45 +3737,27 @@ namespace hsc  // hybrid std container
 
       template <typename SERIALIZER>
       size_t serialize(unsigned char * out, SERIALIZER const & kvs) const {
-        size_t bytes = 0;
-
             size_t out_elem_size = sizeof(Key) + sizeof(T);
-            vector<size_t> offsets(omp_get_max_threads());
-
-            #pragma omp parallel reduction(+ : bytes)
-            {
-                int tid = omp_get_thread_num();
-                int tcnt = omp_get_num_threads();
+            int nparts = this->c.size();
 
-                // get the sizes
-                bytes = offsets[tid] = this->c[tid].size();
-                bytes *= out_elem_size;
-
-                // compute the offsets
-                #pragma omp barrier
-                #pragma omp single 
-                {
-                    size_t sum = 0;
-                    size_t curr = offsets[0];
-                    for (int i = 1; i < tcnt; ++i) {
-                        offsets[i-1] = sum;
-                        sum += curr;
-                        curr = offsets[i];
-                    }
-                    offsets[tcnt - 1] = sum;
-                }
+            // byte offset of each partition in the output.
+            vector<size_t> offsets(nparts + 1, 0);
+            for (int p = 0; p < nparts; ++p) {
+                offsets[p + 1] = offsets[p] + this->c[p].size() * out_elem_size;
+            }
 
+            #pragma omp parallel for schedule(dynamic, 1)
+            for (int p = 0; p < nparts; ++p) {
                 // get the starting position of the output
-                unsigned char * data = out + bytes;
+                unsigned char * data = out + offsets[p];
 
                 // now serialize
-                auto it_end = this->c[tid].cend();
-                for (auto it = this->c[tid].cbegin(); it != it_end; ++it) {
+                auto it_end = this->c[p].cend();
+                for (auto it = this->c[p].cbegin(); it != it_end; ++it) {
 				    data = kvs(*it, data);
 			    }
-
-            }  // end parallel section
-            return bytes;
+            }
+            return offsets[nparts];
 
       }
   };
@@ -23,7 +23,7 @@
  *  and implementations
  *  	https://github.com/hideo55/cpp-HyperLogLog and
  *  	https://github.com/dialtr/libcount.
- *  	not yet SIMD enabled like https://github.com/mindis/hll
+ *  	SIMD for batch update (AVX512CD), merge, and estimate, similar to https://github.com/mindis/hll
  *
  * Since this is for a hash table, several modifications were made that are appropriate for hash tables only.
  * 	1. incorporates 64 bit hash values, allowing bypass of large cardinality correction factor (based on hyperloglog++)
@@ -35,13 +35,23 @@
  *
  * the precision is a function of the number of buckets, 1.04/sqrt(m), where m = 2^precision.
  *
+ * sparse representation (hyperloglog++):  when constructed with sparse = true, the registers are not allocated.
+ * 	instead, a sorted list of 32 bit (index, rank) entries is kept, with index at a higher sparse precision (up to 25 bits).
+ * 	the estimate is linear counting over the 2^sparse_precision virtual registers.  when the list reaches the size of
+ * 	the dense registers, it is converted to dense registers, exactly as if the hash values had been inserted directly.
+ * 	this reduces memory for low cardinality sketches, e.g. per thread or per destination rank.
+ *
  * TODO:
  * [ ] distributed estimation of global count
  * [ ] distributed estimation of local count - average? NOT post distribution estimate per rank - distributed estimate is not needed then.
  * [ ] distributed estimation of local count from global hash bins - scan input, estimate local.
  * [X] exclude some leading bits (for use e.g. after data is distributed.)
  * [ ] exclude some trailing bits....
- * [ ] batch processing (to allow prefetching later.)  - not needed for now since 2^12 fits in cache well.
+ * [X] batch processing.  register index and rank computed in blocks, vectorized with AVX512CD lzcnt.  branchless apply.
+ * [X] SIMD merge (max_epu8) and estimate (register histogram, then harmonic sum over the ranks).
+ * [X] sparse representation for low cardinality (hyperloglog++).  per rank estimation sends sparse entries to peers with few hash values.
+ * [X] predicted growth across insert batches (hll_growth_predictor), for reserving ahead.
+ * [X] exact distinct count of small batches (count_distinct_hashvals), used instead of the estimate when cheap.
  *
  *  Created on: Mar 1, 2017
  *      Author: tpan
@@ -54,6 +64,11 @@
 #include <stdint.h>
 #include <iostream> // std::cout
 #include <cmath>
+#include <cstring>  // memset
+#include <algorithm>  // max
+#include <type_traits>
+
+#include <x86intrin.h>
 
 #include "kmerhash/mem_utils.hpp"
 
@@ -162,9 +177,10 @@ protected:
 				//(64U - (sizeof(decltype(::std::declval<Hash>().operator()(::std::declval<T>()))) << 3));   // if not, check Hash operator return type.
 		// 64 bit.  0xIIRRVVVVVV  // MSB: ignored bits II,  high bits: reg, RR.  low: values, VVVVVV
 		static constexpr uint8_t no_ignore_value_bits = hvt_size - precision;  // e.g. 0x00FFFFFF
+		static constexpr uint8_t max_rank = hvt_size + 1;  // leftmost_set_bit of 0.
 			// assumes that ignored part has be left shifted out, so no_ignore_value_bits is basically all bits except precision.
 
-		mutable ::std::vector<REG_T> registers;  // stores count of leading zeros
+		mutable ::std::vector<REG_T> registers;  // stores count of leading zeros.  empty if sparse.
 
 	mutable double amm;
 	mutable HVT lzc_mask;   // lowest bits set to 1 to prevent counting into that region.
@@ -172,6 +188,115 @@ protected:
 	mutable uint8_t ignored_msb; // MSB to ignore.
 	Hash h;
 
+	// sparse representation.  entry is (sparse index << 7) | rank, sorted, one entry per index.
+	static constexpr uint8_t max_sparse_precision = 25U;
+	static constexpr uint8_t sparse_rank_bits = 7U;
+	static constexpr uint32_t sparse_rank_mask = (0x1U << sparse_rank_bits) - 1U;
+	static constexpr size_t max_sparse_entries = nRegisters >> 2;  // 4 bytes per entry, same memory as dense registers.
+	static constexpr size_t sparse_buffer_size = (nRegisters >> 4) < 64U ? 64U : (nRegisters >> 4);
+
+	mutable ::std::vector<uint32_t> sparse_list;    // sorted by index.
+	mutable ::std::vector<uint32_t> sparse_buffer;  // unsorted, recent updates.
+	mutable uint8_t sparse_precision;
+	mutable HVT sparse_lzc_mask;
+
+	/// sparse precision:  up to 25 bits, leaving at least 1 bit for the rank, but not lower than the dense precision.
+	inline void set_sparse_precision() {
+		int sp = static_cast<int>(hvt_size) - static_cast<int>(ignored_msb) - 1;
+		sp = ::std::max(static_cast<int>(precision), ::std::min(static_cast<int>(max_sparse_precision), sp));
+		sparse_precision = static_cast<uint8_t>(sp);
+		sparse_lzc_mask = (~(static_cast<HVT>(0))) >> (hvt_size - sparse_precision - ignored_msb);
+	}
+
+	inline uint32_t sparse_encode(HVT const & no_ignore) const {
+		return (static_cast<uint32_t>(no_ignore >> (hvt_size - sparse_precision)) << sparse_rank_bits) |
+				static_cast<uint32_t>(leftmost_set_bit(static_cast<HVT>((no_ignore << sparse_precision) | sparse_lzc_mask)));
+	}
+
+	/// decode a sparse entry into the dense register id and rank.  same result as the dense update with the original hash value.
+	inline void sparse_decode(uint32_t const & entry, uint32_t & id, REG_T & rank) const {
+		uint8_t d = sparse_precision - precision;
+		uint32_t sid = entry >> sparse_rank_bits;
+		id = sid >> d;
+		uint32_t mid = sid & ((0x1U << d) - 1U);   // index bits below the dense precision.
+		rank = (mid == 0) ? (d + static_cast<REG_T>(entry & sparse_rank_mask)) :
+				static_cast<REG_T>(d - (32 - ::__builtin_clz(mid)) + 1);
+	}
+
+	/// sort the buffer and merge into the list, keeping the max rank per index.  convert to dense if too large.
+	void sparse_flush() const {
+		if (sparse_buffer.empty()) return;
+
+		::std::sort(sparse_buffer.begin(), sparse_buffer.end());
+		::std::vector<uint32_t> merged;
+		merged.reserve(sparse_list.size() + sparse_buffer.size());
+		::std::merge(sparse_list.begin(), sparse_list.end(), sparse_buffer.begin(), sparse_buffer.end(),
+				::std::back_inserter(merged));
+		sparse_buffer.clear();
+
+		// sorted, so same index entries are adjacent with the max rank last.
+		size_t j = 0;
+		for (size_t i = 1; i < merged.size(); ++i) {
+			if ((merged[i] >> sparse_rank_bits) != (merged[j] >> sparse_rank_bits)) ++j;
+			merged[j] = merged[i];
+		}
+		if (!merged.empty()) merged.resize(j + 1);
+		sparse_list.swap(merged);
+
+		if (sparse_list.size() > max_sparse_entries) to_dense();
+	}
+
+	/// convert the sparse list to dense registers.
+	void to_dense() const {
+		if (!registers.empty()) return;
+		registers.assign(nRegisters, static_cast<REG_T>(0));
+		sparse_merge_into(registers.data(), sparse_list.data(), sparse_list.size());
+		sparse_merge_into(registers.data(), sparse_buffer.data(), sparse_buffer.size());
+		::std::vector<uint32_t>().swap(sparse_list);
+		::std::vector<uint32_t>().swap(sparse_buffer);
+	}
+
+	inline void sparse_merge_into(REG_T* regs, uint32_t const * entries, size_t const & count) const {
+		uint32_t id;
+		REG_T rank;
+		for (size_t i = 0; i < count; ++i) {
+			sparse_decode(entries[i], id, rank);
+			if (rank > regs[id]) regs[id] = rank;
+		}
+	}
+
+	inline void sparse_update(HVT const * hashes, size_t const & count) {
+		for (size_t i = 0; i < count; ++i) {
+			sparse_buffer.emplace_back(sparse_encode(hashes[i] << ignored_msb));
+			if (sparse_buffer.size() >= sparse_buffer_size) {
+				sparse_flush();
+				if (!registers.empty()) {  // converted.  do the rest as dense.
+					internal_update(registers.data(), hashes + i + 1, count - i - 1);
+					return;
+				}
+			}
+		}
+	}
+
+	/// update this object's registers, sparse or dense.
+	inline void update_self(HVT const & hval) {
+		if (registers.empty()) sparse_update(&hval, 1);
+		else internal_update(this->registers.data(), hval << ignored_msb);
+	}
+	inline void update_self(HVT const * hashes, size_t const & count) {
+		if (registers.empty()) sparse_update(hashes, count);
+		else internal_update(this->registers.data(), hashes, count);
+	}
+
+	/// linear counting over the 2^sparse_precision virtual registers.
+	inline double sparse_estimate() const {
+		sparse_flush();
+		if (!registers.empty()) return internal_estimate(registers);
+
+		double m = static_cast<double>(0x1ULL << sparse_precision);
+		return m * ::std::log(m / (m - static_cast<double>(sparse_list.size())));
+	}
+
 
   inline void internal_update(REG_T* regs, HVT const & no_ignore) {
     // no_ignore has bits 0xRRVVVVVV00, not that the II bits had already been shifted away.
@@ -190,23 +315,141 @@ protected:
 		internal_update(regs.data(), no_ignore);
 	}
 
+#if defined(__AVX512F__) && defined(__AVX512CD__)
+	// register id and rank for a block of hash values, before ignored_msb shift.  scalar version for the remainder.
+	inline void compute_ids_ranks(HVT const * hashes, size_t const & count, uint32_t * ids, REG_T * ranks) const {
+		HVT no_ignore;
+		for (size_t j = 0; j < count; ++j) {
+			no_ignore = hashes[j] << ignored_msb;
+			ids[j] = no_ignore >> no_ignore_value_bits;
+			ranks[j] = leftmost_set_bit(static_cast<HVT>((no_ignore << precision) | lzc_mask));
+		}
+	}
+
+	// 64 bit hash values, 8 per vector.  lzc_mask is never 0, so the rank is lzcnt + 1.
+	template <typename H = HVT, typename ::std::enable_if<(sizeof(H) == 8), int>::type = 1>
+	inline size_t compute_ids_ranks_simd(HVT const * hashes, size_t const & count, uint32_t * ids, REG_T * ranks) const {
+		const __m128i shift = _mm_cvtsi32_si128(ignored_msb);
+		const __m512i mask = _mm512_set1_epi64(lzc_mask);
+		const __m512i one = _mm512_set1_epi64(1);
+		__m512i v;
+		size_t max = count & ~(static_cast<size_t>(7));
+		for (size_t j = 0; j < max; j += 8) {
+			v = _mm512_sll_epi64(_mm512_loadu_si512(reinterpret_cast<const void*>(hashes + j)), shift);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(ids + j), _mm512_cvtepi64_epi32(_mm512_srli_epi64(v, no_ignore_value_bits)));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(ranks + j), _mm512_cvtepi64_epi8(
+					_mm512_add_epi64(_mm512_lzcnt_epi64(_mm512_or_si512(_mm512_slli_epi64(v, precision), mask)), one)));
+		}
+		return max;
+	}
+	// 32 bit hash values, 16 per vector.
+	template <typename H = HVT, typename ::std::enable_if<(sizeof(H) == 4), int>::type = 1>
+	inline size_t compute_ids_ranks_simd(HVT const * hashes, size_t const & count, uint32_t * ids, REG_T * ranks) const {
+		const __m128i shift = _mm_cvtsi32_si128(ignored_msb);
+		const __m512i mask = _mm512_set1_epi32(lzc_mask);
+		const __m512i one = _mm512_set1_epi32(1);
+		__m512i v;
+		size_t max = count & ~(static_cast<size_t>(15));
+		for (size_t j = 0; j < max; j += 16) {
+			v = _mm512_sll_epi32(_mm512_loadu_si512(reinterpret_cast<const void*>(hashes + j)), shift);
+			_mm512_storeu_si512(reinterpret_cast<void*>(ids + j), _mm512_srli_epi32(v, no_ignore_value_bits));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(ranks + j), _mm512_cvtepi32_epi8(
+					_mm512_add_epi32(_mm512_lzcnt_epi32(_mm512_or_si512(_mm512_slli_epi32(v, precision), mask)), one)));
+		}
+		return max;
+	}
+#endif
+
+	/// batch update.  with AVX512CD, register ids and ranks are computed a block at a time with vplzcnt.
+	/// the apply is scalar, since the registers are bytes and cannot be gathered or scattered, and branchless
+	/// (load, max, store):  while the registers fill, the rank > register test is unpredictable, and the branch
+	/// costs up to 3x (benchmark_hll).  ids within a block may repeat, so the loads and stores stay in order.
+	/// AVX2 has no vector lzcnt.  an AVX2 path (lzcnt via float conversion, and a register gather that skips lanes
+	/// that do not increase) was measured slower than this scalar loop, so AVX2 builds use the scalar loop.
+	inline void internal_update(REG_T* regs, HVT const * hashes, size_t const & count) {
+#if defined(__AVX512F__) && defined(__AVX512CD__)
+		constexpr size_t block = 256;
+		uint32_t ids[block] __attribute__((aligned(64)));
+		REG_T ranks[block] __attribute__((aligned(64)));
+
+		size_t n, j;
+		REG_T curr;
+		for (size_t i = 0; i < count; i += block) {
+			n = ::std::min(block, count - i);
+			j = compute_ids_ranks_simd(hashes + i, n, ids, ranks);
+			compute_ids_ranks(hashes + i + j, n - j, ids + j, ranks + j);
+
+			for (j = 0; j < n; ++j) {
+				curr = regs[ids[j]];
+				regs[ids[j]] = (ranks[j] > curr) ? ranks[j] : curr;
+			}
+		}
+#else
+		HVT no_ignore, id;
+		REG_T rank, curr;
+		for (size_t i = 0; i < count; ++i) {
+			no_ignore = hashes[i] << ignored_msb;
+			id = no_ignore >> no_ignore_value_bits;
+			rank = leftmost_set_bit(static_cast<HVT>((no_ignore << precision) | lzc_mask));
+			curr = regs[id];
+			regs[id] = (rank > curr) ? rank : curr;
+		}
+#endif
+	}
+
   inline void internal_merge(REG_T * target, const REG_T* src) {
     // precisions identical, so don't need to check number of registers either.
 
     // iterate over both, merge, and update the zero count.
-    for (size_t i = 0; i < nRegisters; ++i) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; (i + 32) <= nRegisters; i += 32) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + i),
+    		  _mm256_max_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(target + i)),
+    				  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i))));
+    }
+#endif
+#if defined(__SSE2__)
+    for (; (i + 16) <= nRegisters; i += 16) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(target + i),
+    		  _mm_max_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(target + i)),
+    				  _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+    }
+#endif
+    for (; i < nRegisters; ++i) {
       target[i] = ::std::max(target[i], src[i]);
     }
   }
 
+  /// number of registers with each rank.  4 interleaved counters so that runs of equal ranks do not serialize on one counter.
+  inline void rank_histogram(const REG_T* regs, uint32_t* hist) const {
+    uint32_t counts[4][max_rank + 1];
+    memset(counts, 0, sizeof(counts));
+
+    size_t i = 0;
+    for (; i < nRegisters; i += 4) {  // nRegisters is a power of 2, >= 16
+      ++counts[0][regs[i]];
+      ++counts[1][regs[i + 1]];
+      ++counts[2][regs[i + 2]];
+      ++counts[3][regs[i + 3]];
+    }
+    for (i = 0; i <= max_rank; ++i) {
+      hist[i] = counts[0][i] + counts[1][i] + counts[2][i] + counts[3][i];
+    }
+  }
+
 
   double internal_estimate(const REG_T* regs) const {
         double est = static_cast<double>(0.0);
         double sum = static_cast<double>(0.0);
 
-        // compute the denominator of the harmonic mean
-        for (size_t i = 0; i < nRegisters; i++) {
-            sum += static_cast<double>(1.0) / static_cast<double>(1ULL << regs[i]);
+        // compute the denominator of the harmonic mean.  registers take at most max_rank + 1 distinct values,
+        // so sum 2^-rank over the histogram instead of over the registers.
+        uint32_t hist[max_rank + 1];
+        rank_histogram(regs, hist);
+        double inv_pow2 = static_cast<double>(1.0);
+        for (size_t r = 0; r <= max_rank; ++r, inv_pow2 *= static_cast<double>(0.5)) {
+            sum += static_cast<double>(hist[r]) * inv_pow2;
         }
         est = amm / sum; // E in the original paper
 //        std::cout << static_cast<size_t>(hvt_size) << " bit, mask " << lzc_mask << " ignored " << static_cast<size_t>(ignored_msb)
@@ -215,7 +458,7 @@ protected:
 //            << std::endl;
 
         if (est <= static_cast<double>(5ULL * (nRegisters >> 1ULL))) {  // 5m/2
-          size_t zeros = count_zeros(regs);
+          size_t zeros = hist[0];
           if (zeros > 0ULL) {
 //              std::cout << "linear_count: zero: " << zeros << " estimate " << est << " linear count " << linear_count(zeros) << std::endl;
         	  return linear_count(zeros);
@@ -265,11 +508,13 @@ public:
 
   	/// constructor.  ignore_leading does not count the leading bits.  ignore_trailing does not count the trailing bits.
   	  /// these are for use when the leading and/or trailing bits are identical in an input set.
-	hyperloglog64(uint8_t const & ignore_msb = 0) :
-		registers(nRegisters),
+	/// sparse starts with the sparse representation, for low cardinality sketches.
+	hyperloglog64(uint8_t const & ignore_msb = 0, bool const & sparse = false) :
+		registers(sparse ? 0 : nRegisters),
 		lzc_mask( (~(static_cast<HVT>(0))) >> (hvt_size - precision - ignore_msb - unused_msb)),
 		ignored_msb(ignore_msb + unused_msb)
 		{
+		set_sparse_precision();
 
         switch (precision) {
             case 4:
@@ -297,11 +542,15 @@ public:
 	}
 
 	hyperloglog64(hyperloglog64 const & other) :
-		registers(other.registers), amm(other.amm), lzc_mask(other.lzc_mask), ignored_msb(other.ignored_msb) {
+		registers(other.registers), amm(other.amm), lzc_mask(other.lzc_mask), ignored_msb(other.ignored_msb),
+		sparse_list(other.sparse_list), sparse_buffer(other.sparse_buffer),
+		sparse_precision(other.sparse_precision), sparse_lzc_mask(other.sparse_lzc_mask) {
 	}
 
 	hyperloglog64(hyperloglog64 && other) :
-		registers(std::move(other.registers)), amm(other.amm), lzc_mask(other.lzc_mask), ignored_msb(other.ignored_msb)  {
+		registers(std::move(other.registers)), amm(other.amm), lzc_mask(other.lzc_mask), ignored_msb(other.ignored_msb),
+		sparse_list(std::move(other.sparse_list)), sparse_buffer(std::move(other.sparse_buffer)),
+		sparse_precision(other.sparse_precision), sparse_lzc_mask(other.sparse_lzc_mask) {
 	}
 
 	hyperloglog64& operator=(hyperloglog64 const & other) {
@@ -309,6 +558,10 @@ public:
 		amm = other.amm;
 		ignored_msb = other.ignored_msb;
 		lzc_mask = other.lzc_mask;
+		sparse_list = other.sparse_list;
+		sparse_buffer = other.sparse_buffer;
+		sparse_precision = other.sparse_precision;
+		sparse_lzc_mask = other.sparse_lzc_mask;
 
 		return *this;
 	}
@@ -319,6 +572,10 @@ public:
 		//registers.swap(other.registers);
 		ignored_msb = other.ignored_msb;
 		lzc_mask = other.lzc_mask;
+		sparse_list.swap(other.sparse_list);
+		sparse_buffer.swap(other.sparse_buffer);
+		sparse_precision = other.sparse_precision;
+		sparse_lzc_mask = other.sparse_lzc_mask;
 
 		return *this;
 	}
@@ -329,31 +586,46 @@ public:
 		std::swap(amm, other.amm);
 		std::swap(ignored_msb, other.ignored_msb);
 		std::swap(lzc_mask, other.lzc_mask);
+		std::swap(sparse_list, other.sparse_list);
+		std::swap(sparse_buffer, other.sparse_buffer);
+		std::swap(sparse_precision, other.sparse_precision);
+		std::swap(sparse_lzc_mask, other.sparse_lzc_mask);
 	}
 
+	/// sparse entries depend on the ignored bits, so this should be called before any updates.
 	inline void set_ignored_msb(uint8_t const & ignore_msb) {
 		this->ignored_msb = ignore_msb + unused_msb;
+		set_sparse_precision();
 	}
 	inline uint8_t get_ignored_msb() {
 		return this->ignored_msb - unused_msb;
 	}
 	hyperloglog64 make_empty_copy() {
-		return hyperloglog64(this->ignored_msb - unused_msb);
+		return hyperloglog64(this->ignored_msb - unused_msb, this->is_sparse());
 	}
 	hyperloglog64 make_copy() {
 		return hyperloglog64(*this);
 	}
 
 
+	inline bool is_sparse() const {
+		return registers.empty();
+	}
+
+	/// switch to dense registers.  no-op if already dense.
+	inline void make_dense() {
+		to_dense();
+	}
+
 	inline HVT update(T const & val) {
     HVT hval = h(val);
-      internal_update(this->registers, hval << ignored_msb);
+      update_self(hval);
       return hval;
 	}
 
 	inline void update_via_hashval(HVT const & hval) {
 	//	::std::cout << ::std::hex << static_cast<uint64_t>(hval) << ", unused msb " << static_cast<size_t>(unused_msb) << " ignored msb  " << static_cast<size_t>(ignored_msb) << " val " <<  (static_cast<uint64_t>(hval) << ignored_msb) << std::endl;
-      internal_update(this->registers, hval << ignored_msb);
+      update_self(hval);
 	}
 
   //BATCH INTERFACE
@@ -366,7 +638,7 @@ public:
   -> decltype(::std::declval<H>()(::std::declval<TT>()), void()) {
 //	  printf("UPDATE_IMPL:  discard hash val, singleton\n");
     for (size_t i = 0; i < count; ++i) {
-      internal_update(this->registers, h(vals[i]) << ignored_msb);
+      update_self(h(vals[i]));
     }
   }
 
@@ -378,23 +650,19 @@ public:
     assert(((h.batch_size & (h.batch_size - 1)) == 0) && "batch size should be power of 2.");
 
     size_t max = count - (count & (h.batch_size - 1) );
-    size_t i = 0, j = 0;
+    size_t i = 0;
 
     HVT* buf = ::utils::mem::aligned_alloc<HVT>(h.batch_size);  // 64 byte alignment.
 
     for (; i < max; i += h.batch_size ) {
       h(vals + i, h.batch_size, buf);
 
-      for (j = 0; j < h.batch_size; ++j) {
-        internal_update(this->registers, buf[j] << ignored_msb);
-      }
+      update_self(buf, h.batch_size);
     }
     // last part, do linearly.
     if (count > max) {
 		h(vals + i, count - max, buf);
-		for (j = 0; j < (count - max); ++j) {
-		  internal_update(this->registers, buf[j] << ignored_msb);
-		}
+		update_self(buf, count - max);
     }
     free(buf);
   }
@@ -414,7 +682,7 @@ public:
     HVT hv;
     for (size_t i = 0; i < count; ++i) {
       hv = h(vals[i]); 
-      internal_update(this->registers, hv << ignored_msb);
+      update_self(hv);
       hvals[i] = hv;
     }
   }
@@ -427,20 +695,15 @@ public:
     assert(((h.batch_size & (h.batch_size - 1)) == 0) && "batch size should be power of 2.");
 
     size_t max = count - (count & (h.batch_size - 1) );
-    size_t i = 0, j = 0, jmax;
+    size_t i = 0;
 
     for (; i < max; i += h.batch_size ) {
       h(vals + i, h.batch_size, hvals + i);
-
-      for (j = i, jmax = i + h.batch_size; j < jmax; ++j) {
-        internal_update(this->registers, hvals[j] << ignored_msb);
-      }
     }
     // last part, do linearly.
     h(vals + i, count - max, hvals + i);
-    for (; i < count; ++i) {
-      internal_update(this->registers, hvals[i] << ignored_msb);
-    }
+
+    update_self(hvals, count);
   }
 
 
@@ -453,29 +716,52 @@ public:
   // =============== update when we already have hash values.
   inline void update_via_hashval(HVT const * hashes, size_t const & count) {
 //  	std::cout << "h0: " << hashes[0] << std::endl;
-    for (size_t i = 0; i < count; ++i) {
-      internal_update(this->registers, hashes[i] << ignored_msb);
-    }
+    update_self(hashes, count);
   }
 
 
 
 	double estimate() const {
+	  if (this->is_sparse()) return sparse_estimate();
 	  return internal_estimate(this->registers);
 	}
 
+	/// merge.  both should have the same ignored bits.  result is sparse only if both are sparse.
 	void merge(hyperloglog64 const & other) {
+	  if (other.is_sparse()) {
+		  if (this->is_sparse()) {
+			  other.sparse_flush();
+			  if (other.is_sparse()) {
+				  sparse_buffer.insert(sparse_buffer.end(), other.sparse_list.begin(), other.sparse_list.end());
+				  sparse_flush();
+				  return;
+			  }
+			  // other converted to dense during flush.
+		  } else {
+			  sparse_merge_into(this->registers.data(), other.sparse_list.data(), other.sparse_list.size());
+			  sparse_merge_into(this->registers.data(), other.sparse_buffer.data(), other.sparse_buffer.size());
+			  return;
+		  }
+	  }
+	  to_dense();
 	  internal_merge(this->registers.data(), other.registers.data());
 	}
 
+	/// clear.  keeps the current representation.
 	void clear() {
-		registers.assign(nRegisters, static_cast<REG_T>(0));
+		if (this->is_sparse()) {
+			sparse_list.clear();
+			sparse_buffer.clear();
+		} else {
+			registers.assign(nRegisters, static_cast<REG_T>(0));
+		}
 	}
 
 
 #ifdef USE_MPI
 	// distributed merge, for estimating globally
 	::std::vector<REG_T> merge_distributed(::mxx::comm const & comm) const {
+	  to_dense();   // allreduce requires same size registers on all ranks.
 	  return ::mxx::allreduce(registers, ::mxx::max<REG_T>(), comm);
 	}
 
@@ -499,9 +785,7 @@ public:
     ::std::vector<REG_T> regs(nRegisters, static_cast<REG_T>(0));
 
     // perform updates on the registers.
-    for (; first != last; ++first) {
-      internal_update(regs, *first << ignored_msb);
-    }
+    internal_update(regs.data(), first, ::std::distance(first, last));
 
     // now merge distributed and estimate
     return internal_estimate(regs);
@@ -515,9 +799,7 @@ public:
     ::std::vector<REG_T> regs(nRegisters, static_cast<REG_T>(0));
 
     // perform updates on the registers.
-    for (; first != last; ++first) {
-      internal_update(regs, *first << ignored_msb);
-    }
+    internal_update(regs.data(), first, ::std::distance(first, last));
 
     // now merge distributed and estimate
     return internal_estimate(::mxx::allreduce(regs, ::mxx::max<REG_T>(), comm));
@@ -535,6 +817,45 @@ public:
 
 
 
+  // per peer message for update_per_rank_by_hashval.  a peer with few hash values is sent 4 byte
+  // (register id << 8 | rank) entries instead of the full registers.  format is determined by the hash value count.
+  inline size_t peer_msg_bytes(size_t const & count) const {
+	  return ((count * sizeof(uint32_t)) < nRegisters) ? (count * sizeof(uint32_t)) : nRegisters;
+  }
+
+  /// fill a peer message buffer of nRegisters bytes.  returns the message size in bytes.
+  inline size_t pack_for_peer(REG_T* buf, HVT const * hashes, size_t const & count) {
+	  size_t bytes = peer_msg_bytes(count);
+	  if (bytes < nRegisters) {
+		  uint32_t* entries = reinterpret_cast<uint32_t*>(buf);
+		  HVT no_ignore;
+		  for (size_t i = 0; i < count; ++i) {
+			  no_ignore = hashes[i] << ignored_msb;
+			  entries[i] = (static_cast<uint32_t>(no_ignore >> no_ignore_value_bits) << 8) |
+					  static_cast<uint32_t>(leftmost_set_bit(static_cast<HVT>((no_ignore << precision) | lzc_mask)));
+		  }
+	  } else {
+		  memset(buf, 0, nRegisters * sizeof(REG_T));
+		  internal_update(buf, hashes, count);
+	  }
+	  return bytes;
+  }
+
+  inline void merge_from_peer(REG_T* accumulating, REG_T const * buf, size_t const & count) {
+	  if (peer_msg_bytes(count) < nRegisters) {
+		  uint32_t const * entries = reinterpret_cast<uint32_t const *>(buf);
+		  uint32_t id;
+		  REG_T rank;
+		  for (size_t i = 0; i < count; ++i) {
+			  id = entries[i] >> 8;
+			  rank = static_cast<REG_T>(entries[i] & 0xFF);
+			  if (rank > accumulating[id]) accumulating[id] = rank;
+		  }
+	  } else {
+		  internal_merge(accumulating, buf);
+	  }
+  }
+
   // distributed estimate.  exact solution, performed bucket by bucket.
   // input: source hash value array, or input array, and bucket send counts.
   // internal:  2^precision buckets
@@ -561,9 +882,7 @@ public:
     // if there is comm size is 1.
     if (comm.size() == 1) {
       // perform updates on the registers.
-      for (; first != last; ++first) {
-        internal_update(accumulating, *first << ignored_msb);
-      }
+      internal_update(accumulating, first, input_size);
       return;
     }
 
@@ -575,7 +894,11 @@ public:
       send_displs.emplace_back(send_displs.back() + send_counts[i]);
     }
 
-    // setup the temporary storage.  double buffered.
+    // number of hash values each peer has for this rank, which determines the message format.
+    std::vector<SIZE> recv_counts(comm.size());
+    mxx::all2all(send_counts.data(), 1, recv_counts.data(), comm);
+
+    // setup the temporary storage.  double buffered.  a sparse message fits in the same space.
     // allocate recv
     REG_T* buffers = ::utils::mem::aligned_alloc<REG_T>(nRegisters * 4ULL);
     REG_T* updating = buffers;
@@ -595,11 +918,7 @@ public:
     bool is_pow2 = ( comm_size & (comm_size-1)) == 0;
 
     //===  for prev_peer:  first compute self estimate.
-    auto max = first + send_displs[prev_peer + 1];
-    memset(recved, 0, nRegisters * sizeof(REG_T));
-    for (auto it = first + send_displs[prev_peer]; it != max; ++it) {
-      internal_update(recved, *it << ignored_msb);
-    }
+    pack_for_peer(recved, first + send_displs[prev_peer], send_counts[prev_peer]);
 
     //=== for curr_peer:
     if ( is_pow2 )  {  // power of 2
@@ -608,11 +927,8 @@ public:
       curr_peer = (comm_rank + 1) % comm_size;
     }
     // compute the array
-    max = first + send_displs[curr_peer + 1];
-    memset(sending, 0, nRegisters * sizeof(REG_T));
-    for (auto it = first + send_displs[curr_peer]; it != max; ++it) {
-      internal_update(sending,  *it << ignored_msb);
-    }
+    size_t sending_bytes = pack_for_peer(sending, first + send_displs[curr_peer], send_counts[curr_peer]);
+    size_t updating_bytes;
 
     size_t step;
 
@@ -624,9 +940,9 @@ public:
       //====  first setup send and recv.
 
       // send and recv next.  post recv first.
-      MPI_Irecv(recving, nRegisters, dt.type(),
+      MPI_Irecv(recving, peer_msg_bytes(recv_counts[curr_peer]), dt.type(),
                 curr_peer, ialltoall_reduce_tag, comm, &reqs[0] );
-      MPI_Isend(sending, nRegisters, dt.type(),
+      MPI_Isend(sending, sending_bytes, dt.type(),
                 curr_peer, ialltoall_reduce_tag, comm, &reqs[1] );
 
       // try using test to kick start the send?
@@ -641,14 +957,10 @@ public:
       } else {
         next_peer = (comm_rank + step) % comm_size;
       }
-      memset(updating, 0, nRegisters * sizeof(REG_T));
-      max = first + send_displs[next_peer + 1];
-      for (auto it = first + send_displs[next_peer]; it != max; ++it) {
-        internal_update(updating,  *it << ignored_msb);
-      }
+      updating_bytes = pack_for_peer(updating, first + send_displs[next_peer], send_counts[next_peer]);
 
       //=== and accumulate
-      internal_merge(accumulating, recved);
+      merge_from_peer(accumulating, recved, recv_counts[prev_peer]);
       //std::cout << "  per rank estimate for step " << (step - 2) << " peer " << prev_peer << ": " << internal_estimate(accumulating) << std::endl;
 
       // wait for both to complete
@@ -656,6 +968,7 @@ public:
 
       // now swap.
       std::swap(updating, sending);
+      sending_bytes = updating_bytes;
       std::swap(recving, recved);
 
       prev_peer = curr_peer;
@@ -665,9 +978,9 @@ public:
 
     //=== process curr_peer
     // send and recv next.  post recv first.
-    MPI_Irecv(recving, nRegisters, dt.type(),
+    MPI_Irecv(recving, peer_msg_bytes(recv_counts[curr_peer]), dt.type(),
               curr_peer, ialltoall_reduce_tag, comm, &reqs[0] );
-    MPI_Isend(sending, nRegisters, dt.type(),
+    MPI_Isend(sending, sending_bytes, dt.type(),
               curr_peer, ialltoall_reduce_tag, comm, &reqs[1] );
 
     // try using test to kick start the send?
@@ -677,7 +990,7 @@ public:
     //=== no more new updates
 
     //=== and accumulate
-    internal_merge(accumulating, recved);
+    merge_from_peer(accumulating, recved, recv_counts[prev_peer]);
     //std::cout << "  per rank estimate for step " << (comm_size - 2) << " peer " << prev_peer << ": " << internal_estimate(accumulating) << std::endl;
 
     // wait for both to complete
@@ -688,7 +1001,7 @@ public:
     prev_peer = curr_peer;
 
     //=== last accumulate, for prev_peer
-    internal_merge(accumulating, recved);
+    merge_from_peer(accumulating, recved, recv_counts[prev_peer]);
     //std::cout << "  per rank estimate for step " << (comm_size - 1) << " peer " << prev_peer << ": " << internal_estimate(accumulating) << std::endl;
 
 
@@ -700,6 +1013,7 @@ public:
   template <typename SIZE>
   void update_per_rank_by_hashval(HVT* first, HVT* last, std::vector<SIZE> const & send_counts,
                                       ::mxx::comm const & comm) {
+    to_dense();
     update_per_rank_by_hashval_internal(this->registers.data(), first, last, send_counts, comm);
   }
 
@@ -721,9 +1035,7 @@ public:
     ::std::vector<REG_T> regs(nRegisters, static_cast<REG_T>(0));
 
     // perform updates on the registers.
-    for (; first != last; ++first) {
-      internal_update(regs, *first << ignored_msb);
-    }
+    internal_update(regs.data(), first, ::std::distance(first, last));
 
     // now compute send counts.  each rank ends up with 2^precision number of entries.
     size_t count = 0;
@@ -760,7 +1072,100 @@ constexpr uint8_t hyperloglog64<T, Hash, precision>::no_ignore_value_bits;
 template <typename T, typename Hash, uint8_t precision>
 constexpr uint8_t hyperloglog64<T, Hash, precision>::unused_msb;
 template <typename T, typename Hash, uint8_t precision>
+constexpr uint8_t hyperloglog64<T, Hash, precision>::max_rank;
+template <typename T, typename Hash, uint8_t precision>
 constexpr double hyperloglog64<T, Hash, precision>::est_error_rate;
+template <typename T, typename Hash, uint8_t precision>
+constexpr uint8_t hyperloglog64<T, Hash, precision>::max_sparse_precision;
+template <typename T, typename Hash, uint8_t precision>
+constexpr uint8_t hyperloglog64<T, Hash, precision>::sparse_rank_bits;
+template <typename T, typename Hash, uint8_t precision>
+constexpr uint32_t hyperloglog64<T, Hash, precision>::sparse_rank_mask;
+template <typename T, typename Hash, uint8_t precision>
+constexpr size_t hyperloglog64<T, Hash, precision>::max_sparse_entries;
+template <typename T, typename Hash, uint8_t precision>
+constexpr size_t hyperloglog64<T, Hash, precision>::sparse_buffer_size;
+
+
+/// hyperloglog precision from a map's parameters:  MapParams<K>::hll_precision if defined, else 12.
+/// 12 bits is 4KB of registers with 1.6% error.  lower precision reduces memory and per rank estimation traffic.
+template <typename MP, typename = void>
+struct hll_precision_param : public ::std::integral_constant<uint8_t, 12U> {};
+template <typename MP>
+struct hll_precision_param<MP, typename ::std::enable_if<(MP::hll_precision > 0)>::type> :
+	public ::std::integral_constant<uint8_t, MP::hll_precision> {};
+
+/// sparse hyperloglog from a map's parameters:  MapParams<K>::hll_sparse if defined, else false.
+template <typename MP, typename = void>
+struct hll_sparse_param : public ::std::false_type {};
+template <typename MP>
+struct hll_sparse_param<MP, typename ::std::enable_if<MP::hll_sparse>::type> : public ::std::true_type {};
+
+
+/// predicts the cardinality after the next insert batch from a running (cumulative) estimate, assuming
+/// the next batch adds as many new distinct elements as the last one did.  reserving for the prediction
+/// avoids repeated upsizing during multi-batch ingestion.  the first batch is not extrapolated.
+class hll_growth_predictor {
+protected:
+	double last_est;
+	size_t batches;
+	double lookahead;  // number of batches to reserve ahead.
+
+public:
+	hll_growth_predictor(double const & _lookahead = 1.0) : last_est(0.0), batches(0), lookahead(_lookahead) {}
+
+	/// record the running estimate for the current batch, and return the predicted estimate.
+	inline double predict(double const & est) {
+		double growth = (batches == 0) ? 0.0 : ::std::max(0.0, est - last_est);
+		last_est = est;
+		++batches;
+		return est + growth * lookahead;
+	}
+
+	inline void set_lookahead(double const & _lookahead) {
+		lookahead = _lookahead;
+	}
+
+	inline void reset() {
+		last_est = 0.0;
+		batches = 0;
+	}
+};
+
+
+/**
+ * exact distinct count of a batch of hash values, for batches small enough that a linear probing set is cheaper
+ * than the hll's error.  equal hash values are counted once, so the count is exact up to hash collisions.
+ * the set is at most half full.  0 marks an empty slot, so the hash value 0 is tracked separately.
+ */
+template <typename HVT>
+size_t count_distinct_hashvals(HVT const * hvals, size_t const & count) {
+	if (count == 0) return 0;
+
+	uint8_t bits = 4;
+	while ((0x1ULL << bits) < (count << 1)) ++bits;
+	size_t const mask = (0x1ULL << bits) - 1;
+	uint8_t const shift = 64 - bits;
+
+	::std::vector<HVT> set(mask + 1, static_cast<HVT>(0));
+	size_t distinct = 0;
+	bool has_zero = false;
+	size_t pos;
+	for (size_t i = 0; i < count; ++i) {
+		if (hvals[i] == 0) {
+			has_zero = true;
+			continue;
+		}
+		// take the high bits of a multiplicative hash, as the low bits of hvals are the table's bucket ids.
+		pos = (static_cast<uint64_t>(hvals[i]) * 0x9E3779B97F4A7C15ULL) >> shift;
+		while ((set[pos] != 0) && (set[pos] != hvals[i])) pos = (pos + 1) & mask;
+		if (set[pos] == 0) {
+			set[pos] = hvals[i];
+			++distinct;
+		}
+	}
+	return distinct + (has_zero ? 1 : 0);
+}
 
 
 
@@ -28,6 +28,8 @@
 
 #include <utility>
 #include <algorithm>
+#include <limits>
+#include <functional>  // plus
 #include <mxx/datatypes.hpp>
 #include <mxx/comm.hpp>
 #include <mxx/collective.hpp>
@@ -35,6 +37,7 @@
 
 #include "utils/benchmark_utils.hpp"
 #include "utils/function_traits.hpp"
+#include "kmerhash/comm_trace.hpp"
 
 #include "containers/fsc_container_utils.hpp"
 
@@ -43,6 +46,8 @@
 #endif
 
 #include <stdlib.h>  // for posix_memalign.
+#include <cstring>   // memcpy
+#include <stdexcept>
 
 #if defined(ENABLE_PREFETCH)
 #include "xmmintrin.h" // prefetch related.
@@ -524,14 +529,15 @@ namespace khmxx
 
     // writes into separate array of results..  similar to bucketing_impl
     // TODO: [X] permute hash values too.
-    template <uint8_t prefetch_dist = 8, typename IT, typename ASSIGN_TYPE, typename OT,
+    // HT is the hash value type, 32 or 64 bit (see hash_width_policy), so 32 bit hashes are not widened.
+    template <uint8_t prefetch_dist = 8, typename IT, typename HT, typename ASSIGN_TYPE, typename OT,
     typename ::std::enable_if<::std::is_same<typename ::std::iterator_traits<OT>::iterator_category,
                                              ::std::random_access_iterator_tag >::value, int>::type = 1  >
     void
-    hashed_permute(IT _begin, IT _end, size_t* hash_begin,
+    hashed_permute(IT _begin, IT _end, HT* hash_begin,
                            ASSIGN_TYPE const num_buckets,
                            std::vector<size_t> & bucket_sizes,
-                           OT results, size_t* permuted_hash) {
+                           OT results, HT* permuted_hash) {
 
       static_assert(::std::is_integral<ASSIGN_TYPE>::value, "ASSIGN_TYPE should be integral, preferably unsigned");
       static_assert((prefetch_dist & (prefetch_dist - 1)) == 0,
@@ -574,7 +580,7 @@ namespace khmxx
         // [1st pass]: compute bucket counts and input2bucket assignment.
         // store input2bucket assignment in i2o temporarily.
         ASSIGN_TYPE p;
-        size_t* hit = hash_begin;
+        HT* hit = hash_begin;
         if (pow2_buckets) {
 			for (auto it = _begin; it != _end; ++it, ++hit) {
 				p = (*hit) & bucket_mask;
@@ -617,7 +623,7 @@ namespace khmxx
         std::vector<size_t> offsets(prefetch_dist, static_cast<size_t>(0));
 
         hit = hash_begin;
-        size_t* heit = hit;
+        HT* heit = hit;
         std::advance(heit, ::std::min(input_size, static_cast<size_t>(prefetch_dist)));
         size_t i = 0;
         size_t bid;
@@ -633,7 +639,7 @@ namespace khmxx
 
 			// now start doing the work from prefetch_dist to end.
 			IT it = _begin;
-			size_t *hit2 = hash_begin;
+			HT *hit2 = hash_begin;
 			i = 0;
 			heit = hash_begin + input_size;
 			for (; hit != heit; ++it, ++hit, ++hit2) {
@@ -670,7 +676,7 @@ namespace khmxx
 
             // now start doing the work from prefetch_dist to end.
             IT it = _begin;
-            size_t *hit2 = hash_begin;
+            HT *hit2 = hash_begin;
             i = 0;
             heit = hash_begin + input_size;
             for (; hit != heit; ++it, ++hit, ++hit2) {
@@ -3401,14 +3407,19 @@ namespace khmxx
     //             query process is transform, assign, permute, communicate, perform op, communicate (unpermute?)
     // [X] ialltoallv_and_modify.  use pairwise exchange.  for variable number of entries.  input bucketed.  overlap comm and compute
   	// [ ] ialltoall_and_modify.  use pairwise exchange.  for equal number of entries.  input bucketed.  overlap comm and compute
-    // [ ] batched_ialltoallv_modify.  use ialltoallv if available.  input unbuckted, so both bucketing AND computation can be overlapped with comm.
+    // [X] batched_ialltoallv_modify.  use ialltoallv if available.  input unbuckted, so both bucketing AND computation can be overlapped with comm.
     // [X] ialltoallv_and_query_one_on_one.  use pairwise exchange.  for variable number of entries.  1 response per request. input bucketed.  overlap query comm, compute, and response comm
-    // [ ] ialltoallv_and_query.  use pairwise exchange.  for variable number of entries.  have responses. input bucketed.  overlap query comm, compute, and response comm
-    // [ ] ialltoall_and_query_one_on_one.  use pairwise exchange.  for equal number of entries.  1 response per request. input bucketed.  overlap query comm, compute, and response comm
+    // [X] ialltoallv_and_query.  use pairwise exchange.  for variable number of entries.  have responses. input bucketed.  overlap query comm, compute, and response comm
+    // [X] ialltoall_and_query_one_on_one.  use pairwise exchange.  for equal number of entries.  1 response per request. input bucketed.  overlap query comm, compute, and response comm.  padded from variable counts, when balanced, by ialltoallv_and_query_one_to_one_adaptive.
     // [ ] ialltoall_and_query.  use pairwise exchange.  for equal number of entries.  have responses. input bucketed.  overlap query comm, compute, and response comm
     // [ ] batched_ialltoallv_query_one_on_one.  use ialltoallv if available.  input unbuckted, so both bucketing AND computation can be overlapped with comm.
     // [ ] batched_ialltoallv_query.  use ialltoallv if available.  input unbuckted, so both bucketing AND computation can be overlapped with comm.
-    // NOTE: currently, we support one-to-one query and response mapping, one-to-zero/one mapping, and not yet one-to-(0..n) mapping.
+    // [X] ialltoallv_and_modify_hierarchical, ialltoallv_and_query_one_to_one_hierarchical.  node-aware 2 level exchange, aggregate between nodes then scatter in node.
+    // [X] ialltoallv_and_modify_compressed.  sort, delta code, and optionally lz4 each block in flight.  switched on when the codec is faster than the exposed comm.
+    // [X] per rank event trace of post, inflight, wait, and compute intervals (KHMXX_COMM_TRACE, see comm_trace.hpp).  for measuring overlap.
+    // [X] query_session.  persistent requests on preallocated per-peer blocks for repeated one-to-one query batches.  no per call count exchange or allocation.
+    // [X] rma_mailbox.  one-sided puts into per-source ring buffers, drained by the target.  asynchronous modify, synchronized once at the end.
+    // NOTE: we support one-to-one query and response mapping, one-to-zero/one mapping, and one-to-(0..n) mapping via ialltoallv_and_query.
     // NOTE: batch mode implies that input is part of larger input, and that it is not permuted (e.g. reading in input in batches).  In this case, we need to expose the request objects,
     //   so that consecutive batches can be overlapped.
     // NOTE: insert will become a dominant component once communication is overlapped.  so important to make it fast, and HLL is important.  need to figure out a way
@@ -3430,7 +3441,8 @@ namespace khmxx
   	//			 3. get smallest recv block size, do those using isend/irecv with fixed/same buffer.  the extras collect into one buffer and do together.
 
     // 	Profiling with Fvesca shows that some buckets get a lot more entries, up to 30% difference between min and max count in send buckets.
-    // to address this, we can include a balance step
+    // to address this, we can include a balance step.  the distributed map does this in balance_partition:  a sampled hash
+    // histogram assigns virtual buckets to ranks, replacing hash modulo comm size.
     template <typename IT, typename SIZE, typename OP,
         typename ::std::enable_if<::std::is_same<typename ::std::iterator_traits<IT>::iterator_category,
                                                  ::std::random_access_iterator_tag >::value, int>::type = 1 >
@@ -3441,6 +3453,7 @@ namespace khmxx
 //								   size_t batch_size = 1) {
 
       BL_BENCH_INIT(idist);
+      KHMXX_TRACE_CALL("ialltoallv_and_modify");
       int comm_size = _comm.size();
       int comm_rank = _comm.rank();
 
@@ -3526,7 +3539,9 @@ namespace khmxx
       std::vector<MPI_Request> reqs(comm_size - 1);
 
       // process self data
+      KHMXX_TRACE_START(t_self);
       compute(comm_rank, &(*(permuted + send_displs[comm_rank])), &(*(permuted + send_displs[comm_rank] + send_counts[comm_rank])));
+      KHMXX_TRACE_END(t_self, "ialltoallv_and_modify", compute, comm_rank, send_counts[comm_rank] * sizeof(V));
 
       bool is_pow2 = ( comm_size & (comm_size-1)) == 0;
       int step;
@@ -3540,8 +3555,10 @@ namespace khmxx
             curr_peer = comm_rank ^ step;
 
             // issend all, avoids buffering.
+            KHMXX_TRACE_START(t_post);
             MPI_Issend(&(*(permuted + send_displs[curr_peer])), send_counts[curr_peer], dt.type(),
             			curr_peer, ialltoallv_tag, _comm, &reqs[step - 1] );
+            KHMXX_TRACE_END(t_post, "ialltoallv_and_modify", post, curr_peer, send_counts[curr_peer] * sizeof(V));
           }
       } else {
           for (step = 1; step < comm_size; ++step) {
@@ -3551,8 +3568,10 @@ namespace khmxx
               curr_peer = (comm_rank + comm_size - step) % comm_size;
 
             // issend all, avoids buffering.
+            KHMXX_TRACE_START(t_post);
             MPI_Issend(&(*(permuted + send_displs[curr_peer])), send_counts[curr_peer], dt.type(),
             			curr_peer, ialltoallv_tag, _comm, &reqs[step - 1] );
+            KHMXX_TRACE_END(t_post, "ialltoallv_and_modify", post, curr_peer, send_counts[curr_peer] * sizeof(V));
           }
 
       }
@@ -3592,9 +3611,11 @@ namespace khmxx
 //        BL_BENCH_START(idist_loop);
 
         // send and recv next.  post recv first.
+        KHMXX_TRACE_START(t_flight);
         if (step < comm_size) {
         	MPI_Irecv(recving, recv_counts[curr_peer], dt.type(),
                   curr_peer, ialltoallv_tag, _comm, &req );
+        	KHMXX_TRACE_END(t_flight, "ialltoallv_and_modify", post_recv, curr_peer, recv_counts[curr_peer] * sizeof(V));
         }
 
         BL_BENCH_LOOP_PAUSE(idist, 0);
@@ -3604,7 +3625,9 @@ namespace khmxx
 //        BL_BENCH_START(idist_loop);
         // process previously received. note: delayed by 1 cycle.
         if (step2 > 0) {
+        	KHMXX_TRACE_START(t_compute);
         	compute(prev_peer, computing, computing + recv_counts[prev_peer]);
+        	KHMXX_TRACE_END(t_compute, "ialltoallv_and_modify", compute, prev_peer, recv_counts[prev_peer] * sizeof(V));
   		    total += recv_counts[prev_peer];
         }
 
@@ -3616,7 +3639,10 @@ namespace khmxx
 //        BL_BENCH_START(idist_loop);
         // now wait for irecv from this iteration to complete, in order to continue.
         if (step < comm_size) {
+        	KHMXX_TRACE_START(t_wait);
         	MPI_Wait(&req, MPI_STATUS_IGNORE);
+        	KHMXX_TRACE_END(t_wait, "ialltoallv_and_modify", wait, curr_peer, 0);
+        	KHMXX_TRACE_END(t_flight, "ialltoallv_and_modify", inflight, curr_peer, recv_counts[curr_peer] * sizeof(V));
         }
         BL_BENCH_LOOP_PAUSE(idist, 2);
 //        BL_BENCH_END(idist_loop, "wait", prev_peer);
@@ -3635,7 +3661,9 @@ namespace khmxx
 
 
       BL_BENCH_START(idist);
+      KHMXX_TRACE_START(t_sends);
       MPI_Waitall(comm_size - 1, reqs.data(), MPI_STATUSES_IGNORE);
+      KHMXX_TRACE_END(t_sends, "ialltoallv_and_modify", wait, -1, 0);
 
       free(buffers);
       BL_BENCH_END(idist, "waitall_cleanup", buffer_max);
@@ -4407,6 +4435,7 @@ namespace khmxx
                                           ::mxx::comm const &_comm) {
 
       BL_BENCH_INIT(idist);
+      KHMXX_TRACE_CALL("ialltoallv_and_query_one_to_one");
 
       int comm_size = _comm.size();
       int comm_rank = _comm.rank();
@@ -4527,12 +4556,16 @@ namespace khmxx
         }
 
         // irecv all
+        KHMXX_TRACE_START(t_post);
         MPI_Irecv(&(*(result + send_displs[curr_peer])), send_counts[curr_peer], r_dt.type(),
                   curr_peer, resp_tag, _comm, &r_reqs[step - 1] );
+        KHMXX_TRACE_END(t_post, "ialltoallv_and_query_one_to_one", post_recv, curr_peer, send_counts[curr_peer] * sizeof(U));
 
         // issend all, avoids buffering (via ssend).
+        KHMXX_TRACE_START(t_send);
         MPI_Isend(&(*(permuted + send_displs[curr_peer])), send_counts[curr_peer], q_dt.type(),
                   curr_peer, query_tag, _comm, &q_reqs[step - 1] );
+        KHMXX_TRACE_END(t_send, "ialltoallv_and_query_one_to_one", post, curr_peer, send_counts[curr_peer] * sizeof(V));
 
 
       }
@@ -4549,9 +4582,11 @@ namespace khmxx
       // compute for self rank.
         BL_BENCH_LOOP_RESUME(idist, 1);
 
+      KHMXX_TRACE_START(t_self);
       compute(comm_rank, &(*(permuted + send_displs[comm_rank])),
               &(*(permuted + send_displs[comm_rank ] + send_counts[comm_rank])),
               &(*(result + send_displs[comm_rank])));
+      KHMXX_TRACE_END(t_self, "ialltoallv_and_query_one_to_one", compute, comm_rank, send_counts[comm_rank] * sizeof(V));
         BL_BENCH_LOOP_PAUSE(idist, 1);
 
 
@@ -4574,10 +4609,12 @@ namespace khmxx
         BL_BENCH_LOOP_RESUME(idist, 0);
 
         // 2nd stage of pipeline
+        KHMXX_TRACE_START(t_flight);
         if (step < comm_size) {
           // send and recv next.  post recv first.
           MPI_Irecv(recving, recv_counts[curr_peer], q_dt.type(),
                     curr_peer, query_tag, _comm, &q_req );
+          KHMXX_TRACE_END(t_flight, "ialltoallv_and_query_one_to_one", post_recv, curr_peer, recv_counts[curr_peer] * sizeof(V));
           // if (comm_rank == 0) std::cout << "step " << step << " rank " << comm_rank << " recv Q from " << curr_peer << std::endl;
         }
         BL_BENCH_LOOP_PAUSE(idist, 0);
@@ -4589,8 +4626,10 @@ namespace khmxx
         // 4rd stage of pipeline
         if (step3 > 0) {
           // send results.  use rsend to avoid buffering
+          KHMXX_TRACE_START(t_post);
           MPI_Irsend(sending, recv_counts[prev_peer2], r_dt.type(),
                      prev_peer2, resp_tag, _comm, &r_req );
+          KHMXX_TRACE_END(t_post, "ialltoallv_and_query_one_to_one", post, prev_peer2, recv_counts[prev_peer2] * sizeof(U));
           // if (comm_rank == 0) std::cout << "step " << step << " rank " << comm_rank << " send R to " << prev_peer2 << std::endl;
         }
         BL_BENCH_LOOP_PAUSE(idist, 2);
@@ -4600,7 +4639,9 @@ namespace khmxx
 
         // process previously received.
         if ((step2 > 0) && (step2 < comm_size)) {
+			KHMXX_TRACE_START(t_compute);
 			compute(prev_peer, computing, computing + recv_counts[prev_peer], storing);
+			KHMXX_TRACE_END(t_compute, "ialltoallv_and_query_one_to_one", compute, prev_peer, recv_counts[prev_peer] * sizeof(V));
 			// if (comm_rank == 0) std::cout << "step " << step << " rank " << comm_rank << " compute for " << prev_peer << std::endl;
 			total += recv_counts[prev_peer];
         }
@@ -4611,7 +4652,10 @@ namespace khmxx
 
         // now wait for irecv from this iteration to complete, in order to continue.
         if (step < comm_size) {
+        	KHMXX_TRACE_START(t_wait);
         	MPI_Wait(&q_req, MPI_STATUS_IGNORE);
+        	KHMXX_TRACE_END(t_wait, "ialltoallv_and_query_one_to_one", wait, curr_peer, 0);
+        	KHMXX_TRACE_END(t_flight, "ialltoallv_and_query_one_to_one", inflight, curr_peer, recv_counts[curr_peer] * sizeof(V));
         	// if (comm_rank == 0) std::cout << "step " << step << " rank " << comm_rank << " recved Q from " << curr_peer << std::endl;
         }
         BL_BENCH_LOOP_PAUSE(idist, 3);
@@ -4620,7 +4664,9 @@ namespace khmxx
         BL_BENCH_LOOP_RESUME(idist, 4);
 
         if (step3 > 0) {
+        	KHMXX_TRACE_START(t_wait);
         	MPI_Wait(&r_req, MPI_STATUS_IGNORE);
+        	KHMXX_TRACE_END(t_wait, "ialltoallv_and_query_one_to_one", wait, prev_peer2, 0);
         	// if (comm_rank == 0) std::cout << "step " << step << " rank " << comm_rank << " sent R to " << prev_peer2 << std::endl;
         }
         BL_BENCH_LOOP_PAUSE(idist, 4);
@@ -4643,11 +4689,13 @@ namespace khmxx
 		BL_BENCH_LOOP_END(idist, 4, "loop_waitrecv", total  );
 
       BL_BENCH_COLLECTIVE_START(idist, "waitall_q", _comm);
+      KHMXX_TRACE_START(t_waitall);
       MPI_Waitall(comm_size - 1, q_reqs.data(), MPI_STATUSES_IGNORE);
       BL_BENCH_END(idist, "waitall_q", comm_size - 1);
 
       BL_BENCH_COLLECTIVE_START(idist, "waitall_r", _comm);
       MPI_Waitall(comm_size - 1, r_reqs.data(), MPI_STATUSES_IGNORE);
+      KHMXX_TRACE_END(t_waitall, "ialltoallv_and_query_one_to_one", wait, -1, 0);
       BL_BENCH_END(idist, "waitall_r", comm_size - 1);
 
       BL_BENCH_COLLECTIVE_START(idist, "cleanup", _comm);
@@ -4661,6 +4709,266 @@ namespace khmxx
 
     }
 
+    /// incremental ialltoall, compute, and respond, for equal number of entries per rank.  one-to-one query and response.
+    /// input is p blocks of block_size each, the i-th block for rank i.  result is the same size and layout.
+    /// same pipeline as ialltoallv_and_query_one_to_one, but with no count exchange and no per-peer displacements.
+    template <typename IT, typename OP, typename OT,
+    typename ::std::enable_if<::std::is_same<typename ::std::iterator_traits<IT>::iterator_category,
+    ::std::random_access_iterator_tag >::value &&
+     ::std::is_same<typename ::std::iterator_traits<OT>::iterator_category,
+      ::std::random_access_iterator_tag >::value, int>::type = 1>
+    void ialltoall_and_query_one_to_one(IT blocks, size_t const & block_size,
+                                        OP compute,
+                                        OT result,
+                                        ::mxx::comm const &_comm) {
+
+      BL_BENCH_INIT(idist);
+      KHMXX_TRACE_CALL("ialltoall_and_query_one_to_one");
+
+      int comm_size = _comm.size();
+      int comm_rank = _comm.rank();
+
+      assert((block_size < static_cast<size_t>(mxx::max_int)) && "block size too large for mpi");
+
+      if (block_size == 0) {
+        BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:exch_block_query", _comm);
+        return;
+      }
+
+      // if there is comm size is 1.
+      if (comm_size == 1) {
+        BL_BENCH_COLLECTIVE_START(idist, "compute_1", _comm);
+        compute(0, &(*blocks), &(*blocks) + block_size, &(*result));
+        BL_BENCH_END(idist, "compute_1", block_size);
+
+        BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:exch_block_query", _comm);
+        return;
+      }
+
+      // setup the temporary storage.  double buffered.
+      BL_BENCH_COLLECTIVE_START(idist, "a2a_alloc", _comm);
+      using V = typename ::std::iterator_traits<IT>::value_type;
+      V* buffers = ::utils::mem::aligned_alloc<V>(block_size << 1);
+      V* recving = buffers;
+      V* computing = buffers + block_size;
+
+      using U = typename ::std::iterator_traits<OT>::value_type;
+      U* out_buffers = ::utils::mem::aligned_alloc<U>(block_size << 1);
+      U* storing = out_buffers;
+      U* sending = out_buffers + block_size;
+      BL_BENCH_END(idist, "a2a_alloc", block_size << 1);
+
+      BL_BENCH_COLLECTIVE_START(idist, "a2a_reqs", _comm);
+
+      const int query_tag = 1773;
+      const int resp_tag = 1779;
+
+      int curr_peer = comm_rank;
+
+      mxx::datatype q_dt = mxx::get_datatype<V>();
+      std::vector<MPI_Request> q_reqs(comm_size - 1);
+
+      mxx::datatype r_dt = mxx::get_datatype<U>();
+      std::vector<MPI_Request> r_reqs(comm_size - 1);
+
+      bool is_pow2 = ( comm_size & (comm_size-1)) == 0;
+      int step;
+
+      for (step = 1; step < comm_size; ++step) {
+        // target rank
+        if ( is_pow2 )  {  // power of 2
+          curr_peer = comm_rank ^ step;
+        } else {
+          curr_peer = (comm_rank + comm_size - step) % comm_size;  // source of result and target of query are same.
+        }
+
+        KHMXX_TRACE_START(t_post);
+        MPI_Irecv(&(*(result + curr_peer * block_size)), block_size, r_dt.type(),
+                  curr_peer, resp_tag, _comm, &r_reqs[step - 1] );
+        KHMXX_TRACE_END(t_post, "ialltoall_and_query_one_to_one", post_recv, curr_peer, block_size * sizeof(U));
+
+        KHMXX_TRACE_START(t_send);
+        MPI_Isend(&(*(blocks + curr_peer * block_size)), block_size, q_dt.type(),
+                  curr_peer, query_tag, _comm, &q_reqs[step - 1] );
+        KHMXX_TRACE_END(t_send, "ialltoall_and_query_one_to_one", post, curr_peer, block_size * sizeof(V));
+      }
+      _comm.barrier();  // need to make sure all Irecv are posted in order for Irsend to work.
+      BL_BENCH_END(idist, "a2a_reqs", comm_size);
+
+      BL_BENCH_LOOP_START(idist, 0);
+      BL_BENCH_LOOP_START(idist, 1);
+      BL_BENCH_LOOP_START(idist, 2);
+
+      // compute for self rank.
+      BL_BENCH_LOOP_RESUME(idist, 1);
+      KHMXX_TRACE_START(t_self);
+      compute(comm_rank, &(*(blocks + comm_rank * block_size)),
+              &(*(blocks + (comm_rank + 1) * block_size)),
+              &(*(result + comm_rank * block_size)));
+      KHMXX_TRACE_END(t_self, "ialltoall_and_query_one_to_one", compute, comm_rank, block_size * sizeof(V));
+      BL_BENCH_LOOP_PAUSE(idist, 1);
+
+      int prev_peer = comm_rank, prev_peer2 = comm_rank;
+      MPI_Request q_req, r_req;
+      int step2, step3;
+
+      // same 3 stage pipeline as the variable size version.
+      for (step = 1, step2 = 0, step3 = -1; step3 < comm_size; ++step, ++step2, ++step3) {
+        if ( is_pow2 )  {  // power of 2
+          curr_peer = comm_rank ^ step;
+        } else {
+          curr_peer = (comm_rank + step) % comm_size;  // source of query, and target of result
+        }
+
+        BL_BENCH_LOOP_RESUME(idist, 0);
+        KHMXX_TRACE_START(t_flight);
+        if (step < comm_size) {
+          MPI_Irecv(recving, block_size, q_dt.type(),
+                    curr_peer, query_tag, _comm, &q_req );
+          KHMXX_TRACE_END(t_flight, "ialltoall_and_query_one_to_one", post_recv, curr_peer, block_size * sizeof(V));
+        }
+        if (step3 > 0) {
+          KHMXX_TRACE_START(t_post);
+          MPI_Irsend(sending, block_size, r_dt.type(),
+                     prev_peer2, resp_tag, _comm, &r_req );
+          KHMXX_TRACE_END(t_post, "ialltoall_and_query_one_to_one", post, prev_peer2, block_size * sizeof(U));
+        }
+        BL_BENCH_LOOP_PAUSE(idist, 0);
+
+        BL_BENCH_LOOP_RESUME(idist, 1);
+        if ((step2 > 0) && (step2 < comm_size)) {
+          KHMXX_TRACE_START(t_compute);
+          compute(prev_peer, computing, computing + block_size, storing);
+          KHMXX_TRACE_END(t_compute, "ialltoall_and_query_one_to_one", compute, prev_peer, block_size * sizeof(V));
+        }
+        BL_BENCH_LOOP_PAUSE(idist, 1);
+
+        BL_BENCH_LOOP_RESUME(idist, 2);
+        if (step < comm_size) {
+          KHMXX_TRACE_START(t_wait);
+          MPI_Wait(&q_req, MPI_STATUS_IGNORE);
+          KHMXX_TRACE_END(t_wait, "ialltoall_and_query_one_to_one", wait, curr_peer, 0);
+          KHMXX_TRACE_END(t_flight, "ialltoall_and_query_one_to_one", inflight, curr_peer, block_size * sizeof(V));
+        }
+        if (step3 > 0) {
+          KHMXX_TRACE_START(t_wait);
+          MPI_Wait(&r_req, MPI_STATUS_IGNORE);
+          KHMXX_TRACE_END(t_wait, "ialltoall_and_query_one_to_one", wait, prev_peer2, 0);
+        }
+        BL_BENCH_LOOP_PAUSE(idist, 2);
+
+        ::std::swap(recving, computing);
+        ::std::swap(storing, sending);
+
+        prev_peer2 = prev_peer;
+        prev_peer = curr_peer;
+      }
+
+      BL_BENCH_LOOP_END(idist, 0, "loop_comm", block_size * comm_size);
+      BL_BENCH_LOOP_END(idist, 1, "loop_compute", block_size * comm_size);
+      BL_BENCH_LOOP_END(idist, 2, "loop_wait", block_size * comm_size);
+
+      BL_BENCH_COLLECTIVE_START(idist, "waitall", _comm);
+      KHMXX_TRACE_START(t_waitall);
+      MPI_Waitall(comm_size - 1, q_reqs.data(), MPI_STATUSES_IGNORE);
+      MPI_Waitall(comm_size - 1, r_reqs.data(), MPI_STATUSES_IGNORE);
+      KHMXX_TRACE_END(t_waitall, "ialltoall_and_query_one_to_one", wait, -1, 0);
+      free(buffers);
+      free(out_buffers);
+      BL_BENCH_END(idist, "waitall", comm_size - 1);
+
+      BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:exch_block_query", _comm);
+    }
+
+    /// one-to-one query that picks the fixed block exchange when the send counts are balanced.
+    /// if the global max send count is within max_ratio of the mean, every bucket is padded to the max and
+    /// ialltoall_and_query_one_to_one is used:  no count exchange, and at most (max_ratio - 1) extra queries computed.
+    /// padding repeats a real query from the input, so compute must not have side effects beyond writing out.
+    /// otherwise falls back to ialltoallv_and_query_one_to_one.
+    template <typename IT, typename SIZE, typename OP, typename OT,
+    typename ::std::enable_if<::std::is_same<typename ::std::iterator_traits<IT>::iterator_category,
+    ::std::random_access_iterator_tag >::value &&
+     ::std::is_same<typename ::std::iterator_traits<OT>::iterator_category,
+      ::std::random_access_iterator_tag >::value, int>::type = 1>
+    void ialltoallv_and_query_one_to_one_adaptive(IT permuted, IT permuted_end,
+                                         ::std::vector<SIZE> const & send_counts,
+                                          OP compute,
+                                          OT result,
+                                          ::mxx::comm const &_comm,
+                                          double const & max_ratio = 1.1) {
+      BL_BENCH_INIT(idist);
+      KHMXX_TRACE_CALL("ialltoallv_and_query_one_to_one_adaptive");
+
+      int comm_size = _comm.size();
+      size_t input_size = std::distance(permuted, permuted_end);
+
+      assert((send_counts.size() == static_cast<size_t>(comm_size)) && "send_count size not same as _comm size.");
+
+      // global max and mean of the bucket sizes, in one allreduce.
+      BL_BENCH_COLLECTIVE_START(idist, "balance", _comm);
+      ::std::pair<size_t, size_t> stats(static_cast<size_t>(*(::std::max_element(send_counts.begin(), send_counts.end()))),
+                                        input_size);
+      KHMXX_TRACE_START(t_balance);
+      stats = ::mxx::allreduce(stats, [](::std::pair<size_t, size_t> const & x, ::std::pair<size_t, size_t> const & y){
+        return ::std::pair<size_t, size_t>(::std::max(x.first, y.first), x.second + y.second);
+      }, _comm);
+      KHMXX_TRACE_END(t_balance, "ialltoallv_and_query_one_to_one_adaptive", wait, -1, 0);
+      size_t block = stats.first;
+      size_t total = stats.second;
+      double mean = static_cast<double>(total) / static_cast<double>(comm_size * comm_size);
+      bool balanced = (comm_size > 1) && (block > 0) && (static_cast<double>(block) <= max_ratio * mean) &&
+          (block < static_cast<size_t>(mxx::max_int));
+      BL_BENCH_END(idist, "balance", block);
+
+      if (!balanced) {
+        BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:exch_query_adaptive", _comm);
+        ialltoallv_and_query_one_to_one(permuted, permuted_end, send_counts, compute, result, _comm);
+        return;
+      }
+
+      using V = typename ::std::iterator_traits<IT>::value_type;
+      using U = typename ::std::iterator_traits<OT>::value_type;
+
+      // pad each bucket to block.  fill with the bucket's first query, so the padding belongs to the target rank,
+      // else with any local query, or a default value if there is no local query.
+      BL_BENCH_START(idist);
+      V* padded = ::utils::mem::aligned_alloc<V>(block * comm_size, 64);
+      U* padded_result = ::utils::mem::aligned_alloc<U>(block * comm_size, 64);
+      V filler = (input_size > 0) ? *permuted : V();
+      IT it = permuted;
+      for (int i = 0; i < comm_size; ++i) {
+        V* b = padded + i * block;
+        b = ::std::copy(it, it + send_counts[i], b);
+        ::std::fill(b, padded + (i + 1) * block, (send_counts[i] > 0) ? *it : filler);
+        it += send_counts[i];
+      }
+      BL_BENCH_END(idist, "pad", block * comm_size);
+
+      BL_BENCH_COLLECTIVE_START(idist, "a2a_query", _comm);
+      ialltoall_and_query_one_to_one(padded, block, compute, padded_result, _comm);
+      BL_BENCH_END(idist, "a2a_query", block * comm_size);
+
+      // unpad.
+      BL_BENCH_START(idist);
+      OT out = result;
+      for (int i = 0; i < comm_size; ++i) {
+        out = ::std::copy(padded_result + i * block, padded_result + i * block + send_counts[i], out);
+      }
+      free(padded);
+      free(padded_result);
+      BL_BENCH_END(idist, "unpad", input_size);
+
+      BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:exch_query_adaptive", _comm);
+    }
+
+    /// parameter for the distributed maps:  MapParams<K>::adaptive_query == true selects ialltoallv_and_query_one_to_one_adaptive
+    /// for find and count.  off by default:  it saves only the count alltoall, at the cost of an allreduce and padded copies
+    /// of the queries and results.  compare with benchmark_a2av on the target system before enabling.
+    template <typename MP, typename = void>
+    struct adaptive_query_param : public ::std::false_type {};
+    template <typename MP>
+    struct adaptive_query_param<MP, typename ::std::enable_if<MP::adaptive_query>::type> : public ::std::true_type {};
+
     template <typename IT, typename SIZE, typename OP, typename OT,
     typename ::std::enable_if<::std::is_same<typename ::std::iterator_traits<IT>::iterator_category,
     ::std::random_access_iterator_tag >::value &&
@@ -5278,6 +5586,1761 @@ namespace khmxx
     /// incremental distribute and compute.  Assume the input is already permuted.
     /// return size for the results.  this version allows missing results, so will compact.
 
+    /// incremental ialltoallv, compute, and respond, with variable number of responses per query (one-to-(0..n)), e.g. multimap find.
+    /// Assume the input is already permuted.  compute should have the form compute(int src_rank, V* start, V* end, ::std::vector<U> & out),
+    /// and append the responses for the queries from src_rank to out.
+    /// 2 phases, both pipelined with the pairwise query exchange:  as soon as the queries from a peer are computed, the response count is sent,
+    /// followed by the response payload.  on the requesting side, the payload irecv for a peer is posted as soon as its count arrives.
+    /// all response sends are nonblocking and are not waited on until the end, so no rank can block while a peer waits for a count.
+    /// responses are returned in results grouped by responding rank, in rank order, with result_counts holding the count from each rank.
+    /// note that responses are held per peer until delivered, so memory is proportional to the total response count.
+    template <typename IT, typename SIZE, typename OP, typename U,
+    typename ::std::enable_if<::std::is_same<typename ::std::iterator_traits<IT>::iterator_category,
+    ::std::random_access_iterator_tag >::value, int>::type = 1>
+    void ialltoallv_and_query(IT permuted, IT permuted_end,
+                              ::std::vector<SIZE> const & send_counts,
+                              OP compute,
+                              ::std::vector<U> & results,
+                              ::std::vector<size_t> & result_counts,
+                              ::mxx::comm const &_comm) {
+
+      BL_BENCH_INIT(idist);
+      KHMXX_TRACE_CALL("ialltoallv_and_query");
+
+      int comm_size = _comm.size();
+      int comm_rank = _comm.rank();
+
+      size_t input_size = std::distance(permuted, permuted_end);
+
+      assert((send_counts.size() == static_cast<size_t>(comm_size)) && "send_count size not same as _comm size.");
+
+      results.clear();
+      result_counts.assign(comm_size, 0);
+
+      // make sure tehre is something to do.
+      BL_BENCH_COLLECTIVE_START(idist, "empty", _comm);
+      bool empty = input_size == 0;
+      empty = mxx::all_of(empty);
+      BL_BENCH_END(idist, "empty", input_size);
+
+      if (empty) {
+        BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:exch_permute_query_n", _comm);
+        return;
+      }
+
+      using V = typename ::std::iterator_traits<IT>::value_type;
+
+      // if there is comm size is 1.
+      if (comm_size == 1) {
+        BL_BENCH_COLLECTIVE_START(idist, "compute_1", _comm);
+        compute(0, &(*permuted), &(*permuted) + input_size, results);
+        result_counts[0] = results.size();
+        BL_BENCH_END(idist, "compute_1", results.size());
+
+        BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:exch_permute_query_n", _comm);
+        return;
+      }
+
+      // get the recv counts.
+      BL_BENCH_COLLECTIVE_START(idist, "a2a_counts", _comm);
+
+      ::std::vector<SIZE> recv_counts(send_counts.size(), 0);
+      mxx::all2all(send_counts.data(), 1, recv_counts.data(), _comm);
+
+      ::std::vector<size_t> send_displs;
+      send_displs.reserve(send_counts.size() + 1);
+
+      // compute displacement for send and recv, also compute the max buffer size needed
+      SIZE buffer_max = 0;
+      send_displs.emplace_back(0UL);
+      for (int i = 0; i < comm_size; ++i) {
+        buffer_max = std::max(buffer_max, recv_counts[i]);
+
+        send_displs.emplace_back(send_displs.back() + send_counts[i]);
+      }
+      BL_BENCH_END(idist, "a2a_counts", buffer_max);
+
+
+      // setup the temporary storage.  double buffered for queries.  responses are per peer.
+      BL_BENCH_COLLECTIVE_START(idist, "a2av_alloc", _comm);
+      V* buffers = ::utils::mem::aligned_alloc<V>(buffer_max << 1, 64);
+      V* recving = buffers;
+      V* computing = buffers + buffer_max;
+
+      ::std::vector<::std::vector<U> > outgoing(comm_size);   // responses to the queries from each peer
+      ::std::vector<::std::vector<U> > incoming(comm_size);   // responses to my queries, from each peer
+      ::std::vector<size_t> out_counts(comm_size, 0);
+      BL_BENCH_END(idist, "a2av_alloc", buffer_max << 1);
+
+
+      BL_BENCH_COLLECTIVE_START(idist, "a2av_reqs", _comm);
+
+      const int query_tag = 1773;
+      const int count_tag = 1781;
+      const int resp_tag = 1783;
+
+      mxx::datatype q_dt = mxx::get_datatype<V>();
+      mxx::datatype c_dt = mxx::get_datatype<size_t>();
+      mxx::datatype r_dt = mxx::get_datatype<U>();
+
+      // indexed by peer rank.  own slot stays MPI_REQUEST_NULL.
+      std::vector<MPI_Request> q_reqs(comm_size, MPI_REQUEST_NULL);
+      std::vector<MPI_Request> c_recv_reqs(comm_size, MPI_REQUEST_NULL);
+      std::vector<MPI_Request> c_send_reqs(comm_size, MPI_REQUEST_NULL);
+      std::vector<MPI_Request> r_recv_reqs(comm_size, MPI_REQUEST_NULL);
+      std::vector<MPI_Request> r_send_reqs(comm_size, MPI_REQUEST_NULL);
+      std::vector<int> ready(comm_size);
+
+      bool is_pow2 = ( comm_size & (comm_size-1)) == 0;
+      int step;
+      int curr_peer = comm_rank;
+
+      for (step = 1; step < comm_size; ++step) {
+        // target rank
+        if ( is_pow2 )  {  // power of 2
+          curr_peer = comm_rank ^ step;
+        } else {
+          curr_peer = (comm_rank + comm_size - step) % comm_size;  // source of result and target of query are same.
+        }
+
+        // irecv the response counts
+        KHMXX_TRACE_START(t_post);
+        MPI_Irecv(&(result_counts[curr_peer]), 1, c_dt.type(),
+                  curr_peer, count_tag, _comm, &c_recv_reqs[curr_peer] );
+
+        // isend the queries.
+        MPI_Isend(&(*(permuted + send_displs[curr_peer])), send_counts[curr_peer], q_dt.type(),
+                  curr_peer, query_tag, _comm, &q_reqs[curr_peer] );
+        KHMXX_TRACE_END(t_post, "ialltoallv_and_query", post, curr_peer, send_counts[curr_peer] * sizeof(V));
+      }
+      BL_BENCH_END(idist, "a2av_reqs", comm_size);
+
+      // post the response irecvs for the peers whose counts have arrived.
+      int n_ready;
+      auto post_responses = [&](int const & n) {
+        int src;
+        for (int i = 0; i < n; ++i) {
+          src = ready[i];
+          assert((result_counts[src] < static_cast<size_t>(mxx::max_int)) && "response count too large for mpi");
+          incoming[src].resize(result_counts[src]);
+          KHMXX_TRACE_START(t_post);
+          MPI_Irecv(incoming[src].data(), result_counts[src], r_dt.type(),
+                    src, resp_tag, _comm, &r_recv_reqs[src]);
+          KHMXX_TRACE_END(t_post, "ialltoallv_and_query", post_recv, src, result_counts[src] * sizeof(U));
+        }
+      };
+
+      // loop and process each processor's assignment.  use isend and irecv.
+      BL_BENCH_LOOP_START(idist, 0);
+      BL_BENCH_LOOP_START(idist, 1);
+      BL_BENCH_LOOP_START(idist, 2);
+      BL_BENCH_LOOP_START(idist, 3);
+
+      // compute for self rank.
+      BL_BENCH_LOOP_RESUME(idist, 1);
+      KHMXX_TRACE_START(t_self);
+      compute(comm_rank, &(*(permuted + send_displs[comm_rank])),
+              &(*(permuted + send_displs[comm_rank] + send_counts[comm_rank])),
+              incoming[comm_rank]);
+      KHMXX_TRACE_END(t_self, "ialltoallv_and_query", compute, comm_rank, send_counts[comm_rank] * sizeof(V));
+      result_counts[comm_rank] = incoming[comm_rank].size();
+      BL_BENCH_LOOP_PAUSE(idist, 1);
+
+      int prev_peer = comm_rank;
+      MPI_Request q_req;
+      size_t total = 0;
+      int step2;
+
+      for (step = 1, step2 = 0; step2 < comm_size; ++step, ++step2) {
+        // target rank
+        if ( is_pow2 )  {  // power of 2
+          curr_peer = comm_rank ^ step;
+        } else {
+          curr_peer = (comm_rank + step) % comm_size;  // source of query, and target of result
+        }
+
+        BL_BENCH_LOOP_RESUME(idist, 0);
+        KHMXX_TRACE_START(t_flight);
+        if (step < comm_size) {
+          MPI_Irecv(recving, recv_counts[curr_peer], q_dt.type(),
+                    curr_peer, query_tag, _comm, &q_req );
+          KHMXX_TRACE_END(t_flight, "ialltoallv_and_query", post_recv, curr_peer, recv_counts[curr_peer] * sizeof(V));
+        }
+        BL_BENCH_LOOP_PAUSE(idist, 0);
+
+        BL_BENCH_LOOP_RESUME(idist, 1);
+        // process previously received, and send the count then the responses.
+        if (step2 > 0) {
+          KHMXX_TRACE_START(t_compute);
+          compute(prev_peer, computing, computing + recv_counts[prev_peer], outgoing[prev_peer]);
+          KHMXX_TRACE_END(t_compute, "ialltoallv_and_query", compute, prev_peer, recv_counts[prev_peer] * sizeof(V));
+          out_counts[prev_peer] = outgoing[prev_peer].size();
+          total += out_counts[prev_peer];
+          assert((out_counts[prev_peer] < static_cast<size_t>(mxx::max_int)) && "response count too large for mpi");
+
+          KHMXX_TRACE_START(t_post);
+          MPI_Isend(&(out_counts[prev_peer]), 1, c_dt.type(),
+                    prev_peer, count_tag, _comm, &c_send_reqs[prev_peer]);
+          MPI_Isend(outgoing[prev_peer].data(), out_counts[prev_peer], r_dt.type(),
+                    prev_peer, resp_tag, _comm, &r_send_reqs[prev_peer]);
+          KHMXX_TRACE_END(t_post, "ialltoallv_and_query", post, prev_peer, out_counts[prev_peer] * sizeof(U));
+        }
+        BL_BENCH_LOOP_PAUSE(idist, 1);
+
+        BL_BENCH_LOOP_RESUME(idist, 2);
+        MPI_Testsome(comm_size, c_recv_reqs.data(), &n_ready, ready.data(), MPI_STATUSES_IGNORE);
+        if (n_ready != MPI_UNDEFINED) post_responses(n_ready);
+        BL_BENCH_LOOP_PAUSE(idist, 2);
+
+        BL_BENCH_LOOP_RESUME(idist, 3);
+        if (step < comm_size) {
+          KHMXX_TRACE_START(t_wait);
+          MPI_Wait(&q_req, MPI_STATUS_IGNORE);
+          KHMXX_TRACE_END(t_wait, "ialltoallv_and_query", wait, curr_peer, 0);
+          KHMXX_TRACE_END(t_flight, "ialltoallv_and_query", inflight, curr_peer, recv_counts[curr_peer] * sizeof(V));
+        }
+        BL_BENCH_LOOP_PAUSE(idist, 3);
+
+        ::std::swap(recving, computing);
+        prev_peer = curr_peer;
+      }
+      BL_BENCH_LOOP_END(idist, 0, "loop_irecv", total);
+      BL_BENCH_LOOP_END(idist, 1, "loop_compute", total);
+      BL_BENCH_LOOP_END(idist, 2, "loop_post_resp", total);
+      BL_BENCH_LOOP_END(idist, 3, "loop_wait", total);
+
+      // remaining counts, then all responses.
+      BL_BENCH_START(idist);
+      KHMXX_TRACE_START(t_waitall);
+      while (true) {
+        MPI_Waitsome(comm_size, c_recv_reqs.data(), &n_ready, ready.data(), MPI_STATUSES_IGNORE);
+        if (n_ready == MPI_UNDEFINED) break;
+        post_responses(n_ready);
+      }
+      MPI_Waitall(comm_size, r_recv_reqs.data(), MPI_STATUSES_IGNORE);
+      MPI_Waitall(comm_size, q_reqs.data(), MPI_STATUSES_IGNORE);
+      MPI_Waitall(comm_size, c_send_reqs.data(), MPI_STATUSES_IGNORE);
+      MPI_Waitall(comm_size, r_send_reqs.data(), MPI_STATUSES_IGNORE);
+      KHMXX_TRACE_END(t_waitall, "ialltoallv_and_query", wait, -1, 0);
+      free(buffers);
+      BL_BENCH_END(idist, "waitall", total);
+
+      // concatenate in rank order.
+      BL_BENCH_START(idist);
+      size_t result_total = 0;
+      for (int i = 0; i < comm_size; ++i) {
+        result_total += result_counts[i];
+      }
+      results.reserve(result_total);
+      for (int i = 0; i < comm_size; ++i) {
+        results.insert(results.end(), incoming[i].begin(), incoming[i].end());
+        ::std::vector<U>().swap(incoming[i]);
+      }
+      BL_BENCH_END(idist, "concat", result_total);
+
+      BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:exch_permute_query_n", _comm);
+    }
+
+
+    //============= compressed exchange.
+    // k-mer blocks bucketed by hash have no locality for lz4.  sorting a block, then delta coding consecutive elements
+    // word by word (64 bit) and writing the zigzag differences as varints recovers it:  sorted k-mers share high bits and
+    // counts are small.  lz4 can be applied on top.  when the receiver depends on the order within a block (e.g. a
+    // non-commutative reduction), the block is delta coded unsorted, which still shrinks the small counts.  every message starts with a mode byte and the element count, so each
+    // sender decides per message, and the receiver needs no agreement.
+
+    /// measured throughputs for the compressed exchange, smoothed across calls.
+    /// compression pays off when encoding and decoding is faster than the exposed (not overlapped) comm time it saves:
+    ///   codec_bw * (1 - ratio) > net_bw.
+    /// if comm is completely hidden behind compute, net_bw is large and compression stays off.
+    struct compression_advisor {
+        /// wire bytes per second of exposed comm time (probe and wait).  0 if not yet measured.
+        double net_bw;
+        /// raw bytes per second for encode plus decode.  0 if not yet measured.
+        double codec_bw;
+        /// encoded size / raw size
+        double ratio;
+        /// apply lz4 after delta coding
+        bool use_lz4;
+
+        compression_advisor(bool const & lz4 = false) : net_bw(0.0), codec_bw(0.0), ratio(1.0), use_lz4(lz4) {}
+
+        inline bool should_compress() const {
+          return (net_bw > 0.0) && (codec_bw > 0.0) && (codec_bw * (1.0 - ratio) > net_bw);
+        }
+
+        inline void update_net(size_t const & bytes, double const & secs) {
+          if ((bytes == 0) || (secs <= 0.0)) return;
+          double bw = static_cast<double>(bytes) / secs;
+          net_bw = (net_bw == 0.0) ? bw : 0.5 * (net_bw + bw);
+        }
+
+        inline void update_codec(size_t const & raw_bytes, size_t const & encoded_bytes, double const & secs) {
+          if ((raw_bytes == 0) || (secs <= 0.0)) return;
+          double bw = static_cast<double>(raw_bytes) / secs;
+          double r = static_cast<double>(encoded_bytes) / static_cast<double>(raw_bytes);
+          codec_bw = (codec_bw == 0.0) ? bw : 0.5 * (codec_bw + bw);
+          ratio = 0.5 * (ratio + r);
+        }
+    };
+
+    namespace local {
+
+      static constexpr uint8_t raw_mode = 0;
+      static constexpr uint8_t delta_mode = 1;
+      static constexpr uint8_t delta_lz4_mode = 2;
+      static constexpr size_t codec_header_size = 1 + sizeof(uint64_t);
+
+      /// delta coding works on 64 bit words.  a trivially copyable element is split into 64 bit words, the last one zero
+      /// extended, e.g. k-mers.  a pair is coded field by field, so the padding in e.g. (k-mer, uint32_t count) is not sent.
+      /// std::pair is not trivially copyable (its assignment is user provided), but (k-mer, count) pairs are plain data.
+      template <typename V>
+      struct word_codec {
+          static constexpr bool enabled = ::std::is_trivially_copyable<V>::value;
+          static constexpr size_t nwords = (sizeof(V) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+          static inline size_t word_bytes(size_t const & j) {
+            return ::std::min(sizeof(uint64_t), sizeof(V) - j * sizeof(uint64_t));
+          }
+          static inline uint64_t word(V const & v, size_t const & j) {
+            uint64_t w = 0;
+            memcpy(&w, reinterpret_cast<uint8_t const *>(&v) + j * sizeof(uint64_t), word_bytes(j));
+            return w;
+          }
+          static inline void set_word(V & v, size_t const & j, uint64_t const & w) {
+            memcpy(reinterpret_cast<uint8_t*>(&v) + j * sizeof(uint64_t), &w, word_bytes(j));
+          }
+          static inline bool less(V const & x, V const & y) {
+            uint64_t a, b;
+            for (size_t j = 0; j < nwords; ++j) {
+              a = word(x, j);  b = word(y, j);
+              if (a != b) return a < b;
+            }
+            return false;
+          }
+      };
+      template <typename A, typename B>
+      struct word_codec<::std::pair<A, B> > {
+          using first_codec = word_codec<A>;
+          using second_codec = word_codec<B>;
+          static constexpr bool enabled = first_codec::enabled && second_codec::enabled;
+          static constexpr size_t nwords = first_codec::nwords + second_codec::nwords;
+
+          static inline uint64_t word(::std::pair<A, B> const & v, size_t const & j) {
+            return (j < first_codec::nwords) ? first_codec::word(v.first, j) : second_codec::word(v.second, j - first_codec::nwords);
+          }
+          static inline void set_word(::std::pair<A, B> & v, size_t const & j, uint64_t const & w) {
+            if (j < first_codec::nwords) first_codec::set_word(v.first, j, w);
+            else second_codec::set_word(v.second, j - first_codec::nwords, w);
+          }
+          static inline bool less(::std::pair<A, B> const & x, ::std::pair<A, B> const & y) {
+            uint64_t a, b;
+            for (size_t j = 0; j < nwords; ++j) {
+              a = word(x, j);  b = word(y, j);
+              if (a != b) return a < b;
+            }
+            return false;
+          }
+      };
+      template <typename V>
+      constexpr bool word_codec<V>::enabled;
+      template <typename V>
+      constexpr size_t word_codec<V>::nwords;
+      template <typename A, typename B>
+      constexpr bool word_codec<::std::pair<A, B> >::enabled;
+      template <typename A, typename B>
+      constexpr size_t word_codec<::std::pair<A, B> >::nwords;
+
+      inline uint8_t* put_varint(uint64_t x, uint8_t* out) {
+        while (x >= 0x80) {
+          *out = static_cast<uint8_t>(x | 0x80);
+          ++out;
+          x >>= 7;
+        }
+        *out = static_cast<uint8_t>(x);
+        return out + 1;
+      }
+
+      inline uint8_t const * get_varint(uint8_t const * in, uint64_t & x) {
+        x = 0;
+        int shift = 0;
+        while (*in & 0x80) {
+          x |= static_cast<uint64_t>(*in & 0x7F) << shift;
+          shift += 7;
+          ++in;
+        }
+        x |= static_cast<uint64_t>(*in) << shift;
+        return in + 1;
+      }
+
+      /// encode n elements into out, with header.  mode is a request:  the result falls back to a smaller mode
+      /// if coding does not shrink the block.  coded blocks are sorted unless keep_order is set.
+      /// scratch and tmp are reused across calls.  returns the mode used.
+      template <typename V>
+      uint8_t encode_block(V const * b, size_t const & n, uint8_t mode,
+                           ::std::vector<V> & scratch, ::std::vector<uint8_t> & tmp, ::std::vector<uint8_t> & out,
+                           bool const & keep_order = false) {
+        using WC = word_codec<V>;
+        size_t raw_bytes = n * sizeof(V);
+        if (!WC::enabled || (n == 0)) mode = raw_mode;
+
+        uint64_t count = n;
+        if (mode != raw_mode) {
+          V const * src = b;
+          if (!keep_order) {
+            scratch.assign(b, b + n);
+            ::std::sort(scratch.begin(), scratch.end(), &WC::less);
+            src = scratch.data();
+          }
+
+          // zigzag varint of word differences.  at most 10 bytes per word.
+          tmp.resize(n * WC::nwords * 10 + 1);
+          uint64_t prev[WC::nwords > 0 ? WC::nwords : 1] = { 0 };
+          uint64_t w, d;
+          uint8_t* it = tmp.data();
+          for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < WC::nwords; ++j) {
+              w = WC::word(src[i], j);
+              d = w - prev[j];
+              it = put_varint((d << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(d) >> 63), it);
+              prev[j] = w;
+            }
+          }
+          size_t delta_bytes = it - tmp.data();
+
+          if ((mode == delta_lz4_mode) && (delta_bytes < static_cast<size_t>(LZ4_MAX_INPUT_SIZE))) {
+            int bound = LZ4_compressBound(static_cast<int>(delta_bytes));
+            out.resize(codec_header_size + sizeof(uint64_t) + bound);
+            int lz4_bytes = LZ4_compress_default(reinterpret_cast<const char *>(tmp.data()),
+                                                 reinterpret_cast<char *>(out.data() + codec_header_size + sizeof(uint64_t)),
+                                                 static_cast<int>(delta_bytes), bound);
+            if ((lz4_bytes > 0) && (static_cast<size_t>(lz4_bytes) + sizeof(uint64_t) < delta_bytes)) {
+              uint64_t db = delta_bytes;
+              out[0] = delta_lz4_mode;
+              memcpy(out.data() + 1, &count, sizeof(uint64_t));
+              memcpy(out.data() + codec_header_size, &db, sizeof(uint64_t));
+              out.resize(codec_header_size + sizeof(uint64_t) + lz4_bytes);
+              return delta_lz4_mode;
+            }
+          }
+          if (delta_bytes < raw_bytes) {
+            out.resize(codec_header_size + delta_bytes);
+            out[0] = delta_mode;
+            memcpy(out.data() + 1, &count, sizeof(uint64_t));
+            memcpy(out.data() + codec_header_size, tmp.data(), delta_bytes);
+            return delta_mode;
+          }
+        }
+
+        out.resize(codec_header_size + raw_bytes);
+        out[0] = raw_mode;
+        memcpy(out.data() + 1, &count, sizeof(uint64_t));
+        if (n > 0) memcpy(out.data() + codec_header_size, b, raw_bytes);
+        return raw_mode;
+      }
+
+      /// element count of an encoded block.
+      inline size_t encoded_count(uint8_t const * in) {
+        uint64_t count;
+        memcpy(&count, in + 1, sizeof(uint64_t));
+        return count;
+      }
+
+      /// decode a block produced by encode_block into out, which must hold encoded_count(in) elements.
+      template <typename V>
+      void decode_block(uint8_t const * in, size_t const & bytes, ::std::vector<uint8_t> & tmp, V* out) {
+        using WC = word_codec<V>;
+        uint8_t mode = in[0];
+        size_t n = encoded_count(in);
+        in += codec_header_size;
+
+        if (mode == raw_mode) {
+          if (n > 0) memcpy(reinterpret_cast<uint8_t*>(out), in, n * sizeof(V));
+          return;
+        }
+
+        if (mode == delta_lz4_mode) {
+          uint64_t delta_bytes;
+          memcpy(&delta_bytes, in, sizeof(uint64_t));
+          tmp.resize(delta_bytes);
+          int decoded = LZ4_decompress_safe(reinterpret_cast<const char *>(in + sizeof(uint64_t)),
+                                            reinterpret_cast<char *>(tmp.data()),
+                                            static_cast<int>(bytes - codec_header_size - sizeof(uint64_t)),
+                                            static_cast<int>(delta_bytes));
+          if (decoded != static_cast<int>(delta_bytes)) throw ::std::logic_error("ERROR: lz4 decompression of comm block failed.");
+          in = tmp.data();
+        }
+
+        uint64_t prev[WC::nwords > 0 ? WC::nwords : 1] = { 0 };
+        uint64_t zz, d;
+        for (size_t i = 0; i < n; ++i) {
+          for (size_t j = 0; j < WC::nwords; ++j) {
+            in = get_varint(in, zz);
+            d = (zz >> 1) ^ (0 - (zz & 0x1));
+            prev[j] += d;
+            WC::set_word(out[i], j, prev[j]);
+          }
+        }
+      }
+
+    }  // namespace local
+
+
+    /// incremental alltoallv and compute, with adaptive compression of the blocks in flight.  Assume the input is already permuted.
+    /// same pairwise exchange and compute as ialltoallv_and_modify.  each outgoing block is encoded (sorted, delta coded,
+    /// optionally lz4) just before it is sent, and each incoming block is decoded just before it is computed, so coding overlaps with comm.
+    /// message sizes are not known ahead, so the receiver matches with MPI_Improbe and receives with MPI_Imrecv; no size exchange is needed.
+    /// a block not yet matched when the previous block has been decoded and computed is matched with a blocking MPI_Mprobe.
+    /// whether to compress is decided from the advisor, which is updated with the throughputs measured in this call.  when not
+    /// compressing, a sample of the largest block is encoded to keep the codec estimate current.
+    /// coded blocks are sorted, unless keep_order is set because compute depends on the order within a block.
+    template <typename IT, typename SIZE, typename OP,
+        typename ::std::enable_if<::std::is_same<typename ::std::iterator_traits<IT>::iterator_category,
+                                                 ::std::random_access_iterator_tag >::value, int>::type = 1 >
+      void ialltoallv_and_modify_compressed(IT permuted, IT permuted_end,
+                  ::std::vector<SIZE> const & send_counts,
+                  OP compute,
+                  compression_advisor & advisor,
+                  bool const & keep_order,
+                  ::mxx::comm const &_comm) {
+
+      BL_BENCH_INIT(idist);
+      KHMXX_TRACE_CALL("ialltoallv_and_modify_compressed");
+      int comm_size = _comm.size();
+      int comm_rank = _comm.rank();
+
+      size_t input_size = ::std::distance(permuted, permuted_end);
+
+      assert((static_cast<int>(send_counts.size()) == comm_size) && "send_count size not same as _comm size.");
+
+      // make sure tehre is something to do.
+      BL_BENCH_COLLECTIVE_START(idist, "empty", _comm);
+      bool empty = input_size == 0;
+      empty = mxx::all_of(empty);
+      BL_BENCH_END(idist, "empty", input_size);
+
+      if (empty) {
+        BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:exch_permute_mod_compress", _comm);
+        return;
+      }
+
+      using V = typename ::std::iterator_traits<IT>::value_type;
+
+      // if there is comm size is 1.
+      if (comm_size == 1) {
+        BL_BENCH_COLLECTIVE_START(idist, "compute_1", _comm);
+        compute(0, &(*permuted), &(*permuted) + input_size);
+        BL_BENCH_END(idist, "compute_1", input_size);
+
+        BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:exch_permute_mod_compress", _comm);
+        return;
+      }
+
+      BL_BENCH_START(idist);
+      ::std::vector<size_t> send_displs(comm_size + 1, 0);
+      size_t max_block = 0;
+      int max_peer = comm_rank;
+      for (int i = 0; i < comm_size; ++i) {
+        send_displs[i + 1] = send_displs[i] + send_counts[i];
+        if ((i != comm_rank) && (static_cast<size_t>(send_counts[i]) > max_block)) {
+          max_block = send_counts[i];
+          max_peer = i;
+        }
+      }
+
+      bool compress = local::word_codec<V>::enabled && advisor.should_compress();
+      uint8_t mode = compress ? (advisor.use_lz4 ? local::delta_lz4_mode : local::delta_mode) : local::raw_mode;
+
+      ::std::vector<V> scratch;
+      ::std::vector<uint8_t> tmp;
+
+      // keep the codec estimate current while not compressing.
+      if (!compress && local::word_codec<V>::enabled && (max_block > 0)) {
+        size_t sample = ::std::min(max_block, static_cast<size_t>(0x1UL << 16));
+        ::std::vector<uint8_t> enc;
+        ::std::vector<V> dec(sample);
+        double t = MPI_Wtime();
+        local::encode_block(&(*(permuted + send_displs[max_peer])), sample,
+                            advisor.use_lz4 ? local::delta_lz4_mode : local::delta_mode, scratch, tmp, enc, keep_order);
+        local::decode_block(enc.data(), enc.size(), tmp, dec.data());
+        advisor.update_codec(sample * sizeof(V), enc.size(), MPI_Wtime() - t);
+      }
+      BL_BENCH_END(idist, "setup", mode);
+
+      // encoded blocks must live until their sends complete.
+      ::std::vector<::std::vector<uint8_t> > sending(comm_size);
+      ::std::vector<MPI_Request> reqs(comm_size - 1);
+      ::std::vector<uint8_t> recving, computing;
+      V* decoded = nullptr;
+      size_t decoded_capacity = 0;
+
+      const int ialltoallv_tag = 1787;
+
+      // process self data
+      KHMXX_TRACE_START(t_self);
+      compute(comm_rank, &(*(permuted + send_displs[comm_rank])), &(*(permuted + send_displs[comm_rank + 1])));
+      KHMXX_TRACE_END(t_self, "ialltoallv_and_modify_compressed", compute, comm_rank, send_counts[comm_rank] * sizeof(V));
+
+      bool is_pow2 = ( comm_size & (comm_size-1)) == 0;
+      int step, step2;
+      int send_peer, recv_peer, prev_peer = comm_rank;
+      MPI_Message msg;
+      MPI_Status stat;
+      MPI_Request req;
+      int recv_bytes, matched;
+      size_t raw_sent = 0, wire_sent = 0, raw_recv = 0, wire_recv = 0;
+      double enc_time = 0.0, dec_time = 0.0, comm_time = 0.0, t;
+
+      BL_BENCH_LOOP_START(idist, 0);
+      BL_BENCH_LOOP_START(idist, 1);
+      BL_BENCH_LOOP_START(idist, 2);
+      BL_BENCH_LOOP_START(idist, 3);
+
+      for (step = 1, step2 = 0; step2 < comm_size; ++step, ++step2) {
+        if ( is_pow2 )  {  // power of 2
+          send_peer = comm_rank ^ step;
+          recv_peer = send_peer;
+        } else {
+          send_peer = (comm_rank + comm_size - step) % comm_size;
+          recv_peer = (comm_rank + step) % comm_size;
+        }
+
+        // encode and send the next block.
+        BL_BENCH_LOOP_RESUME(idist, 0);
+        if (step < comm_size) {
+          KHMXX_TRACE_START(t_encode);
+          t = MPI_Wtime();
+          local::encode_block(&(*(permuted + send_displs[send_peer])), send_counts[send_peer], mode,
+                              scratch, tmp, sending[send_peer], keep_order);
+          enc_time += MPI_Wtime() - t;
+          KHMXX_TRACE_END(t_encode, "ialltoallv_and_modify_compressed", compute, send_peer, send_counts[send_peer] * sizeof(V));
+          assert((sending[send_peer].size() < static_cast<size_t>(mxx::max_int)) && "encoded block too large for mpi");
+
+          raw_sent += send_counts[send_peer] * sizeof(V);
+          wire_sent += sending[send_peer].size();
+          KHMXX_TRACE_START(t_post);
+          MPI_Isend(sending[send_peer].data(), sending[send_peer].size(), MPI_BYTE,
+                    send_peer, ialltoallv_tag, _comm, &reqs[step - 1]);
+          KHMXX_TRACE_END(t_post, "ialltoallv_and_modify_compressed", post, send_peer, sending[send_peer].size());
+        }
+        BL_BENCH_LOOP_PAUSE(idist, 0);
+
+        // match the incoming block without blocking.  if it has arrived, its receive overlaps the compute below.
+        BL_BENCH_LOOP_RESUME(idist, 1);
+        matched = 0;
+        KHMXX_TRACE_START(t_flight);
+        if (step < comm_size) {
+          MPI_Improbe(recv_peer, ialltoallv_tag, _comm, &matched, &msg, &stat);
+          if (matched) {
+            MPI_Get_count(&stat, MPI_BYTE, &recv_bytes);
+            recving.resize(recv_bytes);
+            MPI_Imrecv(recving.data(), recv_bytes, MPI_BYTE, &msg, &req);
+            wire_recv += recv_bytes;
+            KHMXX_TRACE_END(t_flight, "ialltoallv_and_modify_compressed", post_recv, recv_peer, recv_bytes);
+          }
+        }
+        BL_BENCH_LOOP_PAUSE(idist, 1);
+
+        // decode and process previously received, before blocking on the next block.
+        BL_BENCH_LOOP_RESUME(idist, 2);
+        if (step2 > 0) {
+          size_t n = local::encoded_count(computing.data());
+          if (n > decoded_capacity) {
+            if (decoded != nullptr) free(decoded);
+            decoded_capacity = n;
+            decoded = ::utils::mem::aligned_alloc<V>(decoded_capacity, 64);
+          }
+          KHMXX_TRACE_START(t_compute);
+          t = MPI_Wtime();
+          local::decode_block(computing.data(), computing.size(), tmp, decoded);
+          dec_time += MPI_Wtime() - t;
+          raw_recv += n * sizeof(V);
+
+          compute(prev_peer, decoded, decoded + n);
+          KHMXX_TRACE_END(t_compute, "ialltoallv_and_modify_compressed", compute, prev_peer, n * sizeof(V));
+        }
+        BL_BENCH_LOOP_PAUSE(idist, 2);
+
+        // not matched before the compute:  match it now.
+        BL_BENCH_LOOP_RESUME(idist, 3);
+        if (step < comm_size) {
+          KHMXX_TRACE_START(t_wait);
+          t = MPI_Wtime();
+          if (!matched) {
+            MPI_Mprobe(recv_peer, ialltoallv_tag, _comm, &msg, &stat);
+            MPI_Get_count(&stat, MPI_BYTE, &recv_bytes);
+            recving.resize(recv_bytes);
+            KHMXX_TRACE_START(t_post);
+            MPI_Imrecv(recving.data(), recv_bytes, MPI_BYTE, &msg, &req);
+            KHMXX_TRACE_END(t_post, "ialltoallv_and_modify_compressed", post_recv, recv_peer, recv_bytes);
+            wire_recv += recv_bytes;
+          }
+          MPI_Wait(&req, MPI_STATUS_IGNORE);
+          comm_time += MPI_Wtime() - t;
+          KHMXX_TRACE_END(t_wait, "ialltoallv_and_modify_compressed", wait, recv_peer, 0);
+          // matched late, it was in flight only while this rank waited:  all of it is exposed.
+          if (matched) {
+            KHMXX_TRACE_END(t_flight, "ialltoallv_and_modify_compressed", inflight, recv_peer, recv_bytes);
+          } else {
+            KHMXX_TRACE_END(t_wait, "ialltoallv_and_modify_compressed", inflight, recv_peer, recv_bytes);
+          }
+        }
+        BL_BENCH_LOOP_PAUSE(idist, 3);
+
+        ::std::swap(recving, computing);
+        prev_peer = recv_peer;
+      }
+      BL_BENCH_LOOP_END(idist, 0, "loop_encode_send", wire_sent);
+      BL_BENCH_LOOP_END(idist, 1, "loop_improbe_recv", wire_recv);
+      BL_BENCH_LOOP_END(idist, 2, "loop_decode_compute", raw_recv);
+      BL_BENCH_LOOP_END(idist, 3, "loop_probe_wait", wire_recv);
+
+      BL_BENCH_START(idist);
+      KHMXX_TRACE_START(t_sends);
+      MPI_Waitall(comm_size - 1, reqs.data(), MPI_STATUSES_IGNORE);
+      KHMXX_TRACE_END(t_sends, "ialltoallv_and_modify_compressed", wait, -1, 0);
+      if (decoded != nullptr) free(decoded);
+
+      // update the measurements for the next call.
+      advisor.update_net(wire_recv, comm_time);
+      if (compress && (raw_sent > 0) && (raw_recv > 0)) {
+        // time per raw byte for encode plus decode.
+        double per_byte = enc_time / static_cast<double>(raw_sent) + dec_time / static_cast<double>(raw_recv);
+        if (per_byte > 0.0) advisor.update_codec(raw_sent, wire_sent, per_byte * static_cast<double>(raw_sent));
+      }
+      BL_BENCH_END(idist, "waitall_cleanup", wire_sent);
+
+      BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:exch_permute_mod_compress", _comm);
+    }
+
+
+    //============= node-aware (hierarchical) exchange.
+    // with many ranks per node, the pairwise exchange has every rank send p - 1 small messages.  the hierarchical
+    // exchange aggregates instead:
+    //   1. inter-node:  each rank sends to the rank with the same node-local rank on every other node, all data
+    //      destined to that node.  N - 1 messages of L-fold aggregated data, where N is the node count and L the ranks per node.
+    //   2. intra-node:  each rank scatters what it received to the ranks on its node, grouped by final destination.  L - 1 messages.
+    // compute is overlapped with step 2, and called once per source rank with that source's data, as in the pairwise exchange.
+
+    /// parameter for the distributed maps:  MapParams<K>::hierarchical_comm == true selects the node-aware exchange.
+    template <typename MP, typename = void>
+    struct hierarchical_comm_param : public ::std::false_type {};
+    template <typename MP>
+    struct hierarchical_comm_param<MP, typename ::std::enable_if<MP::hierarchical_comm>::type> : public ::std::true_type {};
+
+
+    /// rank layout for the hierarchical exchange.  node_comm holds the ranks on this node.  core_comm holds the ranks
+    /// with this rank's node-local rank, one per node, in node id order.  all nodes must have the same number of ranks.
+    struct node_layout {
+      ::mxx::comm node_comm;
+      ::mxx::comm core_comm;
+      int node_count;
+      int core_count;
+      int node_id;
+      int core_rank;
+      /// global rank for each (node id, core rank), node major.
+      ::std::vector<int> global_ranks;
+
+      node_layout(::mxx::comm const & comm) : node_comm(comm.split_shared()) {
+        core_count = node_comm.size();
+        core_rank = node_comm.rank();
+        assert(mxx::all_same(core_count, comm) && "Different size nodes");
+
+        // node ids in the order of the node leaders' global ranks.
+        {
+          ::mxx::comm leaders = comm.split(core_rank);
+          node_id = leaders.rank();
+          node_count = leaders.size();
+        }
+        mxx::bcast(node_id, 0, node_comm);
+        core_comm = comm.split(core_rank, node_id);   // core_comm rank == node id.
+
+        ::std::vector<int> pos = mxx::allgather(node_id * core_count + core_rank, comm);
+        global_ranks.resize(comm.size());
+        for (int i = 0; i < comm.size(); ++i) {
+          global_ranks[pos[i]] = i;
+        }
+      }
+
+      /// with a single node, or a single rank per node, the hierarchical exchange reduces to the pairwise exchange.
+      inline bool is_hierarchical() const {
+        return (node_count > 1) && (core_count > 1);
+      }
+    };
+
+
+    namespace local {
+
+      /// forward part of the hierarchical exchange, up to the intra-node counts.  data leaves in regroup, ordered by
+      /// (destination core, source node).  counts are per (node, core) entry, node major, except block_send and block_recv
+      /// which are per (core, node), core major:  block_recv[c * N + n] is the count from global rank (n, c).
+      template <typename IT, typename SIZE, typename V>
+      void hierarchical_forward(IT permuted, ::std::vector<SIZE> const & send_counts,
+                                ::std::vector<size_t> const & send_displs,
+                                node_layout const & layout,
+                                ::std::vector<size_t> & node_send, ::std::vector<size_t> & node_recv,
+                                ::std::vector<size_t> & block_send, ::std::vector<size_t> & block_recv,
+                                V* & regroup, size_t & regroup_size) {
+        int N = layout.node_count;
+        int L = layout.core_count;
+        int NL = N * L;
+
+        // pack by destination node, then core.
+        ::std::vector<size_t> pack_counts(NL);
+        size_t input_size = 0;
+        for (int i = 0; i < NL; ++i) {
+          pack_counts[i] = send_counts[layout.global_ranks[i]];
+          input_size += pack_counts[i];
+        }
+        V* packed = ::utils::mem::aligned_alloc<V>(input_size + 1, 64);
+        V* it = packed;
+        for (int i = 0; i < NL; ++i) {
+          it = ::std::copy(permuted + send_displs[layout.global_ranks[i]],
+                           permuted + send_displs[layout.global_ranks[i]] + pack_counts[i], it);
+        }
+
+        // step 1: inter-node.  exchange L counts per node, then the aggregated data.
+        ::std::vector<size_t> stage_counts(NL);
+        mxx::all2all(pack_counts.data(), L, stage_counts.data(), layout.core_comm);
+        node_send.assign(N, 0);
+        node_recv.assign(N, 0);
+        for (int n = 0; n < N; ++n) {
+          for (int c = 0; c < L; ++c) {
+            node_send[n] += pack_counts[n * L + c];
+            node_recv[n] += stage_counts[n * L + c];
+          }
+        }
+        regroup_size = ::std::accumulate(node_recv.begin(), node_recv.end(), static_cast<size_t>(0));
+        V* stage = ::utils::mem::aligned_alloc<V>(regroup_size + 1, 64);
+        mxx::all2allv(packed, node_send, stage, node_recv, layout.core_comm);
+        free(packed);
+
+        // regroup from (source node, destination core) to (destination core, source node)
+        ::std::vector<size_t> stage_displs(NL + 1, 0);
+        for (int i = 0; i < NL; ++i) {
+          stage_displs[i + 1] = stage_displs[i] + stage_counts[i];
+        }
+        block_send.resize(NL);
+        regroup = ::utils::mem::aligned_alloc<V>(regroup_size + 1, 64);
+        it = regroup;
+        for (int c = 0; c < L; ++c) {
+          for (int n = 0; n < N; ++n) {
+            block_send[c * N + n] = stage_counts[n * L + c];
+            it = ::std::copy(stage + stage_displs[n * L + c], stage + stage_displs[n * L + c + 1], it);
+          }
+        }
+        free(stage);
+
+        // step 2 counts: N per local peer.
+        block_recv.resize(NL);
+        mxx::all2all(block_send.data(), N, block_recv.data(), layout.node_comm);
+      }
+
+    }  // namespace local
+
+
+    /// hierarchical version of ialltoallv_and_modify.  Assume the input is already permuted by global rank.
+    /// operator should have the form op(int src_rank, V* start, V* end), called once for each source rank.
+    template <typename IT, typename SIZE, typename OP,
+        typename ::std::enable_if<::std::is_same<typename ::std::iterator_traits<IT>::iterator_category,
+                                                 ::std::random_access_iterator_tag >::value, int>::type = 1 >
+      void ialltoallv_and_modify_hierarchical(IT permuted, IT permuted_end,
+                                  ::std::vector<SIZE> const & send_counts,
+                                  OP compute,
+                                  node_layout const & layout,
+                                  ::mxx::comm const &_comm) {
+
+      if (!layout.is_hierarchical()) {
+        ialltoallv_and_modify(permuted, permuted_end, send_counts, compute, _comm);
+        return;
+      }
+
+      BL_BENCH_INIT(idist);
+      KHMXX_TRACE_CALL("ialltoallv_and_modify_hierarchical");
+      int comm_size = _comm.size();
+      size_t input_size = ::std::distance(permuted, permuted_end);
+
+      assert((static_cast<int>(send_counts.size()) == comm_size) && "send_count size not same as _comm size.");
+
+      BL_BENCH_COLLECTIVE_START(idist, "empty", _comm);
+      bool empty = input_size == 0;
+      empty = mxx::all_of(empty);
+      BL_BENCH_END(idist, "empty", input_size);
+
+      if (empty) {
+        BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:exch_permute_mod_hier", _comm);
+        return;
+      }
+
+      using V = typename ::std::iterator_traits<IT>::value_type;
+      int N = layout.node_count;
+      int L = layout.core_count;
+      int me = layout.core_rank;
+
+      BL_BENCH_COLLECTIVE_START(idist, "a2av_inter", _comm);
+      ::std::vector<size_t> send_displs(comm_size + 1, 0);
+      for (int i = 0; i < comm_size; ++i) {
+        send_displs[i + 1] = send_displs[i] + send_counts[i];
+      }
+      ::std::vector<size_t> node_send, node_recv, block_send, block_recv;
+      V* regroup = nullptr;
+      size_t regroup_size = 0;
+      // blocking, so in flight only while waiting:  all of it is exposed.
+      KHMXX_TRACE_START(t_inter);
+      local::hierarchical_forward(permuted, send_counts, send_displs, layout,
+                                  node_send, node_recv, block_send, block_recv, regroup, regroup_size);
+      KHMXX_TRACE_END(t_inter, "ialltoallv_and_modify_hierarchical", wait, -1, 0);
+      KHMXX_TRACE_END(t_inter, "ialltoallv_and_modify_hierarchical", inflight, -1, regroup_size * sizeof(V));
+      BL_BENCH_END(idist, "a2av_inter", regroup_size);
+
+      // step 2: intra-node, overlapped with compute.
+      BL_BENCH_START(idist);
+      ::std::vector<size_t> send_offsets(L + 1, 0), recv_offsets(L + 1, 0);
+      for (int c = 0; c < L; ++c) {
+        send_offsets[c + 1] = send_offsets[c] + ::std::accumulate(block_send.begin() + c * N, block_send.begin() + (c + 1) * N, static_cast<size_t>(0));
+        recv_offsets[c + 1] = recv_offsets[c] + ::std::accumulate(block_recv.begin() + c * N, block_recv.begin() + (c + 1) * N, static_cast<size_t>(0));
+      }
+      V* recving = ::utils::mem::aligned_alloc<V>(recv_offsets[L] + 1, 64);
+
+      const int ialltoallv_tag = 1775;
+      mxx::datatype dt = mxx::get_datatype<V>();
+      ::std::vector<MPI_Request> recv_reqs(L, MPI_REQUEST_NULL);
+      ::std::vector<MPI_Request> send_reqs(L, MPI_REQUEST_NULL);
+      // intra-node peers are traced by their global rank.
+      KHMXX_TRACE_START(t_flight);
+      for (int c = 0; c < L; ++c) {
+        if (c == me) continue;
+        KHMXX_TRACE_START(t_post);
+        MPI_Irecv(recving + recv_offsets[c], recv_offsets[c + 1] - recv_offsets[c], dt.type(),
+                  c, ialltoallv_tag, layout.node_comm, &recv_reqs[c]);
+        KHMXX_TRACE_END(t_post, "ialltoallv_and_modify_hierarchical", post_recv, layout.global_ranks[layout.node_id * L + c],
+                        (recv_offsets[c + 1] - recv_offsets[c]) * sizeof(V));
+      }
+      for (int c = 0; c < L; ++c) {
+        if (c == me) continue;
+        KHMXX_TRACE_START(t_post);
+        MPI_Issend(regroup + send_offsets[c], send_offsets[c + 1] - send_offsets[c], dt.type(),
+                   c, ialltoallv_tag, layout.node_comm, &send_reqs[c]);
+        KHMXX_TRACE_END(t_post, "ialltoallv_and_modify_hierarchical", post, layout.global_ranks[layout.node_id * L + c],
+                        (send_offsets[c + 1] - send_offsets[c]) * sizeof(V));
+      }
+      BL_BENCH_END(idist, "a2av_intra_post", recv_offsets[L]);
+
+      // compute each source rank's block from one local peer's message.
+      auto compute_peer = [&compute, &layout, &block_recv, &N, &L](int c, V* b) {
+        for (int n = 0; n < N; ++n) {
+          KHMXX_TRACE_START(t_compute);
+          compute(layout.global_ranks[n * L + c], b, b + block_recv[c * N + n]);
+          KHMXX_TRACE_END(t_compute, "ialltoallv_and_modify_hierarchical", compute, layout.global_ranks[n * L + c], block_recv[c * N + n] * sizeof(V));
+          b += block_recv[c * N + n];
+        }
+      };
+
+      BL_BENCH_START(idist);
+      compute_peer(me, regroup + send_offsets[me]);   // own data, sent to self.
+      int idx;
+      for (int i = 1; i < L; ++i) {
+        KHMXX_TRACE_START(t_wait);
+        MPI_Waitany(L, recv_reqs.data(), &idx, MPI_STATUS_IGNORE);
+        KHMXX_TRACE_END(t_wait, "ialltoallv_and_modify_hierarchical", wait, layout.global_ranks[layout.node_id * L + idx], 0);
+        KHMXX_TRACE_END(t_flight, "ialltoallv_and_modify_hierarchical", inflight, layout.global_ranks[layout.node_id * L + idx],
+                        (recv_offsets[idx + 1] - recv_offsets[idx]) * sizeof(V));
+        compute_peer(idx, recving + recv_offsets[idx]);
+      }
+      KHMXX_TRACE_START(t_sends);
+      MPI_Waitall(L, send_reqs.data(), MPI_STATUSES_IGNORE);
+      KHMXX_TRACE_END(t_sends, "ialltoallv_and_modify_hierarchical", wait, -1, 0);
+      BL_BENCH_END(idist, "a2av_intra_compute", recv_offsets[L]);
+
+      BL_BENCH_START(idist);
+      free(regroup);
+      free(recving);
+      BL_BENCH_END(idist, "cleanup", regroup_size);
+
+      BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:exch_permute_mod_hier", _comm);
+    }
+
+
+    /// hierarchical version of ialltoallv_and_query_one_to_one.  responses return along the reverse path.
+    /// operator should have the form op(int src_rank, V* start, V* end, U* out), called once for each source rank.
+    template <typename IT, typename SIZE, typename OP, typename OT,
+    typename ::std::enable_if<::std::is_same<typename ::std::iterator_traits<IT>::iterator_category,
+    ::std::random_access_iterator_tag >::value &&
+     ::std::is_same<typename ::std::iterator_traits<OT>::iterator_category,
+      ::std::random_access_iterator_tag >::value, int>::type = 1>
+    void ialltoallv_and_query_one_to_one_hierarchical(IT permuted, IT permuted_end,
+                                         ::std::vector<SIZE> const & send_counts,
+                                          OP compute,
+                                          OT result,
+                                          node_layout const & layout,
+                                          ::mxx::comm const &_comm) {
+
+      if (!layout.is_hierarchical()) {
+        ialltoallv_and_query_one_to_one(permuted, permuted_end, send_counts, compute, result, _comm);
+        return;
+      }
+
+      BL_BENCH_INIT(idist);
+      KHMXX_TRACE_CALL("ialltoallv_and_query_one_to_one_hierarchical");
+      int comm_size = _comm.size();
+      size_t input_size = ::std::distance(permuted, permuted_end);
+
+      assert((static_cast<int>(send_counts.size()) == comm_size) && "send_count size not same as _comm size.");
+
+      BL_BENCH_COLLECTIVE_START(idist, "empty", _comm);
+      bool empty = input_size == 0;
+      empty = mxx::all_of(empty);
+      BL_BENCH_END(idist, "empty", input_size);
+
+      if (empty) {
+        BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:exch_permute_query_hier", _comm);
+        return;
+      }
+
+      using V = typename ::std::iterator_traits<IT>::value_type;
+      using U = typename ::std::iterator_traits<OT>::value_type;
+      int N = layout.node_count;
+      int L = layout.core_count;
+      int NL = N * L;
+      int me = layout.core_rank;
+
+      BL_BENCH_COLLECTIVE_START(idist, "a2av_inter", _comm);
+      ::std::vector<size_t> send_displs(comm_size + 1, 0);
+      for (int i = 0; i < comm_size; ++i) {
+        send_displs[i + 1] = send_displs[i] + send_counts[i];
+      }
+      ::std::vector<size_t> node_send, node_recv, block_send, block_recv;
+      V* regroup = nullptr;
+      size_t regroup_size = 0;
+      // blocking, so in flight only while waiting:  all of it is exposed.
+      KHMXX_TRACE_START(t_inter);
+      local::hierarchical_forward(permuted, send_counts, send_displs, layout,
+                                  node_send, node_recv, block_send, block_recv, regroup, regroup_size);
+      KHMXX_TRACE_END(t_inter, "ialltoallv_and_query_one_to_one_hierarchical", wait, -1, 0);
+      KHMXX_TRACE_END(t_inter, "ialltoallv_and_query_one_to_one_hierarchical", inflight, -1, regroup_size * sizeof(V));
+      BL_BENCH_END(idist, "a2av_inter", regroup_size);
+
+      // step 2: intra-node, overlapped with compute and with sending the responses back.
+      BL_BENCH_START(idist);
+      ::std::vector<size_t> send_offsets(L + 1, 0), recv_offsets(L + 1, 0);
+      for (int c = 0; c < L; ++c) {
+        send_offsets[c + 1] = send_offsets[c] + ::std::accumulate(block_send.begin() + c * N, block_send.begin() + (c + 1) * N, static_cast<size_t>(0));
+        recv_offsets[c + 1] = recv_offsets[c] + ::std::accumulate(block_recv.begin() + c * N, block_recv.begin() + (c + 1) * N, static_cast<size_t>(0));
+      }
+      V* recving = ::utils::mem::aligned_alloc<V>(recv_offsets[L] + 1, 64);
+      U* storing = ::utils::mem::aligned_alloc<U>(recv_offsets[L] + 1, 64);
+      U* regroup_res = ::utils::mem::aligned_alloc<U>(regroup_size + 1, 64);
+
+      const int ialltoallv_tag = 1776;
+      const int ialltoallv_res_tag = 1777;
+      mxx::datatype dt = mxx::get_datatype<V>();
+      mxx::datatype r_dt = mxx::get_datatype<U>();
+      ::std::vector<MPI_Request> recv_reqs(L, MPI_REQUEST_NULL);
+      ::std::vector<MPI_Request> send_reqs(L, MPI_REQUEST_NULL);
+      ::std::vector<MPI_Request> res_recv_reqs(L, MPI_REQUEST_NULL);
+      ::std::vector<MPI_Request> res_send_reqs(L, MPI_REQUEST_NULL);
+      // intra-node peers are traced by their global rank.
+      KHMXX_TRACE_START(t_flight);
+      for (int c = 0; c < L; ++c) {
+        if (c == me) continue;
+        KHMXX_TRACE_START(t_post);
+        MPI_Irecv(regroup_res + send_offsets[c], send_offsets[c + 1] - send_offsets[c], r_dt.type(),
+                  c, ialltoallv_res_tag, layout.node_comm, &res_recv_reqs[c]);
+        MPI_Irecv(recving + recv_offsets[c], recv_offsets[c + 1] - recv_offsets[c], dt.type(),
+                  c, ialltoallv_tag, layout.node_comm, &recv_reqs[c]);
+        KHMXX_TRACE_END(t_post, "ialltoallv_and_query_one_to_one_hierarchical", post_recv, layout.global_ranks[layout.node_id * L + c],
+                        (send_offsets[c + 1] - send_offsets[c]) * sizeof(U) + (recv_offsets[c + 1] - recv_offsets[c]) * sizeof(V));
+      }
+      for (int c = 0; c < L; ++c) {
+        if (c == me) continue;
+        KHMXX_TRACE_START(t_post);
+        MPI_Issend(regroup + send_offsets[c], send_offsets[c + 1] - send_offsets[c], dt.type(),
+                   c, ialltoallv_tag, layout.node_comm, &send_reqs[c]);
+        KHMXX_TRACE_END(t_post, "ialltoallv_and_query_one_to_one_hierarchical", post, layout.global_ranks[layout.node_id * L + c],
+                        (send_offsets[c + 1] - send_offsets[c]) * sizeof(V));
+      }
+      BL_BENCH_END(idist, "a2av_intra_post", recv_offsets[L]);
+
+      auto compute_peer = [&compute, &layout, &block_recv, &N, &L](int c, V* b, U* o) {
+        for (int n = 0; n < N; ++n) {
+          KHMXX_TRACE_START(t_compute);
+          compute(layout.global_ranks[n * L + c], b, b + block_recv[c * N + n], o);
+          KHMXX_TRACE_END(t_compute, "ialltoallv_and_query_one_to_one_hierarchical", compute, layout.global_ranks[n * L + c], block_recv[c * N + n] * sizeof(V));
+          b += block_recv[c * N + n];
+          o += block_recv[c * N + n];
+        }
+      };
+
+      BL_BENCH_START(idist);
+      compute_peer(me, regroup + send_offsets[me], regroup_res + send_offsets[me]);  // own data, sent to self.
+      int idx;
+      for (int i = 1; i < L; ++i) {
+        KHMXX_TRACE_START(t_wait);
+        MPI_Waitany(L, recv_reqs.data(), &idx, MPI_STATUS_IGNORE);
+        KHMXX_TRACE_END(t_wait, "ialltoallv_and_query_one_to_one_hierarchical", wait, layout.global_ranks[layout.node_id * L + idx], 0);
+        KHMXX_TRACE_END(t_flight, "ialltoallv_and_query_one_to_one_hierarchical", inflight, layout.global_ranks[layout.node_id * L + idx],
+                        (recv_offsets[idx + 1] - recv_offsets[idx]) * sizeof(V));
+        compute_peer(idx, recving + recv_offsets[idx], storing + recv_offsets[idx]);
+        KHMXX_TRACE_START(t_post);
+        MPI_Isend(storing + recv_offsets[idx], recv_offsets[idx + 1] - recv_offsets[idx], r_dt.type(),
+                  idx, ialltoallv_res_tag, layout.node_comm, &res_send_reqs[idx]);
+        KHMXX_TRACE_END(t_post, "ialltoallv_and_query_one_to_one_hierarchical", post, layout.global_ranks[layout.node_id * L + idx],
+                        (recv_offsets[idx + 1] - recv_offsets[idx]) * sizeof(U));
+      }
+      KHMXX_TRACE_START(t_waitall);
+      MPI_Waitall(L, send_reqs.data(), MPI_STATUSES_IGNORE);
+      MPI_Waitall(L, res_recv_reqs.data(), MPI_STATUSES_IGNORE);
+      MPI_Waitall(L, res_send_reqs.data(), MPI_STATUSES_IGNORE);
+      KHMXX_TRACE_END(t_waitall, "ialltoallv_and_query_one_to_one_hierarchical", wait, -1, 0);
+      free(recving);
+      free(storing);
+      free(regroup);
+      BL_BENCH_END(idist, "a2av_intra_compute", recv_offsets[L]);
+
+      // reverse step 1: regroup responses back to (source node, core), then return to the requesting nodes.
+      BL_BENCH_COLLECTIVE_START(idist, "a2av_inter_res", _comm);
+      ::std::vector<size_t> regroup_displs(NL + 1, 0);
+      for (int i = 0; i < NL; ++i) {
+        regroup_displs[i + 1] = regroup_displs[i] + block_send[i];
+      }
+      U* stage_res = ::utils::mem::aligned_alloc<U>(regroup_size + 1, 64);
+      U* it = stage_res;
+      for (int n = 0; n < N; ++n) {
+        for (int c = 0; c < L; ++c) {
+          it = ::std::copy(regroup_res + regroup_displs[c * N + n], regroup_res + regroup_displs[c * N + n + 1], it);
+        }
+      }
+      free(regroup_res);
+
+      U* packed_res = ::utils::mem::aligned_alloc<U>(input_size + 1, 64);
+      KHMXX_TRACE_START(t_inter_res);
+      mxx::all2allv(stage_res, node_recv, packed_res, node_send, layout.core_comm);
+      KHMXX_TRACE_END(t_inter_res, "ialltoallv_and_query_one_to_one_hierarchical", wait, -1, 0);
+      KHMXX_TRACE_END(t_inter_res, "ialltoallv_and_query_one_to_one_hierarchical", inflight, -1, input_size * sizeof(U));
+      free(stage_res);
+
+      // unpack to the permuted input order.
+      it = packed_res;
+      for (int i = 0; i < NL; ++i) {
+        int g = layout.global_ranks[i];
+        ::std::copy(it, it + send_counts[g], result + send_displs[g]);
+        it += send_counts[g];
+      }
+      free(packed_res);
+      BL_BENCH_END(idist, "a2av_inter_res", input_size);
+
+      BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:exch_permute_query_hier", _comm);
+    }
+
+
+    /// pipelined alltoallv and compute, for input that is NOT bucketed.  the input is processed in blocks of at most
+    /// block_size elements per rank.  each block is bucketed by to_rank with assign_and_permute, then exchanged with
+    /// MPI_Ialltoallv.  while block i is in flight, block i-1 is computed and block i+1 is bucketed, so bucketing, comm,
+    /// and compute are all overlapped, and the temporary memory is bounded by 2 send and 2 recv blocks instead of the whole input.
+    /// all ranks iterate the same number of blocks, ranks that run out of input participate with empty blocks.
+    /// to_rank should have the form int to_rank(V const &).   compute has the same form as for ialltoallv_and_modify,
+    /// compute(int src_rank, V* start, V* end), but is called once per source rank per block.
+    template <typename IT, typename ToRank, typename OP,
+        typename ::std::enable_if<::std::is_same<typename ::std::iterator_traits<IT>::iterator_category,
+                                                 ::std::random_access_iterator_tag >::value, int>::type = 1 >
+      void batched_ialltoallv_modify(IT input, IT input_end,
+                  ToRank const & to_rank,
+                  OP compute,
+                  ::mxx::comm const &_comm,
+                  size_t const & block_size = (0x1UL << 20)) {
+
+      BL_BENCH_INIT(idist);
+      KHMXX_TRACE_CALL("batched_ialltoallv_modify");
+      int comm_size = _comm.size();
+
+      size_t input_size = ::std::distance(input, input_end);
+
+      assert((block_size > 0) && "block size should be positive.");
+      assert((block_size * static_cast<size_t>(comm_size) < static_cast<size_t>(mxx::max_int)) &&
+             "block size too large for MPI_Ialltoallv displacements");
+
+      // make sure tehre is something to do.
+      BL_BENCH_COLLECTIVE_START(idist, "empty", _comm);
+      bool empty = input_size == 0;
+      empty = mxx::all_of(empty);
+      BL_BENCH_END(idist, "empty", input_size);
+
+      if (empty) {
+        BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:batch_exch_mod", _comm);
+        return;
+      }
+
+      using V = typename ::std::iterator_traits<IT>::value_type;
+
+      // if there is comm size is 1.  no need to bucket.
+      if (comm_size == 1) {
+        BL_BENCH_COLLECTIVE_START(idist, "compute_1", _comm);
+        compute(0, &(*input), &(*input) + input_size);
+        BL_BENCH_END(idist, "compute_1", input_size);
+
+        BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:batch_exch_mod", _comm);
+        return;
+      }
+
+      // same number of blocks on all ranks, since the exchange is collective.
+      BL_BENCH_COLLECTIVE_START(idist, "nblocks", _comm);
+      size_t nblocks = (input_size + block_size - 1) / block_size;
+      nblocks = ::mxx::allreduce(nblocks, mxx::max<size_t>(), _comm);
+      BL_BENCH_END(idist, "nblocks", nblocks);
+
+      // setup the temporary storage.  double buffered for send, recv, and the counts.
+      BL_BENCH_START(idist);
+      V* sending[2];
+      sending[0] = ::utils::mem::aligned_alloc<V>(block_size << 1, 64);
+      sending[1] = sending[0] + block_size;
+      V* recving[2] = { nullptr, nullptr };
+      size_t recv_capacity[2] = { 0, 0 };
+
+      ::std::vector<size_t> bucket_sizes;
+      ::std::vector<int> send_counts[2], send_displs[2], recv_counts[2], recv_displs[2];
+      for (int j = 0; j < 2; ++j) {
+        send_counts[j].resize(comm_size, 0);
+        send_displs[j].resize(comm_size + 1, 0);
+        recv_counts[j].resize(comm_size, 0);
+        recv_displs[j].resize(comm_size + 1, 0);
+      }
+      BL_BENCH_END(idist, "alloc", block_size << 1);
+
+      // bucket block i into its send buffer, and get the recv counts.  the count exchange is blocking,
+      // and may be done while the previous block's ialltoallv is outstanding.
+      auto bucket = [&](size_t const & i) {
+        int j = i & 1;
+        IT b = input + ::std::min(input_size, i * block_size);
+        IT e = input + ::std::min(input_size, (i + 1) * block_size);
+
+        if (comm_size <= ::std::numeric_limits<uint8_t>::max())
+          ::khmxx::local::assign_and_permute(b, e, to_rank, static_cast<uint8_t>(comm_size), bucket_sizes, sending[j]);
+        else if (comm_size <= ::std::numeric_limits<uint16_t>::max())
+          ::khmxx::local::assign_and_permute(b, e, to_rank, static_cast<uint16_t>(comm_size), bucket_sizes, sending[j]);
+        else
+          ::khmxx::local::assign_and_permute(b, e, to_rank, static_cast<uint32_t>(comm_size), bucket_sizes, sending[j]);
+
+        // empty block returns no bucket sizes.
+        bucket_sizes.resize(comm_size, 0);
+        for (int r = 0; r < comm_size; ++r) {
+          send_counts[j][r] = static_cast<int>(bucket_sizes[r]);
+          send_displs[j][r + 1] = send_displs[j][r] + send_counts[j][r];
+        }
+
+        KHMXX_TRACE_START(t_counts);
+        MPI_Alltoall(send_counts[j].data(), 1, MPI_INT, recv_counts[j].data(), 1, MPI_INT, _comm);
+        KHMXX_TRACE_END(t_counts, "batched_ialltoallv_modify", wait, -1, 0);
+        for (int r = 0; r < comm_size; ++r) {
+          recv_displs[j][r + 1] = recv_displs[j][r] + recv_counts[j][r];
+        }
+
+        // recv buffer for this parity is free:  its previous block was computed in the last iteration.
+        size_t recv_size = recv_displs[j][comm_size];
+        if (recv_size > recv_capacity[j]) {
+          if (recving[j] != nullptr) free(recving[j]);
+          recv_capacity[j] = ::std::max(recv_size, block_size);
+          recving[j] = ::utils::mem::aligned_alloc<V>(recv_capacity[j], 64);
+        }
+      };
+
+      mxx::datatype dt = mxx::get_datatype<V>();
+      MPI_Request req;
+      int completed;
+      size_t total = 0;
+
+      BL_BENCH_COLLECTIVE_START(idist, "bucket_0", _comm);
+      bucket(0);
+      BL_BENCH_END(idist, "bucket_0", send_displs[0][comm_size]);
+
+      // iteration i:  post block i, bucket block i+1, compute block i-1, then wait for block i.
+      // the block i+1 bucket and count exchange uses parity of block i-1, so compute block i-1 goes first.
+      BL_BENCH_LOOP_START(idist, 0);
+      BL_BENCH_LOOP_START(idist, 1);
+      BL_BENCH_LOOP_START(idist, 2);
+      BL_BENCH_LOOP_START(idist, 3);
+
+      for (size_t i = 0; i <= nblocks; ++i) {
+        int j = i & 1;
+
+        BL_BENCH_LOOP_RESUME(idist, 0);
+        // one collective per block, so the block is traced with peer -1.
+        KHMXX_TRACE_START(t_flight);
+        if (i < nblocks) {
+          KHMXX_TRACE_START(t_post);
+          MPI_Ialltoallv(sending[j], send_counts[j].data(), send_displs[j].data(), dt.type(),
+                         recving[j], recv_counts[j].data(), recv_displs[j].data(), dt.type(),
+                         _comm, &req);
+          // kick start.
+          MPI_Test(&req, &completed, MPI_STATUS_IGNORE);
+          KHMXX_TRACE_END(t_post, "batched_ialltoallv_modify", post, -1, send_displs[j][comm_size] * sizeof(V));
+          // the same call posts the receive.  record its bytes, without counting the post time twice.
+          KHMXX_TRACE_START(t_recv);
+          KHMXX_TRACE_END(t_recv, "batched_ialltoallv_modify", post_recv, -1, recv_displs[j][comm_size] * sizeof(V));
+        }
+        BL_BENCH_LOOP_PAUSE(idist, 0);
+
+        BL_BENCH_LOOP_RESUME(idist, 1);
+        if (i > 0) {
+          int k = j ^ 1;
+          for (int r = 0; r < comm_size; ++r) {
+            if (recv_counts[k][r] == 0) continue;
+            KHMXX_TRACE_START(t_compute);
+            compute(r, recving[k] + recv_displs[k][r], recving[k] + recv_displs[k][r + 1]);
+            KHMXX_TRACE_END(t_compute, "batched_ialltoallv_modify", compute, r, recv_counts[k][r] * sizeof(V));
+          }
+          total += recv_displs[k][comm_size];
+        }
+        BL_BENCH_LOOP_PAUSE(idist, 1);
+
+        BL_BENCH_LOOP_RESUME(idist, 2);
+        if ((i + 1) < nblocks) {
+          bucket(i + 1);
+          MPI_Test(&req, &completed, MPI_STATUS_IGNORE);
+        }
+        BL_BENCH_LOOP_PAUSE(idist, 2);
+
+        BL_BENCH_LOOP_RESUME(idist, 3);
+        if (i < nblocks) {
+          KHMXX_TRACE_START(t_wait);
+          MPI_Wait(&req, MPI_STATUS_IGNORE);
+          KHMXX_TRACE_END(t_wait, "batched_ialltoallv_modify", wait, -1, 0);
+          KHMXX_TRACE_END(t_flight, "batched_ialltoallv_modify", inflight, -1, recv_displs[j][comm_size] * sizeof(V));
+        }
+        BL_BENCH_LOOP_PAUSE(idist, 3);
+      }
+      BL_BENCH_LOOP_END(idist, 0, "loop_ia2av", nblocks);
+      BL_BENCH_LOOP_END(idist, 1, "loop_compute", total);
+      BL_BENCH_LOOP_END(idist, 2, "loop_bucket", input_size);
+      BL_BENCH_LOOP_END(idist, 3, "loop_wait", nblocks);
+
+      BL_BENCH_START(idist);
+      free(sending[0]);
+      if (recving[0] != nullptr) free(recving[0]);
+      if (recving[1] != nullptr) free(recving[1]);
+      BL_BENCH_END(idist, "cleanup", recv_capacity[0] + recv_capacity[1]);
+
+      BL_BENCH_REPORT_MPI_NAMED(idist, "khmxx:batch_exch_mod", _comm);
+    }
+
+
+    //============= persistent query session.
+    // a query service calls count or find many times with small, similar batches.  each ialltoallv_and_query_one_to_one
+    // call then pays an emptiness allreduce, a count alltoall, buffer allocation, and request creation before any query moves.
+    // a query_session creates persistent receives (MPI_Recv_init) on preallocated per-peer buffers once, and a batch only
+    // restarts them.  every message is at most one block, with a header holding the element count and a last-block flag,
+    // so counts are not exchanged:  a peer with more than a block's worth sends several blocks, and a peer with nothing sends
+    // one empty block.  a persistent send would always move its full initial count, so sends are MPI_Isend of the used
+    // prefix (header + payload) from the preallocated buffers instead;  the receiver reads the element count from the header.
+
+    /// persistent requests and buffers for repeated one-to-one query batches.  every rank must create the session with
+    /// the same block_bytes and make the same sequence of query_one_to_one calls.  the comm must outlive the session.
+    class query_session {
+      protected:
+        static constexpr int query_tag = 1789;
+        static constexpr int response_tag = 1791;
+        /// header, padded so the payload is cache line aligned.  element count, with the last block flag in the top bit.
+        static constexpr size_t header_size = 64;
+        static constexpr uint64_t last_flag = 0x1ULL << 63;
+
+        // request / buffer kinds, one each per peer.
+        enum { query_send = 0, query_recv = 1, response_send = 2, response_recv = 3 };
+
+        ::mxx::comm const & comm;
+        int comm_size;
+        int comm_rank;
+
+        size_t block_bytes;
+        size_t message_bytes;
+        unsigned char * buffers;
+        /// kind major.  self entries are MPI_REQUEST_NULL.  receives are persistent, sends are MPI_REQUEST_NULL when idle.
+        ::std::vector<MPI_Request> reqs;
+
+        inline unsigned char * buffer(int const & kind, int const & peer) {
+          return buffers + static_cast<size_t>(kind * comm_size + peer) * message_bytes;
+        }
+        inline uint64_t & header(int const & kind, int const & peer) {
+          return *(reinterpret_cast<uint64_t*>(buffer(kind, peer)));
+        }
+
+      public:
+        query_session(::mxx::comm const & _comm, size_t const & _block_bytes = (0x1UL << 12)) :
+          comm(_comm), comm_size(_comm.size()), comm_rank(_comm.rank()),
+          block_bytes((_block_bytes + header_size - 1) & ~(header_size - 1)), buffers(nullptr),
+          reqs(4 * _comm.size(), MPI_REQUEST_NULL) {
+
+          if (block_bytes == 0) block_bytes = header_size;
+          message_bytes = header_size + block_bytes;
+          if (message_bytes > static_cast<size_t>(::std::numeric_limits<int>::max()))
+            throw std::invalid_argument("query_session block_bytes exceeds MPI int count.");
+
+          if (comm_size == 1) return;
+
+          buffers = ::utils::mem::aligned_alloc<unsigned char>(4 * comm_size * message_bytes);
+
+          int bytes = static_cast<int>(message_bytes);
+          for (int i = 0; i < comm_size; ++i) {
+            if (i == comm_rank) continue;
+            MPI_Recv_init(buffer(query_recv, i), bytes, MPI_BYTE, i, query_tag, comm, &(reqs[query_recv * comm_size + i]));
+            MPI_Recv_init(buffer(response_recv, i), bytes, MPI_BYTE, i, response_tag, comm, &(reqs[response_recv * comm_size + i]));
+          }
+        }
+
+        query_session(query_session const & other) = delete;
+        query_session& operator=(query_session const & other) = delete;
+
+        ~query_session() {
+          for (size_t i = 0; i < reqs.size(); ++i) {
+            if (reqs[i] != MPI_REQUEST_NULL) MPI_Request_free(&(reqs[i]));
+          }
+          if (buffers != nullptr) free(buffers);
+        }
+
+        inline size_t get_block_bytes() const { return block_bytes; }
+
+        /// one-to-one query of a bucketed batch, as ialltoallv_and_query_one_to_one.  result[i] is the response to permuted[i].
+        /// compute(int src_rank, V* b, V* e, U* out).  V and U must be trivially copyable.
+        template <typename IT, typename SIZE, typename OP, typename OT,
+        typename ::std::enable_if<::std::is_same<typename ::std::iterator_traits<IT>::iterator_category,
+        ::std::random_access_iterator_tag >::value &&
+         ::std::is_same<typename ::std::iterator_traits<OT>::iterator_category,
+          ::std::random_access_iterator_tag >::value, int>::type = 1>
+        void query_one_to_one(IT permuted, IT permuted_end,
+                              ::std::vector<SIZE> const & send_counts,
+                              OP compute,
+                              OT result) {
+          using V = typename ::std::iterator_traits<IT>::value_type;
+          using U = typename ::std::iterator_traits<OT>::value_type;
+
+          BL_BENCH_INIT(qsess);
+          KHMXX_TRACE_CALL("query_session");
+
+          size_t input_size = ::std::distance(permuted, permuted_end);
+          assert((send_counts.size() == static_cast<size_t>(comm_size)) && "send_count size not same as _comm size.");
+
+          if (comm_size == 1) {
+            BL_BENCH_START(qsess);
+            if (input_size > 0) compute(0, &(*permuted), &(*permuted) + input_size, &(*result));
+            BL_BENCH_END(qsess, "compute_1", input_size);
+
+            BL_BENCH_REPORT_MPI_NAMED(qsess, "khmxx:query_session", comm);
+            return;
+          }
+
+          size_t per_block = ::std::min(block_bytes / sizeof(V), block_bytes / sizeof(U));
+          if (per_block == 0) throw std::invalid_argument("query_session block_bytes smaller than one element.");
+
+          BL_BENCH_START(qsess);
+          ::std::vector<size_t> send_displs(comm_size, 0);
+          for (int i = 1; i < comm_size; ++i) send_displs[i] = send_displs[i - 1] + send_counts[i - 1];
+
+          ::std::vector<size_t> sent(comm_size, 0);
+          ::std::vector<size_t> received(comm_size, 0);
+          ::std::vector<uint8_t> sent_last(comm_size, 0);
+          ::std::vector<uint8_t> responding(comm_size, 0);   // response send in flight
+          ::std::vector<uint8_t> pending(comm_size, 0);      // query block received, response buffer busy
+
+          // pack and send the next query block to peer.
+          auto send_next = [&](int const & peer) {
+            size_t n = ::std::min(per_block, static_cast<size_t>(send_counts[peer]) - sent[peer]);
+            V* out = reinterpret_cast<V*>(buffer(query_send, peer) + header_size);
+            ::std::copy(permuted + send_displs[peer] + sent[peer], permuted + send_displs[peer] + sent[peer] + n, out);
+            sent[peer] += n;
+            sent_last[peer] = (sent[peer] == static_cast<size_t>(send_counts[peer]));
+            header(query_send, peer) = n | (sent_last[peer] ? last_flag : 0);
+            KHMXX_TRACE_START(t_post);
+            MPI_Isend(buffer(query_send, peer), static_cast<int>(header_size + n * sizeof(V)), MPI_BYTE, peer, query_tag,
+                      comm, &(reqs[query_send * comm_size + peer]));
+            KHMXX_TRACE_END(t_post, "query_session", post, peer, header_size + n * sizeof(V));
+          };
+          // answer a received query block.  the response carries the query header, so the requester sees the last flag.
+          auto respond = [&](int const & peer) {
+            uint64_t hdr = header(query_recv, peer);
+            size_t n = hdr & ~last_flag;
+            V* in = reinterpret_cast<V*>(buffer(query_recv, peer) + header_size);
+            if (n > 0) {
+              KHMXX_TRACE_START(t_compute);
+              compute(peer, in, in + n, reinterpret_cast<U*>(buffer(response_send, peer) + header_size));
+              KHMXX_TRACE_END(t_compute, "query_session", compute, peer, n * sizeof(V));
+            }
+            header(response_send, peer) = hdr;
+            KHMXX_TRACE_START(t_post);
+            MPI_Isend(buffer(response_send, peer), static_cast<int>(header_size + n * sizeof(U)), MPI_BYTE, peer, response_tag,
+                      comm, &(reqs[response_send * comm_size + peer]));
+            KHMXX_TRACE_END(t_post, "query_session", post, peer, header_size + n * sizeof(U));
+            responding[peer] = 1;
+            if ((hdr & last_flag) == 0) {
+              KHMXX_TRACE_START(t_post_recv);
+              MPI_Start(&(reqs[query_recv * comm_size + peer]));
+              KHMXX_TRACE_END(t_post_recv, "query_session", post_recv, peer, 0);
+            }
+          };
+          BL_BENCH_END(qsess, "setup", per_block);
+
+          // post receives first, then the first query blocks, starting with the next rank.
+          // a persistent receive has no size until it completes, so received bytes are traced on the inflight events.
+          // every receive is restarted as soon as it completes, so they are in flight from here to their completion.
+          BL_BENCH_START(qsess);
+          KHMXX_TRACE_START(t_flight);
+          for (int i = 1; i < comm_size; ++i) {
+            int peer = (comm_rank + i) % comm_size;
+            KHMXX_TRACE_START(t_post_recv);
+            MPI_Start(&(reqs[query_recv * comm_size + peer]));
+            MPI_Start(&(reqs[response_recv * comm_size + peer]));
+            KHMXX_TRACE_END(t_post_recv, "query_session", post_recv, peer, 0);
+          }
+          for (int i = 1; i < comm_size; ++i) {
+            send_next((comm_rank + i) % comm_size);
+          }
+          BL_BENCH_END(qsess, "start", comm_size);
+
+          // local part while the first blocks are in flight.
+          BL_BENCH_START(qsess);
+          KHMXX_TRACE_START(t_self);
+          if (send_counts[comm_rank] > 0)
+            compute(comm_rank, &(*(permuted + send_displs[comm_rank])),
+                    &(*(permuted + send_displs[comm_rank])) + send_counts[comm_rank],
+                    &(*(result + send_displs[comm_rank])));
+          KHMXX_TRACE_END(t_self, "query_session", compute, comm_rank, send_counts[comm_rank] * sizeof(V));
+          received[comm_rank] = send_counts[comm_rank];
+          BL_BENCH_END(qsess, "compute_self", send_counts[comm_rank]);
+
+          // completed persistent requests become inactive and completed sends become MPI_REQUEST_NULL.  both are ignored,
+          // so this ends when nothing is left.
+          BL_BENCH_START(qsess);
+          ::std::vector<int> indices(reqs.size());
+          int outcount = 0;
+          size_t blocks = 0;
+          while (true) {
+            KHMXX_TRACE_START(t_wait);
+            MPI_Waitsome(static_cast<int>(reqs.size()), reqs.data(), &outcount, indices.data(), MPI_STATUSES_IGNORE);
+            KHMXX_TRACE_END(t_wait, "query_session", wait, -1, 0);
+            if (outcount == MPI_UNDEFINED) break;
+
+            for (int k = 0; k < outcount; ++k) {
+              int kind = indices[k] / comm_size;
+              int peer = indices[k] % comm_size;
+              switch (kind) {
+                case query_send:
+                  if (!sent_last[peer]) send_next(peer);
+                  break;
+                case query_recv:
+                  KHMXX_TRACE_END(t_flight, "query_session", inflight, peer, header_size + (header(query_recv, peer) & ~last_flag) * sizeof(V));
+                  if (responding[peer]) pending[peer] = 1;
+                  else respond(peer);
+                  ++blocks;
+                  break;
+                case response_send:
+                  responding[peer] = 0;
+                  if (pending[peer]) {
+                    pending[peer] = 0;
+                    respond(peer);
+                  }
+                  break;
+                case response_recv:
+                {
+                  uint64_t hdr = header(response_recv, peer);
+                  size_t n = hdr & ~last_flag;
+                  U* in = reinterpret_cast<U*>(buffer(response_recv, peer) + header_size);
+                  KHMXX_TRACE_END(t_flight, "query_session", inflight, peer, header_size + n * sizeof(U));
+                  ::std::copy(in, in + n, result + send_displs[peer] + received[peer]);
+                  received[peer] += n;
+                  if ((hdr & last_flag) == 0) {
+                    KHMXX_TRACE_START(t_post_recv);
+                    MPI_Start(&(reqs[response_recv * comm_size + peer]));
+                    KHMXX_TRACE_END(t_post_recv, "query_session", post_recv, peer, 0);
+                  }
+                }
+                  break;
+                default:
+                  break;
+              }
+            }
+          }
+          BL_BENCH_END(qsess, "exchange", blocks);
+
+          assert(::std::equal(received.begin(), received.end(), send_counts.begin()) && "query_session: missing responses.");
+
+          BL_BENCH_REPORT_MPI_NAMED(qsess, "khmxx:query_session", comm);
+        }
+    };
+
+
+    //============= one-sided (RMA) exchange.
+    // the exchanges above are collective per batch:  every rank waits for every other rank before the batch is done.
+    // the mailbox below uses MPI-3 passive target RMA instead.  each rank exposes one ring buffer per source rank in a window.
+    // a source MPI_Puts its elements into its ring on the target and then publishes the new tail atomically;  the target
+    // drains its rings whenever it likes (between its own batches) and publishes the new head.  ranks can insert
+    // different numbers of batches, at different times, and only synchronize at the end (finish).
+    // a source blocked on a full ring keeps draining its own rings, so two ranks sending to each other always progress.
+
+    /// per-source ring buffers in an MPI window, for asynchronous modify.  V must be trivially copyable.
+    /// construction, finish, and destruction are collective.  put and drain are not.
+    /// counters are monotonic element counts;  the ring position is count % capacity.
+    template <typename V>
+    class rma_mailbox {
+      protected:
+        /// header per ring:  [tail (written by source)][head (written by owner)], padded to a cache line.
+        static constexpr size_t header_size = 64;
+
+        MPI_Comm comm;
+        int comm_size;
+        int comm_rank;
+
+        MPI_Win win;
+        unsigned char * base;
+        /// elements per ring.
+        size_t capacity;
+        /// bytes per ring, including header.
+        size_t region_size;
+
+        /// produced count per target (local copy of the remote tail).
+        ::std::vector<uint64_t> produced;
+        /// last seen remote head per target.
+        ::std::vector<uint64_t> acked;
+        /// consumed count per source (local copy of own head).
+        ::std::vector<uint64_t> consumed;
+
+        inline MPI_Aint tail_disp(int const & src) const { return static_cast<MPI_Aint>(src) * region_size; }
+        inline MPI_Aint head_disp(int const & src) const { return tail_disp(src) + sizeof(uint64_t); }
+        inline MPI_Aint data_disp(int const & src) const { return tail_disp(src) + header_size; }
+
+        /// atomic read of a counter in rank's window.
+        inline uint64_t read_counter(int const & rank, MPI_Aint const & disp) {
+          uint64_t dummy = 0, result = 0;
+          MPI_Fetch_and_op(&dummy, &result, MPI_UINT64_T, rank, disp, MPI_NO_OP, win);
+          MPI_Win_flush(rank, win);
+          return result;
+        }
+
+        /// atomic write of a counter in rank's window.  completes before returning.
+        inline void write_counter(int const & rank, MPI_Aint const & disp, uint64_t const & val) {
+          uint64_t result = 0;
+          MPI_Fetch_and_op(&val, &result, MPI_UINT64_T, rank, disp, MPI_REPLACE, win);
+          MPI_Win_flush(rank, win);
+        }
+
+      public:
+        /// collective.  _capacity elements per (source, target) ring.
+        rma_mailbox(::mxx::comm const & _comm, size_t const & _capacity = (0x1UL << 16)) :
+          comm(_comm), comm_size(_comm.size()), comm_rank(_comm.rank()), win(MPI_WIN_NULL), base(nullptr),
+          capacity(_capacity == 0 ? 1 : _capacity),
+          produced(_comm.size(), 0), acked(_comm.size(), 0), consumed(_comm.size(), 0) {
+
+          // a put is at most one ring, and MPI counts are int.
+          if (capacity * sizeof(V) > static_cast<size_t>(::std::numeric_limits<int>::max()))
+            capacity = static_cast<size_t>(::std::numeric_limits<int>::max()) / sizeof(V);
+          region_size = (header_size + capacity * sizeof(V) + header_size - 1) & ~(header_size - 1);
+
+          MPI_Win_allocate(static_cast<MPI_Aint>(region_size * comm_size), 1, MPI_INFO_NULL, comm, &base, &win);
+          memset(base, 0, region_size * comm_size);
+
+          // one passive target epoch for the lifetime of the mailbox.  barrier so no one writes before the counters are zeroed.
+          MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+          MPI_Barrier(comm);
+        }
+
+        rma_mailbox(rma_mailbox const & other) = delete;
+        rma_mailbox& operator=(rma_mailbox const & other) = delete;
+
+        /// collective.
+        ~rma_mailbox() {
+          if (win != MPI_WIN_NULL) {
+            MPI_Win_unlock_all(win);
+            MPI_Win_free(&win);
+          }
+        }
+
+        inline size_t get_capacity() const { return capacity; }
+
+        /// consume everything that has arrived.  compute(int src_rank, V* b, V* e) is called per contiguous span.
+        /// returns the number of elements consumed.
+        template <typename OP>
+        size_t drain(OP compute) {
+          size_t total = 0;
+          for (int i = 1; i < comm_size; ++i) {
+            int src = (comm_rank + i) % comm_size;
+
+            uint64_t tail = read_counter(comm_rank, tail_disp(src));
+            if (tail == consumed[src]) continue;
+
+            // make the put data visible in the private copy of the window.
+            MPI_Win_sync(win);
+
+            V* ring = reinterpret_cast<V*>(base + data_disp(src));
+            while (consumed[src] < tail) {
+              size_t pos = consumed[src] % capacity;
+              size_t len = ::std::min(static_cast<size_t>(tail - consumed[src]), capacity - pos);
+              KHMXX_TRACE_START(t_compute);
+              compute(src, ring + pos, ring + pos + len);
+              KHMXX_TRACE_END(t_compute, "rma_mailbox", compute, src, len * sizeof(V));
+              consumed[src] += len;
+              total += len;
+            }
+
+            // release the space to the source.
+            write_counter(comm_rank, head_disp(src), consumed[src]);
+          }
+          return total;
+        }
+
+        /// send [b, e) to target.  data for self goes to compute directly.  blocks while the target's ring is full,
+        /// draining own rings with compute meanwhile.
+        template <typename OP>
+        void put(int const & target, V* b, V* e, OP compute) {
+          if (b == e) return;
+          KHMXX_TRACE_CALL("rma_mailbox");
+          if (target == comm_rank) {
+            compute(comm_rank, b, e);
+            return;
+          }
+
+          size_t n = ::std::distance(b, e);
+          while (n > 0) {
+            size_t used = produced[target] - acked[target];
+            if (used >= capacity) {
+              KHMXX_TRACE_START(t_wait);
+              acked[target] = read_counter(target, head_disp(comm_rank));
+              KHMXX_TRACE_END(t_wait, "rma_mailbox", wait, target, 0);
+              if ((produced[target] - acked[target]) >= capacity) drain(compute);
+              continue;
+            }
+
+            size_t pos = produced[target] % capacity;
+            size_t len = ::std::min(n, ::std::min(capacity - used, capacity - pos));
+            int bytes = static_cast<int>(len * sizeof(V));
+            // a put completes before returning, so it is traced as one post.
+            KHMXX_TRACE_START(t_post);
+            MPI_Put(b, bytes, MPI_BYTE, target, data_disp(comm_rank) + pos * sizeof(V), bytes, MPI_BYTE, win);
+            // data must be complete at the target before the tail says so.
+            MPI_Win_flush(target, win);
+
+            produced[target] += len;
+            write_counter(target, tail_disp(comm_rank), produced[target]);
+            KHMXX_TRACE_END(t_post, "rma_mailbox", post, target, bytes);
+
+            b += len;
+            n -= len;
+          }
+        }
+
+        /// collective.  drain until every rank has finished putting, then drain the rest.  the mailbox can be reused after.
+        template <typename OP>
+        size_t finish(OP compute) {
+          KHMXX_TRACE_CALL("rma_mailbox");
+          // all puts from this rank are complete at their targets (flushed) before the barrier is entered.
+          MPI_Request req;
+          MPI_Ibarrier(comm, &req);
+          size_t total = 0;
+          int done = 0;
+          while (!done) {
+            total += drain(compute);
+            MPI_Test(&req, &done, MPI_STATUS_IGNORE);
+          }
+          total += drain(compute);
+          return total;
+        }
+    };
+
   } // namespace incremental
 
 
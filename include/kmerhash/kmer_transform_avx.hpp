@@ -0,0 +1,231 @@
+/*
+ * Copyright 2017 Georgia Institute of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file    kmer_transform_avx.hpp
+ * @ingroup fsc::hash
+ * @author  tpan
+ * @brief   batched canonicalization transforms (lex_less, xor_rev_comp) for use as PreTransform in TransformedHash.
+ * @details bliss::kmer::transform::lex_less and xor_rev_comp compute reverse complement one k-mer at a time,
+ *          so in TransformedHash the scalar canonicalization runs before the SIMD hash and can dominate.
+ *          the transforms here provide the batch operator (in, count, out) that TransformedHash prefers, and
+ *          for 2-bit DNA k-mers stored in a single 64 bit word (K <= 32) compute reverse complement of
+ *          4 k-mers per AVX2 register:
+ *            complement is bitwise not,
+ *            reversing the 2-bit characters within each byte is 2 nibble table lookups (pshufb),
+ *            reversing the bytes within each 64 bit word is 1 pshufb,
+ *            and a right shift by (64 - 2K) aligns the result.
+ *          other k-mer types fall back to the bliss scalar transform, element by element.
+ *
+ *          the single element operator is inherited from the bliss transform, so results are identical.
+ */
+#ifndef KMER_TRANSFORM_AVX_HPP_
+#define KMER_TRANSFORM_AVX_HPP_
+
+#include <type_traits>
+#include <cstdint>
+
+#include <x86intrin.h>
+
+#include "common/kmer.hpp"
+#include "common/alphabets.hpp"
+#include "common/kmer_transform.hpp"
+
+#ifndef FSC_FORCE_INLINE
+
+#if defined(_MSC_VER)
+
+#define FSC_FORCE_INLINE __forceinline
+
+// Other compilers
+
+#else // defined(_MSC_VER)
+
+#define FSC_FORCE_INLINE inline __attribute__((always_inline))
+
+#endif // !defined(_MSC_VER)
+
+#endif
+
+namespace fsc
+{
+
+namespace kmer
+{
+
+namespace transform
+{
+
+namespace detail
+{
+
+/// reverse complement of a 2-bit DNA k-mer in a 64 bit word, K <= 32.  complement of 2-bit DNA is bitwise not.
+template <unsigned int K>
+FSC_FORCE_INLINE uint64_t revcomp_dna64(uint64_t x)
+{
+  static_assert((K > 0) && (K <= 32), "single word DNA k-mer should have 0 < K <= 32");
+
+  x = ~x;
+  // reverse the 2-bit groups.
+  x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+  x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+  x = __builtin_bswap64(x);
+  return x >> (64 - 2 * K);
+}
+
+#if defined(__AVX2__)
+/// reverse complement of 4 2-bit DNA k-mers, one per 64 bit lane, K <= 32.
+template <unsigned int K>
+FSC_FORCE_INLINE __m256i revcomp_dna64_avx2(__m256i const & x)
+{
+  // reversed 2-bit groups in a nibble (ab -> ba), in the high nibble for the low nibble lookup and vice versa.
+  const __m256i lut_lo = _mm256_setr_epi8(0x00, 0x40, (char)0x80, (char)0xC0, 0x10, 0x50, (char)0x90, (char)0xD0,
+                                          0x20, 0x60, (char)0xA0, (char)0xE0, 0x30, 0x70, (char)0xB0, (char)0xF0,
+                                          0x00, 0x40, (char)0x80, (char)0xC0, 0x10, 0x50, (char)0x90, (char)0xD0,
+                                          0x20, 0x60, (char)0xA0, (char)0xE0, 0x30, 0x70, (char)0xB0, (char)0xF0);
+  const __m256i lut_hi = _mm256_setr_epi8(0x0, 0x4, 0x8, 0xC, 0x1, 0x5, 0x9, 0xD, 0x2, 0x6, 0xA, 0xE, 0x3, 0x7, 0xB, 0xF,
+                                          0x0, 0x4, 0x8, 0xC, 0x1, 0x5, 0x9, 0xD, 0x2, 0x6, 0xA, 0xE, 0x3, 0x7, 0xB, 0xF);
+  // reverse bytes in each 64 bit lane.
+  const __m256i bswap = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                         7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+
+  __m256i y = _mm256_xor_si256(x, _mm256_set1_epi64x(-1LL));  // complement
+  __m256i lo = _mm256_and_si256(y, nibble_mask);
+  __m256i hi = _mm256_and_si256(_mm256_srli_epi16(y, 4), nibble_mask);
+  y = _mm256_or_si256(_mm256_shuffle_epi8(lut_lo, lo), _mm256_shuffle_epi8(lut_hi, hi));
+  y = _mm256_shuffle_epi8(y, bswap);
+  return _mm256_srli_epi64(y, 64 - 2 * K);
+}
+
+/// unsigned 64 bit min.  AVX2 only has signed 64 bit compare, so flip the sign bits when K == 32.
+template <unsigned int K>
+FSC_FORCE_INLINE __m256i min_epu64_avx2(__m256i const & a, __m256i const & b)
+{
+  __m256i gt;
+  if (K < 32)
+  { // msb is always 0.
+    gt = _mm256_cmpgt_epi64(a, b);
+  }
+  else
+  {
+    const __m256i sign = _mm256_set1_epi64x(0x8000000000000000LL);
+    gt = _mm256_cmpgt_epi64(_mm256_xor_si256(a, sign), _mm256_xor_si256(b, sign));
+  }
+  return _mm256_blendv_epi8(a, b, gt);
+}
+#endif
+
+/// batched canonicalization for single word DNA k-mers.  in and out may be the same.
+template <unsigned int K, bool XOR>
+struct canonical_dna64
+{
+  static constexpr size_t batch_size = 4;
+
+  FSC_FORCE_INLINE void operator()(uint64_t const *in, size_t const &count, uint64_t *out) const
+  {
+    size_t i = 0;
+#if defined(__AVX2__)
+    size_t max = count - (count & (batch_size - 1));
+    __m256i x, rc;
+    for (; i < max; i += batch_size)
+    {
+      x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(in + i));
+      rc = revcomp_dna64_avx2<K>(x);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+                          XOR ? _mm256_xor_si256(x, rc) : min_epu64_avx2<K>(x, rc));
+    }
+#endif
+    // rest
+    uint64_t rc1;
+    for (; i < count; ++i)
+    {
+      rc1 = revcomp_dna64<K>(in[i]);
+      out[i] = XOR ? (in[i] ^ rc1) : ((in[i] < rc1) ? in[i] : rc1);
+    }
+  }
+};
+
+/// check if KMER is a 2-bit DNA k-mer in a single 64 bit word.
+template <typename KMER>
+struct is_dna64_kmer : public ::std::false_type
+{
+};
+template <unsigned int K>
+struct is_dna64_kmer<::bliss::common::Kmer<K, ::bliss::common::DNA, uint64_t> >
+    : public ::std::integral_constant<bool, (K <= 32) && (sizeof(::bliss::common::Kmer<K, ::bliss::common::DNA, uint64_t>) == sizeof(uint64_t))>
+{
+};
+
+} // namespace detail
+
+/// batched lex_less.  same results as ::bliss::kmer::transform::lex_less, SIMD for single word DNA k-mers.
+template <typename KMER>
+struct lex_less : public ::bliss::kmer::transform::lex_less<KMER>
+{
+  static constexpr size_t batch_size = 4;
+
+  using ::bliss::kmer::transform::lex_less<KMER>::operator();
+
+  template <typename KM = KMER, typename ::std::enable_if<::fsc::kmer::transform::detail::is_dna64_kmer<KM>::value, int>::type = 1>
+  FSC_FORCE_INLINE void operator()(KMER const *in, size_t const &count, KMER *out) const
+  {
+    ::fsc::kmer::transform::detail::canonical_dna64<KMER::size, false>()(
+        reinterpret_cast<uint64_t const *>(in), count, reinterpret_cast<uint64_t *>(out));
+  }
+
+  template <typename KM = KMER, typename ::std::enable_if<!::fsc::kmer::transform::detail::is_dna64_kmer<KM>::value, int>::type = 1>
+  FSC_FORCE_INLINE void operator()(KMER const *in, size_t const &count, KMER *out) const
+  {
+    for (size_t i = 0; i < count; ++i)
+      out[i] = this->operator()(in[i]);
+  }
+};
+template <typename KMER>
+constexpr size_t lex_less<KMER>::batch_size;
+
+/// batched xor_rev_comp.  same results as ::bliss::kmer::transform::xor_rev_comp, SIMD for single word DNA k-mers.
+template <typename KMER>
+struct xor_rev_comp : public ::bliss::kmer::transform::xor_rev_comp<KMER>
+{
+  static constexpr size_t batch_size = 4;
+
+  using ::bliss::kmer::transform::xor_rev_comp<KMER>::operator();
+
+  template <typename KM = KMER, typename ::std::enable_if<::fsc::kmer::transform::detail::is_dna64_kmer<KM>::value, int>::type = 1>
+  FSC_FORCE_INLINE void operator()(KMER const *in, size_t const &count, KMER *out) const
+  {
+    ::fsc::kmer::transform::detail::canonical_dna64<KMER::size, true>()(
+        reinterpret_cast<uint64_t const *>(in), count, reinterpret_cast<uint64_t *>(out));
+  }
+
+  template <typename KM = KMER, typename ::std::enable_if<!::fsc::kmer::transform::detail::is_dna64_kmer<KM>::value, int>::type = 1>
+  FSC_FORCE_INLINE void operator()(KMER const *in, size_t const &count, KMER *out) const
+  {
+    for (size_t i = 0; i < count; ++i)
+      out[i] = this->operator()(in[i]);
+  }
+};
+template <typename KMER>
+constexpr size_t xor_rev_comp<KMER>::batch_size;
+
+} // namespace transform
+
+} // namespace kmer
+
+} // namespace fsc
+
+#endif /* KMER_TRANSFORM_AVX_HPP_ */
@@ -181,6 +181,7 @@ struct ReplaceReducer {
  *  [ ] faster insertion in batch
  *  [ ] faster find?
  *  [x] estimate distinct element counts in input.
+ *  [x] estimator precision as template parameter, HLLPrecision (std::integral_constant<uint8_t, p>), default 12.
  *
  *  [ ] verify that iterator returned has correct data offset and info offset (which are different)
  *
@@ -197,7 +198,8 @@ template <typename Key, typename T,
 		template <typename> class Hash = ::std::hash,
 		template <typename> class Equal = ::std::equal_to,
 		typename Reducer = ::fsc::DiscardReducer,
-		typename Allocator = ::std::allocator<std::pair<const Key, T> >
+		typename Allocator = ::std::allocator<std::pair<const Key, T> >,
+		typename HLLPrecision = ::std::integral_constant<uint8_t, 12U>
 		>
 class hashmap_robinhood_offsets_reduction {
 
@@ -210,6 +212,7 @@ public:
 	using hasher                = Hash<Key>;
 	using key_equal             = Equal<Key>;
 	using reducer               = Reducer;
+	using hll_type              = hyperloglog64<key_type, hasher, HLLPrecision::value>;
 
 protected:
 
@@ -288,7 +291,9 @@ protected:
 
 	using container_type		= value_type*;
 	using info_container_type	= ::std::vector<info_type, Allocator>;
-	hyperloglog64<key_type, hasher, 12> hll;  // precision of 12bits  error rate : 1.04/(2^6)
+	hll_type hll;  // default precision of 12bits  error rate : 1.04/(2^6)
+	hll_growth_predictor hll_growth;  // the estimator is cumulative across insert calls.  reserve for the next call too.
+	size_t exact_count_threshold;     // batches smaller than this are counted exactly instead of via the hll estimate.
 
 
 public:
@@ -411,6 +416,7 @@ public:
 			uint8_t const & _query_lookahead = 8) :
 			INSERT_LOOKAHEAD(_insert_lookahead), QUERY_LOOKAHEAD(_query_lookahead),
 			INSERT_LOOKAHEAD_MASK(_insert_lookahead * 2 - 1), QUERY_LOOKAHEAD_MASK(_query_lookahead * 2 - 1),
+			exact_count_threshold(0x1UL << 16),
 			lsize(0), buckets(next_power_of_2(_capacity)), mask(buckets - 1),
 #if defined (REPROBE_STAT)
 			upsize_count(0), downsize_count(0),
@@ -454,7 +460,7 @@ public:
 		QUERY_LOOKAHEAD(other.QUERY_LOOKAHEAD),
 		INSERT_LOOKAHEAD_MASK(other.INSERT_LOOKAHEAD_MASK),
 		QUERY_LOOKAHEAD_MASK(other.QUERY_LOOKAHEAD_MASK),
-		hll(other.hll),
+		hll(other.hll), hll_growth(other.hll_growth), exact_count_threshold(other.exact_count_threshold),
 		lsize(other.lsize),
 		buckets(other.buckets),
 		mask(other.mask),
@@ -490,6 +496,8 @@ public:
 		INSERT_LOOKAHEAD_MASK = other.INSERT_LOOKAHEAD_MASK;
 		QUERY_LOOKAHEAD_MASK = other.QUERY_LOOKAHEAD_MASK;
 		hll = other.hll;
+		hll_growth = other.hll_growth;
+		exact_count_threshold = other.exact_count_threshold;
 		lsize = other.lsize;
 		buckets = other.buckets;
 		mask = other.mask;
@@ -526,7 +534,7 @@ public:
 		INSERT_LOOKAHEAD_MASK(std::move(other.INSERT_LOOKAHEAD_MASK)),
 		QUERY_LOOKAHEAD_MASK(std::move(other.QUERY_LOOKAHEAD_MASK)),
 
-		hll(std::move(other.hll)),
+		hll(std::move(other.hll)), hll_growth(other.hll_growth), exact_count_threshold(other.exact_count_threshold),
 		lsize(std::move(other.lsize)),
 		buckets(std::move(other.buckets)),
 		mask(std::move(other.mask)),
@@ -562,6 +570,8 @@ public:
 		QUERY_LOOKAHEAD_MASK = std::move(other.QUERY_LOOKAHEAD_MASK);
 
 		hll = std::move(other.hll);
+		hll_growth = other.hll_growth;
+		exact_count_threshold = other.exact_count_threshold;
 		lsize = std::move(other.lsize);
 		buckets = std::move(other.buckets);
 		mask = std::move(other.mask);
@@ -596,6 +606,8 @@ public:
 		std::swap(INSERT_LOOKAHEAD_MASK, other.INSERT_LOOKAHEAD_MASK);
 		std::swap(QUERY_LOOKAHEAD_MASK, other.QUERY_LOOKAHEAD_MASK);
 		hll.swap(std::move(other.hll));
+		std::swap(hll_growth, other.hll_growth);
+		std::swap(exact_count_threshold, other.exact_count_threshold);
 		std::swap(lsize, other.lsize);
 		std::swap(buckets, other.buckets);
 		std::swap(mask, other.mask);
@@ -656,10 +668,45 @@ public:
 		this->hll.set_ignored_msb(ignore_msb);
 	}
 
-	inline hyperloglog64<key_type, hasher, 12>& get_hll() {
+	inline hll_type& get_hll() {
 		return this->hll;
 	}
 
+	/// number of insert calls to reserve ahead, based on the growth in estimated cardinality of the last call.  0 to disable.
+	inline void set_reserve_lookahead(double const & lookahead) {
+		this->hll_growth.set_lookahead(lookahead);
+	}
+
+	/// insert batches with fewer elements than this are counted exactly for reserve, instead of using the hll estimate.  0 to disable.
+	inline void set_exact_count_threshold(size_t const & threshold) {
+		this->exact_count_threshold = threshold;
+	}
+
+protected:
+	/// reserve before inserting a batch with the given hash values.  the hll must already include them.
+	/// nothing to do if the batch fits even when all of it is new.  small batches are then counted exactly:  the table
+	/// grows by at most the batch's distinct count, which is exact for an empty table.  if that still does not fit, or
+	/// the batch is large, reserve for the predicted hll estimate, padded by its error rate, with the exact bound capping
+	/// the current estimate.  the estimate is only computed here, so the growth is tracked between such batches.
+	template <typename HT>
+	inline void reserve_for_insert(HT const * hvals, size_t const & count) {
+		if ((lsize + count) <= max_load) return;
+
+		double bound = ::std::numeric_limits<double>::max();
+		if (count < exact_count_threshold) {
+			size_t exact = lsize + count_distinct_hashvals(hvals, count);
+			if (exact <= max_load) return;
+			bound = static_cast<double>(exact);
+		}
+
+		double est = this->hll.estimate();
+		double growth = this->hll_growth.predict(est) - est;
+		double padding = 1.0 + this->hll.est_error_rate;
+		this->reserve(static_cast<size_t>(::std::min(bound, est * padding) + growth * padding));
+	}
+
+public:
+
 
 	/**
 	 * @brief get the load factors.
@@ -2532,7 +2579,7 @@ protected:
 #endif
 			//#endif
 			// assume one element per bucket as ideal, resize now.  should not resize if don't need to.
-			this->reserve(static_cast<size_t>(static_cast<double>(this->hll.estimate()) * (1.0 + this->hll.est_error_rate)));   // this updates the bucket counts also.  overestimate by 10 percent just to be sure.
+			this->reserve_for_insert(hash_vals, input_size);   // this updates the bucket counts also.  overestimate by 10 percent just to be sure.
 		} else {
 			for (; i < max; i += hash.batch_size) {
 				for (j = 0; j < hash.batch_size; ++j, ++it) {
@@ -2607,7 +2654,7 @@ protected:
 #endif
 //#endif
 		  // assume one element per bucket as ideal, resize now.  should not resize if don't need to.
-		  this->reserve(static_cast<size_t>(static_cast<double>(this->hll.estimate()) * (1.0 + this->hll.est_error_rate)));
+		  this->reserve_for_insert(hash_vals, input_size);
 		}
   // this updates the bucket counts also.  overestimate by 10 percent just to be sure.
 
@@ -2679,7 +2726,7 @@ protected:
 #endif
 			//#endif
 			// assume one element per bucket as ideal, resize now.  should not resize if don't need to.
-			this->reserve(static_cast<size_t>(static_cast<double>(this->hll.estimate()) * (1.0 + this->hll.est_error_rate)));
+			this->reserve_for_insert(hash_vals, input_size);
 			// this updates the bucket counts also.  overestimate by 10 percent just to be sure.
 		} else {
 			for (; i < input_size; ++i, ++it) {
@@ -2747,7 +2794,7 @@ protected:
 #endif
 
 			// assume one element per bucket as ideal, resize now.  should not resize if don't need to.
-			this->reserve(static_cast<size_t>(static_cast<double>(this->hll.estimate()) * (1.0 + this->hll.est_error_rate)));
+			this->reserve_for_insert(hash_vals, input_size);
 			// this updates the bucket counts also.  overestimate by 10 percent just to be sure.
 		} else {
 			for (; i < input_size; ++i, ++it) {
@@ -2884,6 +2931,69 @@ public:
 		insert_no_estimate(input.data(), input.data() + input.size(), default_val);
 	}
 
+	// insert with precomputed hash values, hashes[i] == hasher()(begin[i]), e.g. computed by the caller for data distribution.
+	// no hashing is done here.  hash values remain valid across rehash since masking is done during insertion.
+	template <bool estimate = true>
+	void insert_by_hash(value_type const * begin, value_type const * end, hash_val_type const * hashes) {
+		size_t input_size = std::distance(begin, end);
+		if (input_size == 0) return;
+
+#if defined(REPROBE_STAT)
+		reset_reprobe_stats();
+		size_type before = lsize;
+#endif
+		if (estimate) {
+			this->hll.update_via_hashval(hashes, input_size);
+			this->reserve_for_insert(hashes, input_size);
+		}
+
+		size_t finished = 0;
+		do {
+			finished += insert_batch_by_hash(begin + finished, hashes + finished, input_size - finished);
+			if (finished < input_size)  {
+				std::cout << "rehashing to "  << (buckets <<1) << std::endl;
+				rehash(buckets << 1);  // failed to completely insert (overflow, or max_load).  need to rehash.
+			}
+		} while (finished < input_size);
+
+#if defined(REPROBE_STAT)
+		print_reprobe_stats("INSERT BY HASH", input_size, (lsize - before));
+#endif
+	}
+	template <bool estimate = true>
+	void insert_by_hash(key_type const * begin, key_type const * end, hash_val_type const * hashes, mapped_type const & default_val) {
+		size_t input_size = std::distance(begin, end);
+		if (input_size == 0) return;
+
+#if defined(REPROBE_STAT)
+		reset_reprobe_stats();
+		size_type before = lsize;
+#endif
+		if (estimate) {
+			this->hll.update_via_hashval(hashes, input_size);
+			this->reserve_for_insert(hashes, input_size);
+		}
+
+		auto converter = [&default_val](key_type const & x) {
+			return ::std::make_pair(x, default_val);
+		};
+		using trans_iter_type = ::bliss::iterator::transform_iterator<key_type const *, decltype(converter)>;
+		trans_iter_type local_start(begin, converter);
+
+		size_t finished = 0;
+		do {
+			finished += insert_batch_by_hash(local_start + finished, hashes + finished, input_size - finished);
+			if (finished < input_size)  {
+				std::cout << "rehashing to "  << (buckets <<1) << std::endl;
+				rehash(buckets << 1);  // failed to completely insert (overflow, or max_load).  need to rehash.
+			}
+		} while (finished < input_size);
+
+#if defined(REPROBE_STAT)
+		print_reprobe_stats("INSERT KEY BY HASH", input_size, (lsize - before));
+#endif
+	}
+
 protected:
 	inline value_type get_tuple(key_type const & key, mapped_type const & default_val = mapped_type()) const {
 		return ::std::make_pair(key, default_val);
@@ -4063,27 +4173,27 @@ public:
 
 };
 
-template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator >
-constexpr typename hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::info_type hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::info_empty;
-template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator >
-constexpr typename hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::info_type hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::info_mask;
-template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator >
-constexpr typename hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::info_type hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::info_normal;
-
-template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator >
-constexpr typename hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::bucket_id_type hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::bid_pos_mask;
-template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator >
-constexpr typename hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::bucket_id_type hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::bid_pos_exists;
-template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator >
-constexpr typename hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::bucket_id_type hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::insert_failed;
-template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator >
-constexpr typename hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::bucket_id_type hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::find_failed;
-template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator >
-constexpr typename hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::bucket_id_type hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::cache_align_mask;
-template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator >
-constexpr uint32_t hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::info_per_cacheline;
-template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator >
-constexpr uint32_t hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator>::value_per_cacheline;
+template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator, typename HLLPrecision >
+constexpr typename hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::info_type hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::info_empty;
+template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator, typename HLLPrecision >
+constexpr typename hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::info_type hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::info_mask;
+template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator, typename HLLPrecision >
+constexpr typename hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::info_type hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::info_normal;
+
+template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator, typename HLLPrecision >
+constexpr typename hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::bucket_id_type hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::bid_pos_mask;
+template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator, typename HLLPrecision >
+constexpr typename hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::bucket_id_type hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::bid_pos_exists;
+template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator, typename HLLPrecision >
+constexpr typename hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::bucket_id_type hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::insert_failed;
+template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator, typename HLLPrecision >
+constexpr typename hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::bucket_id_type hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::find_failed;
+template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator, typename HLLPrecision >
+constexpr typename hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::bucket_id_type hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::cache_align_mask;
+template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator, typename HLLPrecision >
+constexpr uint32_t hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::info_per_cacheline;
+template <typename Key, typename T, template <typename> class Hash, template <typename> class Equal, typename Reducer, typename Allocator, typename HLLPrecision >
+constexpr uint32_t hashmap_robinhood_offsets_reduction<Key, T, Hash, Equal, Reducer, Allocator, HLLPrecision>::value_per_cacheline;
 
 
 //========== ALIASED TYPES
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2017 Georgia Institute of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * mpi_test_async_insert.cpp
+ * Test the one-sided asynchronous insert (async_insert_begin / async_insert / async_insert_end) against the collective insert.
+ */
+
+#include "kmerhash/hash_new.hpp"
+#include "kmerhash/distributed_batched_robinhood_map.hpp"
+
+#include <gtest/gtest.h>
+#include <cstdint>  // for uint64_t, etc.
+#include <random>
+#include <vector>
+#include <utility>   // pair
+#include <algorithm>  // sort
+#include <functional>  // plus
+
+#include "mxx/env.hpp"
+#include "mxx/comm.hpp"
+#include "mxx/reduction.hpp"
+
+
+template <typename KM>
+using DistHash = ::fsc::hash::farm<KM>;
+template <typename KM>
+using StoreHash = ::fsc::hash::farm<KM>;
+
+template <typename Key>
+using MapParams = ::dsc::HashMapParams<Key,
+                                       bliss::transform::identity,
+                                       bliss::transform::identity,
+                                       DistHash,
+                                       std::equal_to,
+                                       bliss::transform::identity,
+                                       StoreHash,
+                                       std::equal_to>;
+
+using KeyType = uint64_t;
+using ValType = uint32_t;
+// sum reduction:  the result does not depend on the arrival order.
+using MapType = ::dsc::reduction_batched_robinhood_map<KeyType, ValType, MapParams, ::std::plus<ValType> >;
+
+
+class AsyncInsertTest : public ::testing::Test
+{
+protected:
+	static constexpr size_t count = 10007ULL;   // per rank.  odd, so batches are uneven.
+
+	std::vector<std::pair<KeyType, ValType> > input;
+
+	virtual void SetUp()
+	{
+		mxx::comm comm;
+
+		// keys repeat within and across ranks.
+		std::default_random_engine generator(comm.rank() + 1);
+		std::uniform_int_distribution<KeyType> key_dist(0, count * comm.size() / 4);
+		std::uniform_int_distribution<ValType> val_dist(1, 100);
+
+		input.clear();
+		for (size_t i = 0; i < count; ++i) {
+			input.emplace_back(key_dist(generator), val_dist(generator));
+		}
+	}
+
+	/// (key, value) for every input key, sorted.  find permutes the keys, and the results follow them.
+	std::vector<std::pair<KeyType, ValType> > lookup(MapType const & map) {
+		std::vector<KeyType> keys;
+		keys.reserve(input.size());
+		for (auto const & x : input) keys.emplace_back(x.first);
+
+		std::vector<ValType> vals(keys.size(), 0);
+		map.find(keys, vals.data());
+
+		std::vector<std::pair<KeyType, ValType> > res;
+		res.reserve(keys.size());
+		for (size_t i = 0; i < keys.size(); ++i) res.emplace_back(keys[i], vals[i]);
+		std::sort(res.begin(), res.end());
+		return res;
+	}
+};
+
+constexpr size_t AsyncInsertTest::count;
+
+
+// rank r makes 2r + 1 async_insert calls of uneven sizes, plus an empty one, with small rings so that puts wait on
+// full rings.  the table must match the collective insert of the same input.
+TEST_F(AsyncInsertTest, uneven_batches){
+	mxx::comm comm;
+
+	MapType gold(comm);
+	std::vector<std::pair<KeyType, ValType> > in(input.begin(), input.end());
+	gold.insert(in);
+
+	MapType test(comm);
+	test.async_insert_begin(256);
+
+	size_t batches = 2 * comm.rank() + 1;
+	size_t i = 0, n;
+	for (size_t b = 0; b < batches; ++b) {
+		// the last batch takes the rest.  the others grow from small to large.
+		n = (b == batches - 1) ? (input.size() - i) : ::std::min(input.size() - i, (b + 1) * input.size() / (batches * batches));
+		in.assign(input.begin() + i, input.begin() + i + n);
+		test.async_insert(in);
+		i += n;
+	}
+	in.clear();
+	test.async_insert(in);
+	test.async_insert_end();
+
+	EXPECT_EQ(gold.size(), test.size());
+	EXPECT_EQ(gold.local_size(), test.local_size());
+
+	std::vector<std::pair<KeyType, ValType> > expected = lookup(gold);
+	std::vector<std::pair<KeyType, ValType> > actual = lookup(test);
+	ASSERT_EQ(expected.size(), actual.size());
+	EXPECT_TRUE(std::equal(expected.begin(), expected.end(), actual.begin()));
+}
+
+// a rank with no input still takes part, and receives.
+TEST_F(AsyncInsertTest, idle_rank){
+	mxx::comm comm;
+	if (comm.rank() == 0) input.clear();
+
+	MapType gold(comm);
+	std::vector<std::pair<KeyType, ValType> > in(input.begin(), input.end());
+	gold.insert(in);
+
+	MapType test(comm);
+	test.async_insert_begin(256);
+	in.assign(input.begin(), input.end());
+	if (in.size() > 0) test.async_insert(in);
+	test.async_insert_end();
+
+	EXPECT_EQ(gold.size(), test.size());
+	EXPECT_EQ(gold.local_size(), test.local_size());
+}
+
+
+int main(int argc, char* argv[]) {
+	::testing::InitGoogleTest(&argc, argv);
+
+	mxx::env e(argc, argv);
+	mxx::comm comm;
+
+	// only rank 0 prints.
+	if (comm.rank() != 0) {
+		::testing::TestEventListeners& listeners = ::testing::UnitTest::GetInstance()->listeners();
+		delete listeners.Release(listeners.default_result_printer());
+	}
+
+	int result = RUN_ALL_TESTS();
+	// fail everywhere if any rank failed.
+	return mxx::allreduce(result, ::std::plus<int>(), comm);
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2017 Georgia Institute of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * mpi_test_query_session.cpp
+ * Test the persistent one-to-one query session over several rounds of different sizes, including empty ones:
+ * directly, against a known response, and through the distributed map's find, against find without a session.
+ */
+
+#include "kmerhash/hash_new.hpp"
+#include "kmerhash/distributed_batched_robinhood_map.hpp"
+
+#include <gtest/gtest.h>
+#include <cstdint>  // for uint64_t, etc.
+#include <random>
+#include <vector>
+#include <utility>   // pair
+#include <algorithm>  // sort
+#include <functional>  // plus
+
+#include "mxx/env.hpp"
+#include "mxx/comm.hpp"
+#include "mxx/reduction.hpp"
+
+
+template <typename KM>
+using DistHash = ::fsc::hash::farm<KM>;
+template <typename KM>
+using StoreHash = ::fsc::hash::farm<KM>;
+
+template <typename Key>
+using MapParams = ::dsc::HashMapParams<Key,
+                                       bliss::transform::identity,
+                                       bliss::transform::identity,
+                                       DistHash,
+                                       std::equal_to,
+                                       bliss::transform::identity,
+                                       StoreHash,
+                                       std::equal_to>;
+
+using KeyType = uint64_t;
+using ValType = uint32_t;
+using MapType = ::dsc::reduction_batched_robinhood_map<KeyType, ValType, MapParams, ::std::plus<ValType> >;
+
+
+/// per rank query count of a round.  round 0 is empty everywhere, round 2 is empty on even ranks, round 3 is larger
+/// than a block, and the rest vary by rank.
+static size_t round_size(size_t const & round, int const & rank) {
+	switch (round) {
+		case 0:  return 0;
+		case 2:  return (rank % 2 == 0) ? 0 : 37;
+		case 3:  return 5003 + rank * 101;
+		default: return (round * 131 + rank * 17) % 997;
+	}
+}
+static constexpr size_t rounds = 7;
+
+
+// responses are computed on the owner:  owner rank * 2^32 + query.  the requester knows the owner of each bucket.
+TEST(QuerySessionTest, rounds){
+	mxx::comm comm;
+	int comm_size = comm.size();
+	int comm_rank = comm.rank();
+
+	auto compute = [comm_rank](int src, uint64_t const * b, uint64_t const * e, uint64_t * out) {
+		for (; b != e; ++b, ++out) *out = (static_cast<uint64_t>(comm_rank) << 32) + *b;
+	};
+
+	// small blocks, so the larger rounds take several messages per peer.
+	::khmxx::incremental::query_session sess(comm, 512);
+
+	std::default_random_engine generator(comm_rank + 1);
+	std::uniform_int_distribution<uint64_t> dist(0, 0xFFFFFFFFULL);
+	for (size_t r = 0; r < rounds; ++r) {
+		size_t n = round_size(r, comm_rank);
+
+		// bucketed:  an uneven share to each peer.
+		std::vector<size_t> send_counts(comm_size, 0);
+		for (int i = 0; i < comm_size; ++i) send_counts[i] = n * (i + 1) * 2 / (comm_size * (comm_size + 1));
+		size_t total = 0;
+		for (int i = 0; i < comm_size; ++i) total += send_counts[i];
+		send_counts[comm_size - 1] += n - total;
+
+		std::vector<uint64_t> queries(n), expected(n), results(n, 0);
+		size_t k = 0;
+		for (int i = 0; i < comm_size; ++i) {
+			for (size_t j = 0; j < send_counts[i]; ++j, ++k) {
+				queries[k] = dist(generator);
+				expected[k] = (static_cast<uint64_t>(i) << 32) + queries[k];
+			}
+		}
+
+		sess.query_one_to_one(queries.data(), queries.data() + n, send_counts, compute, results.data());
+		EXPECT_TRUE(std::equal(expected.begin(), expected.end(), results.begin())) << "round " << r;
+	}
+}
+
+
+// find with a session matches find without one, round after round.
+TEST(QuerySessionTest, find_rounds){
+	mxx::comm comm;
+	int comm_rank = comm.rank();
+
+	std::default_random_engine generator(comm_rank + 1);
+	std::uniform_int_distribution<KeyType> key_dist(0, 20000);
+
+	// half of the key range is inserted, so about half of the queries miss.
+	MapType map(comm);
+	std::vector<std::pair<KeyType, ValType> > input;
+	for (size_t i = 0; i < 10007; ++i) {
+		KeyType k = key_dist(generator);
+		if (k % 2 == 0) input.emplace_back(k, static_cast<ValType>(k % 101 + 1));
+	}
+	map.insert(input);
+
+	for (size_t r = 0; r < rounds; ++r) {
+		std::vector<KeyType> keys(round_size(r, comm_rank));
+		for (size_t i = 0; i < keys.size(); ++i) keys[i] = key_dist(generator);
+
+		// find permutes the keys, and the results follow them.  compare as sorted (key, value).
+		std::vector<KeyType> gold_keys(keys);
+		std::vector<ValType> gold_vals(keys.size(), 0);
+		map.find(gold_keys, gold_vals.data());
+
+		map.start_query_session(512);
+		std::vector<ValType> vals(keys.size(), 0);
+		map.find(keys, vals.data());
+		map.stop_query_session();
+
+		std::vector<std::pair<KeyType, ValType> > expected, actual;
+		for (size_t i = 0; i < keys.size(); ++i) {
+			expected.emplace_back(gold_keys[i], gold_vals[i]);
+			actual.emplace_back(keys[i], vals[i]);
+		}
+		std::sort(expected.begin(), expected.end());
+		std::sort(actual.begin(), actual.end());
+		EXPECT_TRUE(std::equal(expected.begin(), expected.end(), actual.begin())) << "round " << r;
+	}
+}
+
+// one session across all rounds.
+TEST(QuerySessionTest, find_one_session){
+	mxx::comm comm;
+	int comm_rank = comm.rank();
+
+	std::default_random_engine generator(comm_rank + 1);
+	std::uniform_int_distribution<KeyType> key_dist(0, 20000);
+
+	MapType map(comm);
+	std::vector<std::pair<KeyType, ValType> > input;
+	for (size_t i = 0; i < 10007; ++i) {
+		KeyType k = key_dist(generator);
+		input.emplace_back(k, static_cast<ValType>(k % 101 + 1));
+	}
+	map.insert(input);
+
+	// every key is in the map, with value key % 101 + 1 times the number of inserts.  check against a gold find.
+	std::vector<std::vector<KeyType> > queries(rounds);
+	std::vector<std::vector<std::pair<KeyType, ValType> > > expected(rounds);
+	for (size_t r = 0; r < rounds; ++r) {
+		queries[r].resize(round_size(r, comm_rank));
+		for (size_t i = 0; i < queries[r].size(); ++i) queries[r][i] = key_dist(generator);
+
+		std::vector<KeyType> keys(queries[r]);
+		std::vector<ValType> vals(keys.size(), 0);
+		map.find(keys, vals.data());
+		for (size_t i = 0; i < keys.size(); ++i) expected[r].emplace_back(keys[i], vals[i]);
+		std::sort(expected[r].begin(), expected[r].end());
+	}
+
+	map.start_query_session(512);
+	for (size_t r = 0; r < rounds; ++r) {
+		std::vector<ValType> vals(queries[r].size(), 0);
+		map.find(queries[r], vals.data());
+
+		std::vector<std::pair<KeyType, ValType> > actual;
+		for (size_t i = 0; i < queries[r].size(); ++i) actual.emplace_back(queries[r][i], vals[i]);
+		std::sort(actual.begin(), actual.end());
+		EXPECT_TRUE(std::equal(expected[r].begin(), expected[r].end(), actual.begin())) << "round " << r;
+	}
+	map.stop_query_session();
+}
+
+
+int main(int argc, char* argv[]) {
+	::testing::InitGoogleTest(&argc, argv);
+
+	mxx::env e(argc, argv);
+	mxx::comm comm;
+
+	// only rank 0 prints.
+	if (comm.rank() != 0) {
+		::testing::TestEventListeners& listeners = ::testing::UnitTest::GetInstance()->listeners();
+		delete listeners.Release(listeners.default_result_printer());
+	}
+
+	int result = RUN_ALL_TESTS();
+	// fail everywhere if any rank failed.
+	return mxx::allreduce(result, ::std::plus<int>(), comm);
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2017 Georgia Institute of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * test_bounded_combiner.cpp
+ * Test bounded_combiner class
+ */
+
+#include "kmerhash/hash_new.hpp"
+
+#include "kmerhash/bounded_combiner.hpp"
+
+#include <gtest/gtest.h>
+#include <cstdint>  // for uint64_t, etc.
+#include <unordered_map>
+#include <random>   // rand, srand
+#include <vector>
+#include <algorithm>  // shuffle
+
+
+/*
+ * test class holding some information.  Also, needed for the typed tests
+ */
+template<typename HH>
+class BoundedCombinerTest : public ::testing::Test
+{
+protected:
+	using COMB = bounded_combiner<uint64_t, uint32_t>;
+
+	static constexpr size_t count = 100003ULL;
+	static constexpr size_t distinct = 1000ULL;   // high coverage:  ~100 copies per key.
+
+	std::vector<uint64_t> vals;
+	std::vector<decltype(::std::declval<HH>()(::std::declval<uint64_t>()))> hashes;
+	std::unordered_map<uint64_t, size_t> gold;
+
+	virtual void SetUp()
+	{
+		std::default_random_engine generator;
+		std::uniform_int_distribution<uint64_t> distribution;
+
+		std::vector<uint64_t> keys;
+		for (size_t i = 0; i < distinct; ++i) {
+			keys.emplace_back(distribution(generator));
+		}
+
+		HH hash;
+		vals.clear();
+		for (size_t i = 0; i < count; ++i) {
+			vals.emplace_back(keys[i % distinct]);
+		}
+		std::shuffle(vals.begin(), vals.end(), generator);
+
+		for (size_t i = 0; i < count; ++i) {
+			hashes.emplace_back(hash(vals[i]));
+			++gold[vals[i]];
+		}
+	}
+};
+
+template <typename HH>
+constexpr size_t BoundedCombinerTest<HH>::count;
+template <typename HH>
+constexpr size_t BoundedCombinerTest<HH>::distinct;
+
+// indicate this is a typed test
+TYPED_TEST_CASE_P(BoundedCombinerTest);
+
+
+// spilled aggregates sum to the true counts, and most repeats are absorbed when the distinct keys fit.
+TYPED_TEST_P(BoundedCombinerTest, reduce){
+	typename TestFixture::COMB comb(12);
+
+	std::unordered_map<uint64_t, size_t> result;
+	size_t spilled = 0;
+	auto spill = [&result, &spilled](std::pair<uint64_t, uint32_t> const & x) {
+		result[x.first] += x.second;
+		++spilled;
+	};
+
+	for (size_t i = 0; i < this->count; ++i) {
+		comb.insert(this->vals[i], this->hashes[i], 1U, spill);
+	}
+	comb.flush(spill);
+
+	EXPECT_EQ(this->gold.size(), result.size());
+	for (auto const & g : this->gold) {
+		EXPECT_EQ(g.second, result[g.first]);
+	}
+	EXPECT_EQ(this->count, spilled + comb.absorbed_count());
+	EXPECT_LT(spilled, this->count / 10);   // sheds > 90% with 1000 keys in 4096 slots.
+
+	// flush empties the table.
+	size_t before = spilled;
+	comb.flush(spill);
+	EXPECT_EQ(before, spilled);
+}
+
+// a tiny table still gives exact sums, with more spills.
+TYPED_TEST_P(BoundedCombinerTest, small){
+	typename TestFixture::COMB comb(1);
+	EXPECT_EQ(4UL, comb.capacity());   // at least 2 sets of 2.
+
+	std::unordered_map<uint64_t, size_t> result;
+	auto spill = [&result](std::pair<uint64_t, uint32_t> const & x) {
+		result[x.first] += x.second;
+	};
+
+	for (size_t i = 0; i < this->count; ++i) {
+		comb.insert(this->vals[i], this->hashes[i], 1U, spill);
+	}
+	comb.flush(spill);
+
+	EXPECT_EQ(this->gold.size(), result.size());
+	for (auto const & g : this->gold) {
+		EXPECT_EQ(g.second, result[g.first]);
+	}
+
+	comb.clear();
+	EXPECT_EQ(0UL, comb.absorbed_count());
+}
+
+
+// now register the test cases
+REGISTER_TYPED_TEST_CASE_P(BoundedCombinerTest, reduce, small);
+
+//////////////////// RUN the tests with different types.
+
+typedef ::testing::Types<
+		::fsc::hash::murmur<uint64_t>,
+		::fsc::hash::crc32c<uint64_t>,
+		::fsc::hash::farm<uint64_t>
+> BoundedCombinerTestTypes;
+INSTANTIATE_TYPED_TEST_CASE_P(Bliss, BoundedCombinerTest, BoundedCombinerTestTypes);
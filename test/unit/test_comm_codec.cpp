@@ -0,0 +1,181 @@
+/*
+ * Copyright 2017 Georgia Institute of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * test_comm_codec.cpp
+ * Test the block codec of the compressed exchange:  encode_block / decode_block round trips.
+ */
+
+#include "kmerhash/incremental_mxx.hpp"
+
+#include <gtest/gtest.h>
+#include <cstdint>  // for uint64_t, etc.
+#include <random>
+#include <vector>
+#include <utility>   // pair
+#include <algorithm>  // sort
+#include <cstring>    // memset
+
+
+using namespace ::khmxx::incremental::local;
+
+
+template <typename V>
+struct make_val {
+	inline V operator()(uint64_t const & k, uint64_t const & c) const { return static_cast<V>(k + c); }
+};
+template <typename A, typename B>
+struct make_val<::std::pair<A, B> > {
+	inline ::std::pair<A, B> operator()(uint64_t const & k, uint64_t const & c) const {
+		return ::std::pair<A, B>(static_cast<A>(k), static_cast<B>(c));
+	}
+};
+
+
+/*
+ * test class holding some information.  Also, needed for the typed tests
+ */
+template<typename V>
+class CommCodecTest : public ::testing::Test
+{
+protected:
+	static constexpr size_t count = 10007ULL;   // odd, so not a multiple of any block.
+
+	std::vector<V> vals;
+
+	virtual void SetUp()
+	{
+		// k-mer like keys sharing the high bits, and small counts:  compressible after sorting.
+		std::default_random_engine generator;
+		std::uniform_int_distribution<uint64_t> key_dist(0, 1000000);
+		std::uniform_int_distribution<uint64_t> count_dist(1, 100);
+
+		make_val<V> mk;
+		vals.clear();
+		for (size_t i = 0; i < count; ++i) {
+			vals.emplace_back(mk(0x1234567800000000ULL + key_dist(generator), count_dist(generator)));
+		}
+	}
+
+	/// encode with the requested mode, decode, and compare.  returns the mode used.
+	uint8_t check_round_trip(V const * b, size_t const & n, uint8_t const & mode, bool const & keep_order = false) {
+		std::vector<V> scratch;
+		std::vector<uint8_t> tmp, out;
+
+		uint8_t used = encode_block(b, n, mode, scratch, tmp, out, keep_order);
+		EXPECT_EQ(n, encoded_count(out.data()));
+		EXPECT_EQ(used, out[0]);
+
+		std::vector<V> decoded(n);
+		decode_block(out.data(), out.size(), tmp, decoded.data());
+
+		std::vector<V> expected(b, b + n);
+		if (used != raw_mode) {
+			// coded blocks are sorted, unless the order is kept.
+			if (!keep_order) std::sort(expected.begin(), expected.end(), &word_codec<V>::less);
+			EXPECT_LT(out.size(), codec_header_size + n * sizeof(V));
+		}
+		EXPECT_TRUE(std::equal(expected.begin(), expected.end(), decoded.begin()));
+		return used;
+	}
+};
+
+template <typename V>
+constexpr size_t CommCodecTest<V>::count;
+
+// indicate this is a typed test
+TYPED_TEST_CASE_P(CommCodecTest);
+
+
+// every mode round trips.  codable types are coded when it shrinks the block, the rest are sent raw.
+TYPED_TEST_P(CommCodecTest, round_trip){
+	size_t n = this->count;
+	TypeParam const * b = this->vals.data();
+
+	EXPECT_EQ(raw_mode, this->check_round_trip(b, n, raw_mode));
+
+	uint8_t used = this->check_round_trip(b, n, delta_mode);
+	EXPECT_EQ(word_codec<TypeParam>::enabled ? delta_mode : raw_mode, used);
+
+	used = this->check_round_trip(b, n, delta_lz4_mode);
+	if (word_codec<TypeParam>::enabled) EXPECT_NE(raw_mode, used);
+	else EXPECT_EQ(raw_mode, used);
+}
+
+// unsorted coding keeps the element order.
+TYPED_TEST_P(CommCodecTest, keep_order){
+	size_t n = this->count;
+	TypeParam const * b = this->vals.data();
+
+	this->check_round_trip(b, n, delta_mode, true);
+	this->check_round_trip(b, n, delta_lz4_mode, true);
+}
+
+// empty and single element blocks.
+TYPED_TEST_P(CommCodecTest, small_blocks){
+	EXPECT_EQ(raw_mode, this->check_round_trip(this->vals.data(), 0, delta_lz4_mode));
+	this->check_round_trip(this->vals.data(), 1, delta_mode);
+	this->check_round_trip(this->vals.data(), 1, delta_lz4_mode);
+}
+
+
+// now register the test cases
+REGISTER_TYPED_TEST_CASE_P(CommCodecTest, round_trip, keep_order, small_blocks);
+
+//////////////////// RUN the tests with different types.
+
+typedef ::testing::Types<
+		uint64_t,
+		::std::pair<uint64_t, uint64_t>,   // (k-mer, count), not trivially copyable but codable.
+		::std::pair<uint64_t, uint32_t>,   // padded, coded field by field.
+		uint32_t
+> CommCodecTestTypes;
+INSTANTIATE_TYPED_TEST_CASE_P(Bliss, CommCodecTest, CommCodecTestTypes);
+
+
+TEST(CommCodecTest, codable){
+	EXPECT_TRUE(word_codec<uint64_t>::enabled);
+	EXPECT_TRUE((word_codec<::std::pair<uint64_t, uint64_t> >::enabled));
+	EXPECT_TRUE((word_codec<::std::pair<uint64_t, uint32_t> >::enabled));
+	EXPECT_TRUE(word_codec<uint32_t>::enabled);
+	EXPECT_EQ(2UL, (word_codec<::std::pair<uint64_t, uint32_t> >::nwords));
+}
+
+// the padding of a (k-mer, uint32_t count) pair is not sent:  the coded block is no larger than for the same values
+// as (k-mer, uint64_t count).
+TEST(CommCodecTest, padding_not_sent){
+	std::vector<::std::pair<uint64_t, uint32_t> > narrow;
+	std::vector<::std::pair<uint64_t, uint64_t> > wide;
+	for (uint64_t i = 0; i < 1000; ++i) {
+		::std::pair<uint64_t, uint32_t> x;
+		memset(static_cast<void*>(&x), static_cast<int>(i & 0xFF), sizeof(x));   // garbage in the padding.
+		x.first = 0x1234567800000000ULL + i * 37;
+		x.second = static_cast<uint32_t>(i % 7 + 1);
+		narrow.emplace_back(x);
+		wide.emplace_back(x.first, x.second);
+	}
+
+	std::vector<::std::pair<uint64_t, uint32_t> > nscratch;
+	std::vector<::std::pair<uint64_t, uint64_t> > wscratch;
+	std::vector<uint8_t> tmp, nout, wout;
+	EXPECT_EQ(delta_mode, encode_block(narrow.data(), narrow.size(), delta_mode, nscratch, tmp, nout, true));
+	EXPECT_EQ(delta_mode, encode_block(wide.data(), wide.size(), delta_mode, wscratch, tmp, wout, true));
+	EXPECT_EQ(wout.size(), nout.size());
+
+	std::vector<::std::pair<uint64_t, uint32_t> > decoded(narrow.size());
+	decode_block(nout.data(), nout.size(), tmp, decoded.data());
+	EXPECT_TRUE(std::equal(narrow.begin(), narrow.end(), decoded.begin()));
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2017 Georgia Institute of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * test_comm_trace.cpp
+ * Test comm_trace summary, straggler detection, and Chrome trace output
+ */
+
+#ifndef KHMXX_COMM_TRACE
+#define KHMXX_COMM_TRACE
+#endif
+
+#include "kmerhash/comm_trace.hpp"
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+using namespace ::khmxx::trace;
+
+
+// totals per lane, union of overlapping inflight intervals, and overlap efficiency.
+TEST(CommTraceTest, summarize){
+	comm_trace t;
+
+	t.record("x", lane::call, -1, 0.0, 100.0);
+	t.record("x", lane::post, 1, 0.0, 2.0, 1000);
+	t.record("x", lane::post_recv, 2, 2.0, 3.0, 500);
+	// inflight [0, 40) and [30, 60) overlap, [70, 80) is separate:  union 70.
+	// waits [35, 42) and [55, 62) are inside the union for 7 + 5.  [90, 95) is outside, e.g. a final send waitall.
+	t.record("x", lane::inflight, 1, 0.0, 40.0, 1000);
+	t.record("x", lane::inflight, 2, 30.0, 60.0, 500);
+	t.record("x", lane::inflight, 3, 70.0, 80.0, 10);
+	t.record("x", lane::wait, 1, 35.0, 42.0);
+	t.record("x", lane::wait, 2, 55.0, 62.0);
+	t.record("x", lane::wait, -1, 90.0, 95.0);
+	t.record("x", lane::compute, 1, 42.0, 55.0, 1000);
+
+	summary s = t.summarize();
+	EXPECT_DOUBLE_EQ(100.0, s.call);
+	EXPECT_DOUBLE_EQ(3.0, s.post);
+	EXPECT_DOUBLE_EQ(1000.0, s.sent);
+	EXPECT_DOUBLE_EQ(500.0, s.received);
+	EXPECT_DOUBLE_EQ(70.0, s.inflight);
+	EXPECT_DOUBLE_EQ(19.0, s.wait);
+	EXPECT_DOUBLE_EQ(12.0, s.exposed);
+	EXPECT_DOUBLE_EQ(13.0, s.compute);
+	EXPECT_DOUBLE_EQ(1.0 - 12.0 / 70.0, s.overlap);
+	EXPECT_DOUBLE_EQ(81.0, s.busy());
+
+	t.clear();
+	EXPECT_EQ(0UL, t.get_events().size());
+	EXPECT_DOUBLE_EQ(1.0, t.summarize().overlap);   // nothing received, nothing exposed.
+}
+
+// a wrapper exchange and the exchange it calls record nested calls.  the call time counts once.
+TEST(CommTraceTest, nested_calls){
+	comm_trace t;
+	t.record("ialltoallv_and_query_one_to_one_adaptive", lane::call, -1, 0.0, 100.0);
+	t.record("ialltoall_and_query_one_to_one", lane::call, -1, 10.0, 90.0);
+	t.record("ialltoallv_and_modify", lane::call, -1, 120.0, 150.0);
+	t.record("x", lane::wait, -1, 20.0, 30.0);
+
+	summary s = t.summarize();
+	EXPECT_DOUBLE_EQ(130.0, s.call);
+	EXPECT_DOUBLE_EQ(120.0, s.busy());
+}
+
+// ranks busier than the median by more than 10%, slowest first.
+TEST(CommTraceTest, stragglers){
+	std::vector<summary> all(6, summary{100.0, 10.0, 50.0, 1.0, 20.0, 5.0, 0.0, 0.0, 0.75});
+	all[2].call = 130.0;   // busy 120
+	all[4].call = 150.0;   // busy 140
+	all[5].call = 105.0;   // busy 95, within tolerance
+
+	std::vector<int> s = find_stragglers(all);
+	ASSERT_EQ(2UL, s.size());
+	EXPECT_EQ(4, s[0]);
+	EXPECT_EQ(2, s[1]);
+
+	EXPECT_EQ(0UL, find_stragglers(std::vector<summary>()).size());
+
+	std::stringstream ss;
+	print_summary(all, ss);
+	EXPECT_NE(std::string::npos, ss.str().find("comm_trace stragglers: 4 2"));
+}
+
+// one metadata event per lane, one complete event per interval, with rank as pid.
+TEST(CommTraceTest, dump){
+	comm_trace t;
+	t.record("ialltoallv_and_modify", lane::compute, 3, 1.0, 2.5, 64);
+	t.record("ialltoallv_and_modify", lane::wait, 3, 2.5, 4.0);
+
+	std::stringstream ss;
+	t.dump(ss, 7);
+	std::string out = ss.str();
+
+	size_t meta = 0, complete = 0;
+	for (size_t pos = out.find("\"ph\":\"M\""); pos != std::string::npos; pos = out.find("\"ph\":\"M\"", pos + 1)) ++meta;
+	for (size_t pos = out.find("\"ph\":\"X\""); pos != std::string::npos; pos = out.find("\"ph\":\"X\"", pos + 1)) ++complete;
+	EXPECT_EQ(static_cast<size_t>(num_lanes), meta);
+	EXPECT_EQ(2UL, complete);
+	EXPECT_NE(std::string::npos, out.find("\"pid\":7"));
+	EXPECT_NE(std::string::npos, out.find("\"name\":\"ialltoallv_and_modify\",\"cat\":\"compute\""));
+	EXPECT_NE(std::string::npos, out.find("\"peer\":3,\"bytes\":64"));
+	EXPECT_EQ(0UL, out.find("{\"traceEvents\":["));
+}
+
+// the macros record into the process wide trace.
+TEST(CommTraceTest, macros){
+	comm_trace::get().clear();
+	{
+		KHMXX_TRACE_CALL("scope");
+		KHMXX_TRACE_START(t_compute);
+		KHMXX_TRACE_END(t_compute, "scope", compute, 1, 8);
+	}
+	std::vector<event> const & e = comm_trace::get().get_events();
+	ASSERT_EQ(2UL, e.size());
+	EXPECT_EQ(static_cast<uint8_t>(compute), e[0].lane);
+	EXPECT_EQ(1, e[0].peer);
+	EXPECT_EQ(8UL, e[0].bytes);
+	EXPECT_EQ(static_cast<uint8_t>(call), e[1].lane);
+	EXPECT_LE(e[1].start, e[0].start);
+	EXPECT_GE(e[1].end, e[0].end);
+	comm_trace::get().clear();
+}
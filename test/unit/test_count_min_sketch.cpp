@@ -0,0 +1,157 @@
+/*
+ * Copyright 2017 Georgia Institute of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * test_count_min_sketch.cpp
+ * Test count_min_sketch class
+ */
+
+#include "kmerhash/hash_new.hpp"
+
+#include "kmerhash/count_min_sketch.hpp"
+
+#include <gtest/gtest.h>
+#include <cstdint>  // for uint64_t, etc.
+#include <unordered_map>
+#include <random>   // rand, srand
+#include <vector>
+#include <algorithm>  // shuffle
+
+
+/*
+ * test class holding some information.  Also, needed for the typed tests
+ */
+template<typename HH>
+class CountMinSketchTest : public ::testing::Test
+{
+protected:
+	using CMS = count_min_sketch<uint64_t, HH>;
+
+	static constexpr size_t count = 100003ULL;   // not a multiple of the batch size.
+	static constexpr size_t heavy_count = 5000ULL;
+
+	std::vector<uint64_t> vals;
+	std::vector<typename CMS::HVT> hashes;
+	std::unordered_map<uint64_t, size_t> gold;
+
+	virtual void SetUp()
+	{
+		std::default_random_engine generator;
+		std::uniform_int_distribution<uint64_t> distribution;
+
+		HH hash;
+		vals.clear();
+		for (size_t i = 0; i < count; ++i) {
+			// 3 heavy hitters, mixed with uniform random values.
+			if (i < 3 * heavy_count) vals.emplace_back(i % 3);
+			else vals.emplace_back(distribution(generator));
+		}
+		std::shuffle(vals.begin(), vals.end(), generator);
+
+		for (size_t i = 0; i < count; ++i) {
+			hashes.emplace_back(hash(vals[i]));
+			++gold[vals[i]];
+		}
+	}
+};
+
+template <typename HH>
+constexpr size_t CountMinSketchTest<HH>::count;
+template <typename HH>
+constexpr size_t CountMinSketchTest<HH>::heavy_count;
+
+// indicate this is a typed test
+TYPED_TEST_CASE_P(CountMinSketchTest);
+
+
+// estimates are at least the true count, and within the error bound.  heavy hitters are found.
+TYPED_TEST_P(CountMinSketchTest, estimate){
+	typename TestFixture::CMS cms;
+
+	for (size_t i = 0; i < this->count; ++i) {
+		cms.update_via_hashval(this->hashes[i]);
+	}
+	EXPECT_EQ(this->count, cms.total());
+
+	size_t bound = static_cast<size_t>(TestFixture::CMS::est_error_rate * static_cast<double>(this->count)) + 1;
+	size_t over = 0;
+	for (auto const & g : this->gold) {
+		size_t est = cms.estimate(g.first);
+		EXPECT_GE(est, g.second);
+		if (est > g.second + bound) ++over;
+	}
+	EXPECT_LT(over, this->gold.size() / 20);  // failure probability is e^-depth, < 2%.
+
+	TypeParam hash;
+	size_t threshold = this->heavy_count / 2;
+	size_t heavy = 0;
+	for (auto const & g : this->gold) {
+		if (cms.is_heavy_via_hashval(hash(g.first), threshold)) ++heavy;
+	}
+	EXPECT_EQ(3UL, heavy);
+}
+
+// batch update and merge give the same counters as single updates.
+TYPED_TEST_P(CountMinSketchTest, batch_and_merge){
+	typename TestFixture::CMS single, batch, half1, half2;
+
+	for (size_t i = 0; i < this->count; ++i) {
+		single.update_via_hashval(this->hashes[i]);
+	}
+	batch.update_via_hashval(this->hashes.data(), this->count);
+
+	size_t half = this->count / 2;
+	half1.update_via_hashval(this->hashes.data(), half);
+	half2.update_via_hashval(this->hashes.data() + half, this->count - half);
+	half1.merge(half2);
+
+	EXPECT_EQ(single.total(), batch.total());
+	EXPECT_EQ(single.total(), half1.total());
+	for (size_t i = 0; i < this->count; ++i) {
+		EXPECT_EQ(single.estimate_via_hashval(this->hashes[i]), batch.estimate_via_hashval(this->hashes[i]));
+		EXPECT_EQ(single.estimate_via_hashval(this->hashes[i]), half1.estimate_via_hashval(this->hashes[i]));
+	}
+
+	half1.clear();
+	EXPECT_EQ(0UL, half1.total());
+	EXPECT_EQ(0UL, half1.estimate_via_hashval(this->hashes[0]));
+}
+
+// default counters do not overflow past 2^32, e.g. a global k-mer total after merge.
+TYPED_TEST_P(CountMinSketchTest, large_count){
+	typename TestFixture::CMS a, b;
+	size_t large = (0x1ULL << 32) + 5ULL;
+
+	a.update_via_hashval(this->hashes[0], large);
+	b.update_via_hashval(this->hashes[0], large);
+	a.merge(b);
+	EXPECT_EQ(2 * large, a.total());
+	EXPECT_GE(a.estimate_via_hashval(this->hashes[0]), 2 * large);
+}
+
+
+// now register the test cases
+REGISTER_TYPED_TEST_CASE_P(CountMinSketchTest, estimate, batch_and_merge, large_count);
+
+//////////////////// RUN the tests with different types.
+
+typedef ::testing::Types<
+		::fsc::hash::murmur<uint64_t>,
+		::fsc::hash::murmur32<uint64_t>,
+		::fsc::hash::crc32c<uint64_t>,
+		::fsc::hash::farm<uint64_t>
+> CountMinSketchTestTypes;
+INSTANTIATE_TYPED_TEST_CASE_P(Bliss, CountMinSketchTest, CountMinSketchTestTypes);
@@ -46,6 +46,7 @@
 #define NO_RESIZE 1
 #define RESIZE 2
 #define INTEGRATED 3
+#define BY_HASH 4
 //#define SORT 4
 //#define SHUFFLE 5
 
@@ -106,6 +107,14 @@ class Hashtable_OARHDO_PrefixTest : public ::testing::Test
     	  case RESIZE:
     		  test.insert(this->temp.data(), this->temp.data() + this->temp.size());
     		  break;
+    	  case BY_HASH:
+    	  {
+    		  typename MAP::hasher h;
+    		  ::std::vector<decltype(h(T()))> hvals(this->temp.size());
+    		  for (size_t i = 0; i < this->temp.size(); ++i) hvals[i] = h(this->temp[i].first);
+    		  test.insert_by_hash(this->temp.data(), this->temp.data() + this->temp.size(), hvals.data());
+    		  break;
+    	  }
 //    	  case INTEGRATED:
 //    		  test.insert_integrated(this->temp);
 //    		  break;
@@ -184,6 +193,11 @@ TYPED_TEST_P(Hashtable_OARHDO_PrefixTest, insert_iterator)
 	this->test_insert(RESIZE);
 }
 
+TYPED_TEST_P(Hashtable_OARHDO_PrefixTest, insert_by_hash)
+{
+	this->test_insert(BY_HASH);
+}
+
 //TYPED_TEST_P(Hashtable_OARHDO_PrefixTest, insert_integrated)
 //{
 //	this->test_insert(INTEGRATED);
@@ -338,6 +352,7 @@ TYPED_TEST_P(Hashtable_OARHDO_PrefixTest, count)
 REGISTER_TYPED_TEST_CASE_P(Hashtable_OARHDO_PrefixTest,
 		insert_no_estimate,
 		insert_iterator,
+		insert_by_hash,
 //		insert_integrated,
 //		insert_sort,
 //		insert_shuffle,
@@ -274,6 +274,84 @@ TYPED_TEST_P(HyperLogLog64Test, estimate_by_hash_batch){
 }
 
 
+// batch update (SIMD when available) should give the same registers, hence estimate, as the scalar update.
+TYPED_TEST_P(HyperLogLog64Test, batch_same_as_single){
+
+    using HLL = hyperloglog64<
+    		typename TypeParam::Type,
+    		typename TypeParam::Hash,
+			TypeParam::precision>;
+	HLL single(TypeParam::ignore);
+	HLL batch(TypeParam::ignore);
+
+	typename TypeParam::Hash hash;
+	std::vector<typename HLL::HVT> hashes;
+	hashes.reserve(this->iterations * this->step + 3);   // not a multiple of vector width
+	for (size_t s = 0; s < this->iterations * this->step + 3; ++s) {
+		hashes.emplace_back(hash(this->distribution(this->generator)));
+		single.update_via_hashval(hashes.back());
+	}
+	batch.update_via_hashval(hashes.data(), hashes.size());
+
+	EXPECT_EQ(single.estimate(), batch.estimate());
+}
+
+
+// sparse (hyperloglog++) should give the same registers as dense when converted, and merge in any combination.
+TYPED_TEST_P(HyperLogLog64Test, sparse_same_as_dense){
+
+    using HLL = hyperloglog64<
+    		typename TypeParam::Type,
+    		typename TypeParam::Hash,
+			TypeParam::precision>;
+	HLL dense(TypeParam::ignore);
+	HLL sparse(TypeParam::ignore, true);
+	HLL sparse2(TypeParam::ignore, true);
+	EXPECT_TRUE(sparse.is_sparse());
+
+	typename TypeParam::Hash hash;
+	std::vector<typename HLL::HVT> hashes;
+	for (size_t s = 0; s < this->iterations * this->step; ++s) {
+		hashes.emplace_back(hash(this->distribution(this->generator)));
+	}
+
+	// few values:  stays sparse.
+	size_t few = 20;
+	dense.update_via_hashval(hashes.data(), few);
+	sparse.update_via_hashval(hashes.data(), few);
+	EXPECT_TRUE(sparse.is_sparse());
+
+	// merge sparse into sparse.
+	sparse2.update_via_hashval(hashes.data() + few, few);
+	dense.update_via_hashval(hashes.data() + few, few);
+	sparse.merge(sparse2);
+	EXPECT_TRUE(sparse.is_sparse());
+
+	HLL converted(sparse);
+	converted.make_dense();
+	EXPECT_FALSE(converted.is_sparse());
+	EXPECT_EQ(dense.estimate(), converted.estimate());
+
+	// all values:  converts to dense on the way.
+	dense.update_via_hashval(hashes.data() + 2 * few, hashes.size() - 2 * few);
+	for (size_t s = 2 * few; s < hashes.size(); ++s) {
+		sparse.update_via_hashval(hashes[s]);
+	}
+	EXPECT_FALSE(sparse.is_sparse());
+	EXPECT_EQ(dense.estimate(), sparse.estimate());
+
+	// merge sparse into dense, and dense into sparse.
+	HLL sparse3(TypeParam::ignore, true);
+	sparse3.update_via_hashval(hashes.data(), few);
+	HLL dense2(TypeParam::ignore);
+	dense2.update_via_hashval(hashes.data() + few, hashes.size() - few);
+	HLL dense3(dense2);
+	dense2.merge(sparse3);
+	sparse3.merge(dense3);
+	EXPECT_EQ(dense.estimate(), dense2.estimate());
+	EXPECT_EQ(dense.estimate(), sparse3.estimate());
+}
+
 
 // testing the copy constructor
 TYPED_TEST_P(HyperLogLog64Test, merge){
@@ -342,7 +420,9 @@ REGISTER_TYPED_TEST_CASE_P(HyperLogLog64Test,
 		estimate_by_hash,
 		merge, swap,
 		estimate_batch,
-		estimate_by_hash_batch);
+		estimate_by_hash_batch,
+		batch_same_as_single,
+		sparse_same_as_dense);
 
 //////////////////// RUN the tests with different types.
 
@@ -456,3 +536,39 @@ typedef ::testing::Types<
 
 > HyperLogLog64TestTypes;
 INSTANTIATE_TYPED_TEST_CASE_P(Bliss, HyperLogLog64Test, HyperLogLog64TestTypes);
+
+
+// predicted cardinality for reserving ahead across insert batches.
+TEST(HyperLogLog64GrowthTest, predict) {
+	hll_growth_predictor growth;
+
+	EXPECT_EQ(100.0, growth.predict(100.0));   // first batch is not extrapolated.
+	EXPECT_EQ(300.0, growth.predict(200.0));   // grew by 100, expect the same for the next batch.
+	EXPECT_EQ(200.0, growth.predict(200.0));   // no new elements.
+
+	growth.set_lookahead(2.0);
+	EXPECT_EQ(350.0, growth.predict(250.0));   // grew by 50, reserve for 2 more batches.
+
+	growth.reset();
+	EXPECT_EQ(50.0, growth.predict(50.0));
+}
+
+// exact distinct count of hash values, including duplicates and the hash value 0.
+TEST(HyperLogLog64ExactTest, count_distinct) {
+	std::default_random_engine generator;
+	std::uniform_int_distribution<uint64_t> distribution;
+
+	std::vector<uint64_t> hvals;
+	std::unordered_set<uint64_t> gold;
+	EXPECT_EQ(0UL, count_distinct_hashvals(hvals.data(), hvals.size()));
+
+	for (size_t i = 0; i < 10007; ++i) {
+		hvals.emplace_back((i % 3 == 0) ? (i % 101) : distribution(generator));   // many duplicates of small values, 0 included.
+		gold.insert(hvals.back());
+	}
+	EXPECT_EQ(gold.size(), count_distinct_hashvals(hvals.data(), hvals.size()));
+
+	std::vector<uint32_t> hvals32(hvals.begin(), hvals.end());
+	std::unordered_set<uint32_t> gold32(hvals32.begin(), hvals32.end());
+	EXPECT_EQ(gold32.size(), count_distinct_hashvals(hvals32.data(), hvals32.size()));
+}
@@ -396,6 +396,24 @@ protected:
 
     op2.hash(this->kmers.data(), this->iterations, test2.data());
 
+    // batch output should match the single element output.  iterations is not a multiple of the batch size.
+    for (size_t i = 0; i < this->iterations; ++i)
+    {
+      EXPECT_EQ(op(this->kmers[i]), test[i]);
+      EXPECT_EQ(op2(this->kmers[i]), test2[i]);
+    }
+
+    // short inputs, all tail.
+    std::vector<OT> tail(2 * H<T>::batch_size + 1, 0);
+    for (size_t n = 1; n <= tail.size(); ++n)
+    {
+      op.hash(this->kmers.data(), n, tail.data());
+      for (size_t i = 0; i < n; ++i)
+      {
+        EXPECT_EQ(op(this->kmers[i]), tail[i]);
+      }
+    }
+
     bool diff = (test[0] != test2[0]);
 
     bool no_collision1 = true;
@@ -422,6 +440,33 @@ protected:
       ASSERT_TRUE(no_collision2);
     }
   }
+  /// narrowed hash should equal the folded 64 bit hash, in single and batch mode, and be 32 bit.
+  template <template <typename> class H>
+  void hash_narrowed(std::string name)
+  {
+    using NH = ::fsc::hash::narrowed_hash<T, H>;
+    static_assert(::std::is_same<typename NH::result_type, uint32_t>::value, "narrowed hash should be 32 bit");
+    static_assert(::std::is_same<typename ::fsc::hash::hash_width_policy<H, 24>::template hash<T>, NH>::value, "small capacity should narrow");
+    static_assert(::std::is_same<typename ::fsc::hash::hash_width_policy<H, 32>::template hash<T>, H<T> >::value, "large capacity should not narrow");
+
+    H<T> wide;
+    NH op;
+
+    std::vector<uint32_t> test(this->iterations, 0);
+    op(this->kmers.data(), this->iterations, test.data());
+
+    uint64_t h;
+    bool same = true;
+    for (size_t i = 0; i < this->iterations; ++i)
+    {
+      h = wide(this->kmers[i]);
+      same &= (test[i] == static_cast<uint32_t>(h ^ (h >> 32)));
+      same &= (test[i] == op(this->kmers[i]));
+    }
+    if (!same)
+      printf("ERROR: hash %s batch and single narrowed hash values differ.", name.c_str());
+    ASSERT_TRUE(same);
+  }
 };
 
 template <typename T>
@@ -519,6 +564,11 @@ TYPED_TEST_P(KmerHashTest, murmur64avx_batch)
   this->template hash_vector_vs_sse_batch<fsc::hash::murmur_x86, fsc::hash::murmur3avx64, uint64_t>(std::string("murmur3_64_vs_avx_batch"));
 }
 
+TYPED_TEST_P(KmerHashTest, murmur64avx_narrowed)
+{
+  this->template hash_narrowed<fsc::hash::murmur3avx64>(std::string("murmur3_64_avx_narrowed"));
+}
+
 
 #endif
 
@@ -533,6 +583,16 @@ TYPED_TEST_P(KmerHashTest, crc32c_batch)
   this->template hash_crc32c_batch<::fsc::hash::crc32c>(std::string("crc32c_seed_batch"));
 }
 
+TYPED_TEST_P(KmerHashTest, crc32c64)
+{
+  this->template hash_crc32c<::fsc::hash::crc32c64, uint64_t>(std::string("crc32c64_seed"));
+}
+
+TYPED_TEST_P(KmerHashTest, crc32c64_batch)
+{
+  this->template hash_crc32c_batch<::fsc::hash::crc32c64, uint64_t>(std::string("crc32c64_seed_batch"));
+}
+
 #endif
 
 REGISTER_TYPED_TEST_CASE_P(KmerHashTest, iden, murmur, farm,
@@ -543,11 +603,11 @@ REGISTER_TYPED_TEST_CASE_P(KmerHashTest, iden, murmur, farm,
 #endif
 #if defined(__AVX2__)
                            murmur32avx, murmur32avx_batch,
-						   murmur64avx, murmur64avx_batch,
+						   murmur64avx, murmur64avx_batch, murmur64avx_narrowed,
 						   clhash,
 #endif
 #if defined(__SSE4_2__)
-                           crc32c, crc32c_batch,
+                           crc32c, crc32c_batch, crc32c64, crc32c64_batch,
 #endif
                            stdcpp);
 
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2017 Georgia Institute of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file    test_kmer_transform_avx.cpp
+ * @ingroup
+ * @author  tpan
+ * @brief
+ * @details batched canonicalization transforms should produce the same results as the bliss scalar transforms.
+ *
+ */
+
+#include "utils/logging.h"
+
+// include google test
+#include <gtest/gtest.h>
+#include "kmerhash/hash_new.hpp"
+#include "kmerhash/kmer_transform_avx.hpp"
+
+#include <cstdint>
+#include <vector>
+
+#include "common/kmer.hpp"
+#include "common/alphabets.hpp"
+#include "common/kmer_transform.hpp"
+
+template <typename T>
+class KmerTransformTest : public ::testing::Test
+{
+protected:
+  static std::vector<T> kmers;
+
+  static constexpr size_t iterations = 10003;  // not a multiple of batch size.
+
+public:
+  static void SetUpTestCase()
+  {
+    T kmer;
+
+    srand(0);
+    for (unsigned int i = 0; i < T::size; ++i)
+    {
+      kmer.nextFromChar(rand() % T::KmerAlphabet::SIZE);
+    }
+
+    kmers.resize(iterations);
+    for (size_t i = 0; i < iterations; ++i)
+    {
+      kmers[i] = kmer;
+      kmer.nextFromChar(rand() % T::KmerAlphabet::SIZE);
+    }
+  }
+
+  static void TearDownTestCase()
+  {
+    std::vector<T>().swap(kmers);
+  }
+
+protected:
+  template <template <typename> class BATCH, template <typename> class GOLD>
+  void transform(std::string name)
+  {
+    BATCH<T> op;
+    GOLD<T> gold;
+
+    std::vector<T> test(this->iterations);
+    op(this->kmers.data(), this->iterations, test.data());
+
+    bool same = true;
+    for (size_t i = 0; i < this->iterations; ++i)
+    {
+      same &= (test[i] == gold(this->kmers[i]));
+      same &= (op(this->kmers[i]) == gold(this->kmers[i]));
+    }
+    if (!same)
+      BL_DEBUGF("ERROR: batched transform %s differs from scalar transform.", name.c_str());
+    ASSERT_TRUE(same);
+
+    // in place.
+    test.assign(this->kmers.begin(), this->kmers.end());
+    op(test.data(), this->iterations, test.data());
+    for (size_t i = 0; i < this->iterations; ++i)
+    {
+      same &= (test[i] == gold(this->kmers[i]));
+    }
+    ASSERT_TRUE(same);
+  }
+
+  template <template <typename> class BATCH, template <typename> class GOLD>
+  void transformed_hash(std::string name)
+  {
+    ::fsc::hash::TransformedHash<T, ::fsc::hash::murmur, BATCH> op;
+    ::fsc::hash::TransformedHash<T, ::fsc::hash::murmur, GOLD> gold;
+
+    std::vector<uint64_t> test(this->iterations);
+    std::vector<uint64_t> test2(this->iterations);
+
+    op(this->kmers.data(), this->iterations, test.data());
+    gold(this->kmers.data(), this->iterations, test2.data());
+
+    bool same = true;
+    for (size_t i = 0; i < this->iterations; ++i)
+    {
+      same &= (test[i] == test2[i]);
+    }
+    if (!same)
+      BL_DEBUGF("ERROR: TransformedHash with batched transform %s differs from scalar transform.", name.c_str());
+    ASSERT_TRUE(same);
+  }
+};
+
+template <typename T>
+constexpr size_t KmerTransformTest<T>::iterations;
+
+template <typename T>
+std::vector<T> KmerTransformTest<T>::kmers;
+
+// indicate this is a typed test
+TYPED_TEST_CASE_P(KmerTransformTest);
+
+TYPED_TEST_P(KmerTransformTest, lex_less)
+{
+  this->template transform<::fsc::kmer::transform::lex_less, ::bliss::kmer::transform::lex_less>(std::string("lex_less"));
+}
+
+TYPED_TEST_P(KmerTransformTest, xor_rev_comp)
+{
+  this->template transform<::fsc::kmer::transform::xor_rev_comp, ::bliss::kmer::transform::xor_rev_comp>(std::string("xor_rev_comp"));
+}
+
+TYPED_TEST_P(KmerTransformTest, lex_less_hash)
+{
+  this->template transformed_hash<::fsc::kmer::transform::lex_less, ::bliss::kmer::transform::lex_less>(std::string("lex_less"));
+}
+
+REGISTER_TYPED_TEST_CASE_P(KmerTransformTest, lex_less, xor_rev_comp, lex_less_hash);
+
+//////////////////// RUN the tests with different types.
+
+typedef ::testing::Types<
+    ::bliss::common::Kmer< 31, bliss::common::DNA,   uint64_t>,  // 1 word, not full, SIMD
+    ::bliss::common::Kmer< 32, bliss::common::DNA,   uint64_t>,  // 1 word, full, SIMD
+    ::bliss::common::Kmer< 21, bliss::common::DNA,   uint64_t>,  // 1 word, not full, SIMD
+    ::bliss::common::Kmer<  1, bliss::common::DNA,   uint64_t>,  // 1 word, not full, SIMD
+    ::bliss::common::Kmer< 63, bliss::common::DNA,   uint64_t>,  // 2 words, scalar
+    ::bliss::common::Kmer< 31, bliss::common::DNA,   uint32_t>,  // 2 words, scalar
+    ::bliss::common::Kmer< 21, bliss::common::DNA5,  uint64_t>,  // 1 word, scalar
+    ::bliss::common::Kmer< 15, bliss::common::DNA16, uint64_t>   // 1 word, scalar
+    >
+    KmerTransformTestTypes;
+INSTANTIATE_TYPED_TEST_CASE_P(Bliss, KmerTransformTest, KmerTransformTestTypes);